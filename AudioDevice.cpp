@@ -0,0 +1,54 @@
+#include <cstdio>
+#include "AudioDevice.h"
+#include "ToneSynth.h"
+
+AudioDevice::AudioDevice() :
+    m_device(0),
+    m_bufferSamples(0)
+{
+}
+
+AudioDevice::~AudioDevice()
+{
+    Close();
+}
+
+int AudioDevice::Open(ToneSynth& synth)
+{
+    if (SDL_InitSubSystem(SDL_INIT_AUDIO) < 0)
+        return 1;
+
+    // mono 16 bit. A small buffer keeps the delay between a timer edge and hearing it short
+    SDL_AudioSpec desired;
+    SDL_zero(desired);
+    desired.freq = synth.GetSampleRate();
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = 512;
+    desired.callback = FillBuffer;
+    desired.userdata = &synth;
+
+    SDL_AudioSpec obtained;
+    m_device = SDL_OpenAudioDevice(NULL, 0, &desired, &obtained, 0);
+    if (m_device == 0)
+        return 2;
+
+    m_bufferSamples = obtained.samples;
+    SDL_PauseAudioDevice(m_device, 0);
+    return 0;
+}
+
+void AudioDevice::Close()
+{
+    if (m_device == 0)
+        return;
+
+    SDL_CloseAudioDevice(m_device);
+    m_device = 0;
+}
+
+void SDLCALL AudioDevice::FillBuffer(void* userData, Uint8* stream, int length)
+{
+    ToneSynth* synth = static_cast<ToneSynth*>(userData);
+    synth->Render(reinterpret_cast<int16_t*>(stream), length / (int)sizeof(int16_t));
+}
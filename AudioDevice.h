@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <SDL.h>
+
+class ToneSynth;
+
+// Plays a ToneSynth through the default SDL audio device. SDL pulls samples from its own audio thread
+class AudioDevice
+{
+public:
+    AudioDevice();
+
+    // closes the device if it's open
+    ~AudioDevice();
+
+    // opens the default output device and starts playing synth, which must outlive the device.
+    // returns 0 if no errors. Otherwise returns an error code.
+    int Open(ToneSynth& synth);
+
+    void Close();
+
+    // samples per device buffer, as granted by SDL
+    int GetBufferSamples() const { return m_bufferSamples; }
+
+private:
+    // SDL audio callback. Runs on the audio thread
+    static void SDLCALL FillBuffer(void* userData, Uint8* stream, int length);
+
+    SDL_AudioDeviceID m_device;
+    int m_bufferSamples;
+};
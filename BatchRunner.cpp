@@ -0,0 +1,201 @@
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include "BatchRunner.h"
+#include "Chip8.h"
+#include "InputMovie.h"
+#include "ThreadPool.h"
+
+namespace
+{
+    // quirk profiles the core knows how to run, and the machine and quirks each one needs.
+    // returns false for an unknown profile
+    bool LookupQuirkProfile(const std::string& name, MachineType& machine, QuirkProfile& quirks)
+    {
+        quirks = QUIRKS_DEFAULT;
+        if (name == "chip8")
+            machine = MACHINE_CHIP8;
+        else if (name == "cosmac")
+        {
+            machine = MACHINE_CHIP8;
+            quirks = QUIRKS_COSMAC;
+        }
+        else if (name == "schip")
+        {
+            machine = MACHINE_CHIP8;
+            quirks = QUIRKS_SCHIP;
+        }
+        else if (name == "xochip")
+        {
+            machine = MACHINE_XOCHIP;
+            quirks = QUIRKS_XOCHIP;
+        }
+        else if (name == "megachip")
+            machine = MACHINE_MEGACHIP;
+        else
+            return false;
+
+        return true;
+    }
+
+    // escapes a string for use inside a JSON string literal. Mostly for windows path separators
+    std::string JsonEscape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    // 64-bit hashes don't survive a round trip through a JSON number, so they're written as hex strings
+    std::string HashString(uint64_t hash)
+    {
+        char buffer[19];
+        snprintf(buffer, sizeof(buffer), "\"%016llx\"", (unsigned long long)hash);
+        return buffer;
+    }
+}
+
+BatchRunner::BatchRunner() :
+    m_instructionsPerFrame(500 / 60),
+    m_hashInterval(60),
+    m_defaultBudget(0)
+{
+}
+
+int BatchRunner::LoadJobs(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+
+    // file not found
+    if (!file)
+        return 1;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        BatchJob job;
+        if (!(fields >> job.romPath >> job.moviePath >> job.frames >> job.quirkProfile))
+            return 2;
+
+        if (!(fields >> job.instructionBudget))
+            job.instructionBudget = m_defaultBudget;
+
+        m_jobs.push_back(job);
+    }
+
+    return 0;
+}
+
+int BatchRunner::Run(unsigned threadCount, FILE* out)
+{
+    std::mutex outputMutex;
+    int failures = 0;
+
+    ThreadPool pool(threadCount);
+    for (size_t i = 0; i < m_jobs.size(); ++i)
+    {
+        pool.Submit([this, i, out, &outputMutex, &failures]
+        {
+            bool ok;
+            const std::string result = RunJob(i, ok);
+
+            std::lock_guard<std::mutex> lock(outputMutex);
+            fprintf(out, "%s\n", result.c_str());
+            fflush(out);
+            if (!ok)
+                ++failures;
+        });
+    }
+    pool.Wait();
+
+    fprintf(stderr, "Ran %zu jobs on %u threads (%llu stolen), %d failed\n",
+        m_jobs.size(), pool.GetThreadCount(), (unsigned long long)pool.GetStealCount(), failures);
+    return failures;
+}
+
+std::string BatchRunner::RunJob(size_t jobIndex, bool& ok) const
+{
+    const BatchJob& job = m_jobs[jobIndex];
+    const auto startTime = std::chrono::steady_clock::now();
+
+    const char* status = "ok";
+    uint64_t instructions = 0;
+    uint32_t frame = 0;
+    std::vector<uint64_t> screenHashes;
+
+    Chip8 emu;
+    InputMovie movie;
+    MachineType machine;
+    QuirkProfile quirks;
+    if (!LookupQuirkProfile(job.quirkProfile, machine, quirks))
+        status = "unknown_profile";
+    else if (emu.Init(m_instructionsPerFrame * 60, machine, quirks) != 0 || emu.LoadGame(job.romPath) != 0)
+        status = "rom_load_failed";
+    else if (job.moviePath != "-" && movie.Load(job.moviePath) != 0)
+        status = "movie_load_failed";
+    else
+    {
+        for (; frame < job.frames; ++frame)
+        {
+            if (job.instructionBudget != 0 && instructions >= job.instructionBudget)
+            {
+                status = "budget_exhausted";
+                break;
+            }
+
+            emu.SetKeyboardState(movie.GetKeyState(frame));
+            instructions += emu.RunFrame(m_instructionsPerFrame);
+
+            if (!emu.IsProgramCounterValid())
+            {
+                status = "pc_out_of_bounds";
+                break;
+            }
+
+            if (m_hashInterval != 0 && (frame + 1) % m_hashInterval == 0)
+                screenHashes.push_back(emu.GetScreenHash());
+        }
+    }
+
+    const double wallMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    ok = strcmp(status, "ok") == 0;
+
+    std::ostringstream json;
+    json << "{\"job\":" << jobIndex
+        << ",\"rom\":\"" << JsonEscape(job.romPath) << "\""
+        << ",\"movie\":\"" << JsonEscape(job.moviePath) << "\""
+        << ",\"profile\":\"" << JsonEscape(job.quirkProfile) << "\""
+        << ",\"status\":\"" << status << "\""
+        << ",\"frames\":" << frame
+        << ",\"instructions\":" << instructions
+        << ",\"idle_instructions\":" << emu.GetIdleInstructionCount()
+        << ",\"fused_instructions\":" << emu.GetFusedInstructionCount()
+        << ",\"superinstructions\":{";
+    for (int kind = SUPER_LOAD_PAIR; kind < SUPERINSTRUCTION_KINDS; ++kind)
+    {
+        json << (kind == SUPER_LOAD_PAIR ? "" : ",") << "\"" << Chip8::GetSuperinstructionName((Superinstruction)kind) << "\":"
+            << emu.GetSuperinstructionCount((Superinstruction)kind);
+    }
+    json << "}"
+        << ",\"sprite_cache_hits\":" << emu.GetSpriteCacheHits()
+        << ",\"sprite_cache_misses\":" << emu.GetSpriteCacheMisses()
+        << ",\"wall_ms\":" << wallMs
+        << ",\"final_hash\":" << HashString(emu.GetStateHash())
+        << ",\"screen_hashes\":[";
+    for (size_t i = 0; i < screenHashes.size(); ++i)
+        json << (i == 0 ? "" : ",") << HashString(screenHashes[i]);
+    json << "]}";
+
+    return json.str();
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// one headless emulation run
+struct BatchJob
+{
+    std::string romPath;
+
+    // input movie to play back (see InputMovie). "-" runs without input
+    std::string moviePath;
+
+    // number of 60hz frames to emulate
+    uint32_t frames;
+
+    std::string quirkProfile;
+
+    // maximum number of instructions to execute before giving up on the rom. 0 means no limit
+    uint64_t instructionBudget;
+};
+
+// Runs a list of headless jobs on a work-stealing thread pool and reports each result as a JSON line.
+// A job list has one job per line: "romPath moviePath frames quirkProfile [instructionBudget]".
+// Empty lines and lines starting with # are ignored.
+class BatchRunner
+{
+public:
+    BatchRunner();
+
+    // reads the job list. returns 0 if no errors. Otherwise returns an error code.
+    int LoadJobs(const std::string& fileName);
+
+    void SetInstructionsPerFrame(int instructionsPerFrame) { m_instructionsPerFrame = instructionsPerFrame; }
+
+    // a screen hash is reported every hashInterval frames
+    void SetHashInterval(uint32_t hashInterval) { m_hashInterval = hashInterval; }
+
+    // budget for jobs loaded after this call that don't specify their own. 0 means no limit
+    void SetDefaultInstructionBudget(uint64_t budget) { m_defaultBudget = budget; }
+
+    const std::vector<BatchJob>& GetJobs() const { return m_jobs; }
+
+    // runs every job on threadCount threads (0 = one per core) and writes one JSON line per job to out,
+    // in order of completion. Returns the number of jobs that didn't finish with status "ok".
+    int Run(unsigned threadCount, FILE* out);
+
+private:
+    // runs a single job and returns its JSON result line. Sets ok to false if the job failed
+    std::string RunJob(size_t jobIndex, bool& ok) const;
+
+    std::vector<BatchJob> m_jobs;
+    int m_instructionsPerFrame;
+    uint32_t m_hashInterval;
+    uint64_t m_defaultBudget;
+};
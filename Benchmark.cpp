@@ -0,0 +1,526 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include "Benchmark.h"
+#include "Chip8.h"
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define HAVE_CYCLE_COUNTER
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER
+#endif
+
+namespace
+{
+    // assembles a synthetic rom. Opcodes are placed starting at FIRST_MEMORY_LOCATION
+    class RomBuilder
+    {
+    public:
+        void Emit(uint16_t opcode)
+        {
+            m_bytes.push_back(opcode >> 8);
+            m_bytes.push_back(opcode & 0xFF);
+        }
+
+        void Emit(const std::vector<uint16_t>& opcodes, int times)
+        {
+            for (int i = 0; i < times; ++i)
+                for (uint16_t opcode : opcodes)
+                    Emit(opcode);
+        }
+
+        // places raw data, like sprites or a palette
+        void EmitData(const std::vector<uint8_t>& bytes) { m_bytes.insert(m_bytes.end(), bytes.begin(), bytes.end()); }
+
+        // address the next opcode will be placed at
+        uint16_t GetAddress() const { return FIRST_MEMORY_LOCATION + (uint16_t)m_bytes.size(); }
+
+        // pads the rom with zeros up to the given address
+        void PadTo(uint16_t address) { m_bytes.resize(address - FIRST_MEMORY_LOCATION); }
+
+        const std::vector<uint8_t>& GetBytes() const { return m_bytes; }
+
+    private:
+        std::vector<uint8_t> m_bytes;
+    };
+
+    struct SyntheticRom
+    {
+        const char* name;
+        std::vector<uint8_t> bytes;
+        MachineType machine = MACHINE_CHIP8;
+    };
+
+    // MEGA-CHIP sprite at full load: 32x32 sprites tiled over the whole 256x192 page every pass, then 00E0 to show it.
+    // A quarter of each sprite is transparent and some of the screen is the collision color, so every path of the blitter runs.
+    // The sprites are blended onto the page in blendMode
+    SyntheticRom BuildMegaSpriteRom(const char* name = "mega_sprites", uint8_t blendMode = MEGA_BLEND_NORMAL)
+    {
+        const uint16_t paletteAddress = 0x400;
+        const uint16_t spriteAddress = 0x410;
+
+        RomBuilder rom;
+        rom.Emit({ 0x0011, 0xA000 | paletteAddress, 0x0204, 0x0320, 0x0420, 0x0903, (uint16_t)(0x0800 | blendMode) }, 1);
+        rom.Emit({ 0x0100, spriteAddress }, 1);
+
+        const uint16_t loop = rom.GetAddress();
+        rom.Emit(0x6100);
+        for (int row = 0; row < MEGA_SCREEN_HEIGHT / 32; ++row)
+        {
+            rom.Emit(0x6000);
+            rom.Emit({ 0xD010, 0x7020 }, MEGA_SCREEN_WIDTH / 32);
+            rom.Emit(0x7120);
+        }
+        rom.Emit({ 0x00E0, (uint16_t)(0x1000 | loop) }, 1);
+
+        rom.PadTo(paletteAddress);
+        rom.EmitData({ 0xFF, 0xFF, 0x00, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0xFF, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF });
+
+        std::vector<uint8_t> sprite(32 * 32);
+        for (size_t i = 0; i < sprite.size(); ++i)
+            sprite[i] = (uint8_t)(i % 4 == 3 ? 0 : 1 + (i / 32 + i) % 4);
+        rom.EmitData(sprite);
+
+        return { name, rom.GetBytes(), MACHINE_MEGACHIP };
+    }
+
+    // one endless loop per handler family, unrolled so that the closing jump is a small share of the work
+    std::vector<SyntheticRom> BuildSyntheticRoms()
+    {
+        std::vector<SyntheticRom> roms;
+
+        // 8XY* - every ALU operation on V0 and V1
+        {
+            RomBuilder rom;
+            rom.Emit({ 0x6005, 0x6103 }, 1);
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0x8014, 0x8015, 0x8011, 0x8012, 0x8013, 0x8016, 0x8017, 0x801E }, 4);
+            rom.Emit(0x1000 | loop);
+            roms.push_back({ "alu_8xy", rom.GetBytes() });
+        }
+
+        // 3XKK/4XKK/5XY0/9XY0 - half of the skips are taken, each one skips over a 6XKK
+        {
+            RomBuilder rom;
+            rom.Emit({ 0x6005, 0x6105 }, 1);
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0x3005, 0x6200, 0x4005, 0x6200, 0x5010, 0x6200, 0x9010, 0x6200 }, 4);
+            rom.Emit(0x1000 | loop);
+            roms.push_back({ "skips", rom.GetBytes() });
+        }
+
+        // DXYN - draws and erases a font sprite along the top of the screen
+        {
+            RomBuilder rom;
+            rom.Emit({ 0xA000 | FONT_START_ADDR, 0x6000, 0x6100 }, 1);
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0xD015, 0xD015, 0x7008 }, 4);
+            rom.Emit({ 0x6000, (uint16_t)(0x1000 | loop) }, 1);
+            roms.push_back({ "draw_dxyn", rom.GetBytes() });
+        }
+
+        // DXYN in 128x64 mode - the same draws on the SUPER-CHIP screen, where a row spans two words
+        {
+            RomBuilder rom;
+            rom.Emit({ 0x00FF, 0xA000 | FONT_START_ADDR, 0x6000, 0x6100 }, 1);
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0xD015, 0xD015, 0x7008 }, 4);
+            rom.Emit({ 0x6000, (uint16_t)(0x1000 | loop) }, 1);
+            roms.push_back({ "draw_dxyn_hires", rom.GetBytes() });
+        }
+
+        // DXY0 - draws and erases a 16x16 sprite across the word boundary in the middle of the 128x64 screen
+        {
+            RomBuilder rom;
+            rom.Emit({ 0x00FF, 0xA000 | BIG_FONT_START_ADDR, 0x6038, 0x6100 }, 1);
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0xD010, 0xD010, 0x7004 }, 4);
+            rom.Emit({ 0x6038, (uint16_t)(0x1000 | loop) }, 1);
+            roms.push_back({ "draw_dxy0_hires", rom.GetBytes() });
+        }
+
+        // 00CN/00FB/00FC - scrolls the 64x32 and then the 128x64 screen, redrawing a font sprite so there's something to move
+        for (int highRes = 0; highRes < 2; ++highRes)
+        {
+            RomBuilder rom;
+            rom.Emit({ (uint16_t)(highRes ? 0x00FF : 0x00FE), 0xA000 | FONT_START_ADDR, 0x6010, 0x6100 }, 1);
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0x00C1, 0x00FB, 0x00FC, 0xD015 }, 4);
+            rom.Emit(0x1000 | loop);
+            roms.push_back({ highRes ? "scroll_hires" : "scroll_lores", rom.GetBytes() });
+        }
+
+        // FX33/FX55/FX65 - BCD conversion and register dumps to scratch memory at 0x800
+        {
+            RomBuilder rom;
+            rom.Emit({ 0x60C8, 0x6137, 0x6242, 0x6399 }, 1);
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0xA800, 0xF033, 0xF355, 0xF365 }, 4);
+            rom.Emit(0x1000 | loop);
+            roms.push_back({ "memory_fx33_fx55_fx65", rom.GetBytes() });
+        }
+
+        // 2NNN/00EE - calls to a subroutine that returns straight away
+        {
+            RomBuilder rom;
+            const uint16_t loop = rom.GetAddress();
+            rom.Emit({ 0x2300 }, 16);
+            rom.Emit(0x1000 | loop);
+            rom.PadTo(0x300);
+            rom.Emit(0x00EE);
+            roms.push_back({ "call_return", rom.GetBytes() });
+        }
+
+        roms.push_back(BuildMegaSpriteRom());
+        roms.push_back(BuildMegaSpriteRom("mega_sprites_multiply", MEGA_BLEND_MULTIPLY));
+        return roms;
+    }
+
+    // runs count instructions through RunFrame, the way the emulator runs them, so common sequences go through
+    // superinstructions and dead flag writes are left out. Idle loops aren't skipped, so every instruction
+    // counted really runs. returns the number of instructions run, less than count if the rom stopped
+    uint64_t RunInstructions(Chip8& emu, uint64_t count)
+    {
+        emu.SetIdleSkipping(false);
+
+        uint64_t executed = 0;
+        while (executed < count && emu.IsProgramCounterValid() && !emu.IsWaitingForKey())
+            executed += emu.RunFrame((int)std::min<uint64_t>(count - executed, 1000000));
+        return executed;
+    }
+
+    struct Samples
+    {
+        std::vector<double> mips;
+        std::vector<double> nsPerInstruction;
+        std::vector<double> cyclesPerInstruction;
+    };
+
+    void AddSample(Samples& samples, uint64_t instructions, double seconds, uint64_t cycles)
+    {
+        samples.mips.push_back(instructions / seconds / 1e6);
+        samples.nsPerInstruction.push_back(seconds * 1e9 / instructions);
+        samples.cyclesPerInstruction.push_back((double)cycles / instructions);
+    }
+
+    void WriteResult(FILE* out, const char* name, const char* kind, uint64_t instructions, const Samples& samples)
+    {
+        std::ostringstream json;
+        json << "{\"type\":\"result\",\"benchmark\":\"" << name << "\",\"kind\":\"" << kind << "\""
+            << ",\"instructions_per_rep\":" << instructions
+            << ",\"mips\":" << Benchmark::SummaryJson(Benchmark::Summarize(samples.mips))
+            << ",\"ns_per_instruction\":" << Benchmark::SummaryJson(Benchmark::Summarize(samples.nsPerInstruction));
+
+#ifdef HAVE_CYCLE_COUNTER
+        json << ",\"cycles_per_instruction\":" << Benchmark::SummaryJson(Benchmark::Summarize(samples.cyclesPerInstruction));
+#else
+        json << ",\"cycles_per_instruction\":null";
+#endif
+        json << "}";
+
+        fprintf(out, "%s\n", json.str().c_str());
+        fflush(out);
+    }
+}
+
+int Benchmark::Run(const BenchmarkOptions& options, FILE* out)
+{
+    const int pinResult = options.pinCpu >= 0 ? PinThread(options.pinCpu) : 1;
+
+    fprintf(out, "{\"type\":\"meta\",\"pinned_cpu\":%d,\"pinned\":%s,\"cycle_counter\":%s,\"warmup_reps\":%d,\"reps\":%d}\n",
+        options.pinCpu, pinResult == 0 ? "true" : "false",
+#ifdef HAVE_CYCLE_COUNTER
+        "\"tsc\"",
+#else
+        "null",
+#endif
+        options.warmupReps, options.reps);
+
+    // synthetic roms run one long stream of instructions on the same machine
+    for (const SyntheticRom& rom : BuildSyntheticRoms())
+    {
+        Chip8 emu;
+        if (emu.Init(500, rom.machine) != 0 || emu.LoadGame(rom.bytes.data(), (int)rom.bytes.size()) != 0)
+            return 1;
+
+        Samples samples;
+        for (int rep = 0; rep < options.warmupReps + options.reps; ++rep)
+        {
+            const uint64_t startCycles = ReadCycleCounter();
+            const auto startTime = std::chrono::steady_clock::now();
+
+            const uint64_t instructions = RunInstructions(emu, options.instructionsPerRep);
+
+            const auto endTime = std::chrono::steady_clock::now();
+            const uint64_t endCycles = ReadCycleCounter();
+
+            if (instructions != options.instructionsPerRep)
+            {
+                printf("Synthetic rom %s stopped after %llu instructions\n", rom.name, (unsigned long long)instructions);
+                return 3;
+            }
+
+            if (rep >= options.warmupReps)
+                AddSample(samples, instructions, std::chrono::duration<double>(endTime - startTime).count(), endCycles - startCycles);
+        }
+
+        WriteResult(out, rom.name, "synthetic", options.instructionsPerRep, samples);
+    }
+
+    // the renderer's palette expansion of a full MEGA-CHIP page, on the picture the sprite benchmark leaves behind
+    {
+        const SyntheticRom rom = BuildMegaSpriteRom();
+        Chip8 emu;
+        if (emu.Init(500, rom.machine) != 0 || emu.LoadGame(rom.bytes.data(), (int)rom.bytes.size()) != 0)
+            return 1;
+        RunInstructions(emu, 1000);
+
+        const int pages = 200;
+        std::vector<uint32_t> argb(MegaFramebuffer::PAGE_SIZE);
+        std::vector<double> nsPerPixel;
+        for (int rep = 0; rep < options.warmupReps + options.reps; ++rep)
+        {
+            const auto startTime = std::chrono::steady_clock::now();
+            for (int i = 0; i < pages; ++i)
+                emu.GetMegaScreen().ExpandShownPage(argb.data(), MEGA_SCREEN_WIDTH);
+            const auto endTime = std::chrono::steady_clock::now();
+
+            if (rep >= options.warmupReps)
+                nsPerPixel.push_back(std::chrono::duration<double, std::nano>(endTime - startTime).count() / pages / MegaFramebuffer::PAGE_SIZE);
+        }
+
+        fprintf(out, "{\"type\":\"result\",\"benchmark\":\"mega_expand\",\"kind\":\"kernel\",\"pixels_per_rep\":%d,\"ns_per_pixel\":%s}\n",
+            pages * MegaFramebuffer::PAGE_SIZE, SummaryJson(Summarize(nsPerPixel)).c_str());
+        fflush(out);
+    }
+
+    // bundled roms run frame by frame like a headless batch job. Every repetition starts from a freshly loaded rom.
+    const char* bundledRoms[] = { "PONG.ch8", "Airplane.ch8", "TEST1.ch8", "TEST2.ch8" };
+    for (const char* romName : bundledRoms)
+    {
+        Samples samples;
+        uint64_t instructions = 0;
+        for (int rep = 0; rep < options.warmupReps + options.reps; ++rep)
+        {
+            Chip8 emu;
+            if (emu.Init(options.romInstructionsPerFrame * 60) != 0 || emu.LoadGame(options.romDir + romName) != 0)
+            {
+                printf("Failed to load %s%s\n", options.romDir.c_str(), romName);
+                return 2;
+            }
+
+            // measure the interpreter, not how much of the rom is spent waiting
+            emu.SetIdleSkipping(false);
+
+            instructions = 0;
+            const uint64_t startCycles = ReadCycleCounter();
+            const auto startTime = std::chrono::steady_clock::now();
+
+            for (uint32_t frame = 0; frame < options.romFrames && emu.IsProgramCounterValid(); ++frame)
+                instructions += emu.RunFrame(options.romInstructionsPerFrame);
+
+            const auto endTime = std::chrono::steady_clock::now();
+            const uint64_t endCycles = ReadCycleCounter();
+
+            if (rep >= options.warmupReps && instructions > 0)
+                AddSample(samples, instructions, std::chrono::duration<double>(endTime - startTime).count(), endCycles - startCycles);
+        }
+
+        WriteResult(out, romName, "rom", instructions, samples);
+    }
+
+    return 0;
+}
+
+int Benchmark::RunScaling(const ScalingOptions& options, FILE* out)
+{
+    using Clock = std::chrono::steady_clock;
+
+    // construction and Init are timed separately since Init builds the instruction table
+    std::vector<std::unique_ptr<Chip8>> instances;
+    double constructSeconds = 0;
+    double initSeconds = 0;
+    const size_t residentBefore = GetResidentMemory();
+
+    for (int i = 0; i < options.instances; ++i)
+    {
+        const auto startTime = Clock::now();
+        instances.emplace_back(new Chip8());
+        const auto constructedTime = Clock::now();
+        const int errorCode = instances.back()->Init(options.instructionsPerFrame * 60);
+        const auto initTime = Clock::now();
+
+        if (errorCode != 0 || instances.back()->LoadGame(options.romPath) != 0)
+        {
+            printf("Failed to load %s\n", options.romPath.c_str());
+            return 1;
+        }
+        instances.back()->SetIdleSkipping(false);
+
+        constructSeconds += std::chrono::duration<double>(constructedTime - startTime).count();
+        initSeconds += std::chrono::duration<double>(initTime - constructedTime).count();
+    }
+
+    const size_t residentAfter = GetResidentMemory();
+    const double residentPerInstance = residentAfter > residentBefore ? (double)(residentAfter - residentBefore) / options.instances : 0;
+
+    fprintf(out, "{\"type\":\"scaling_startup\",\"instances\":%d,\"construct_us_per_instance\":%g,\"init_us_per_instance\":%g,\"resident_bytes_per_instance\":%.0f}\n",
+        options.instances, constructSeconds * 1e6 / options.instances, initSeconds * 1e6 / options.instances, residentPerInstance);
+    fflush(out);
+
+    unsigned maxThreads = options.maxThreads != 0 ? options.maxThreads : std::thread::hardware_concurrency();
+    if (maxThreads == 0)
+        maxThreads = 1;
+
+    for (unsigned threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        // every thread owns a contiguous slice of the instances and steps them one frame at a time, round robin
+        std::vector<std::vector<double>> latencies(threads);
+        std::vector<uint64_t> instructions(threads, 0);
+        std::vector<std::thread> workers;
+
+        const auto startTime = Clock::now();
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            workers.emplace_back([&, t]
+            {
+                const size_t first = instances.size() * t / threads;
+                const size_t last = instances.size() * (t + 1) / threads;
+                latencies[t].reserve((last - first) * options.frames);
+
+                for (uint32_t frame = 0; frame < options.frames; ++frame)
+                {
+                    for (size_t i = first; i < last; ++i)
+                    {
+                        const auto frameStart = Clock::now();
+                        instructions[t] += instances[i]->RunFrame(options.instructionsPerFrame);
+                        latencies[t].push_back(std::chrono::duration<double, std::nano>(Clock::now() - frameStart).count());
+                    }
+                }
+            });
+        }
+
+        for (std::thread& worker : workers)
+            worker.join();
+        const double seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+
+        std::vector<double> allLatencies;
+        uint64_t totalInstructions = 0;
+        for (unsigned t = 0; t < threads; ++t)
+        {
+            allLatencies.insert(allLatencies.end(), latencies[t].begin(), latencies[t].end());
+            totalInstructions += instructions[t];
+        }
+        std::sort(allLatencies.begin(), allLatencies.end());
+
+        auto percentile = [&allLatencies](double p) { return allLatencies.empty() ? 0 : allLatencies[(size_t)(p * (allLatencies.size() - 1))]; };
+
+        fprintf(out, "{\"type\":\"scaling\",\"threads\":%u,\"instances\":%d,\"frames\":%u,\"mips\":%g,\"frames_per_second\":%g,"
+            "\"frame_latency_ns\":{\"p50\":%g,\"p99\":%g,\"p999\":%g,\"max\":%g}}\n",
+            threads, options.instances, options.frames, totalInstructions / seconds / 1e6, allLatencies.size() / seconds,
+            percentile(0.5), percentile(0.99), percentile(0.999), percentile(1.0));
+        fflush(out);
+
+        if (threads == maxThreads)
+            break;
+    }
+
+    return 0;
+}
+
+int Benchmark::PinThread(int cpu)
+{
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0 ? 0 : 1;
+#elif defined(__linux__)
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0 ? 0 : 1;
+#else
+    // not supported on this platform
+    return 2;
+#endif
+}
+
+uint64_t Benchmark::ReadCycleCounter()
+{
+#ifdef HAVE_CYCLE_COUNTER
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+size_t Benchmark::GetResidentMemory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.WorkingSetSize;
+#elif defined(__linux__)
+    // second field of statm is the resident set in pages
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr)
+        return 0;
+
+    unsigned long totalPages = 0;
+    unsigned long residentPages = 0;
+    const int fields = fscanf(statm, "%lu %lu", &totalPages, &residentPages);
+    fclose(statm);
+
+    return fields == 2 ? residentPages * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+Benchmark::Summary Benchmark::Summarize(std::vector<double> samples)
+{
+    Summary summary = {};
+    if (samples.empty())
+        return summary;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (double sample : samples)
+        sum += sample;
+    summary.mean = sum / samples.size();
+
+    double squaredError = 0;
+    for (double sample : samples)
+        squaredError += (sample - summary.mean) * (sample - summary.mean);
+    summary.stddev = samples.size() > 1 ? std::sqrt(squaredError / (samples.size() - 1)) : 0;
+
+    summary.min = samples.front();
+    summary.median = samples.size() % 2 == 1 ? samples[samples.size() / 2]
+        : (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]) / 2;
+
+    return summary;
+}
+
+std::string Benchmark::SummaryJson(const Summary& summary)
+{
+    std::ostringstream json;
+    json << "{\"mean\":" << summary.mean << ",\"stddev\":" << summary.stddev
+        << ",\"min\":" << summary.min << ",\"median\":" << summary.median << "}";
+    return json.str();
+}
@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct BenchmarkOptions
+{
+    // untimed repetitions before measuring
+    int warmupReps = 3;
+
+    // timed repetitions. Every result is reported as mean/stddev/min/median over these
+    int reps = 10;
+
+    // instructions executed per repetition of a synthetic benchmark
+    uint64_t instructionsPerRep = 2000000;
+
+    // cpu to pin the benchmark thread to. -1 leaves the thread unpinned
+    int pinCpu = -1;
+
+    // directory with the bundled roms for the end-to-end benchmarks
+    std::string romDir = "roms/";
+
+    // frames and instructions per frame for the end-to-end rom benchmarks.
+    // Far above the real 500hz tickrate so that each repetition runs long enough to time.
+    uint32_t romFrames = 600;
+    int romInstructionsPerFrame = 1000;
+};
+
+struct ScalingOptions
+{
+    // emulator instances to construct and run
+    int instances = 64;
+
+    // instances are run on 1, 2, 4... up to this many threads. 0 uses one thread per hardware thread
+    unsigned maxThreads = 0;
+
+    // frames each instance runs per thread count, at the default 500hz tickrate
+    uint32_t frames = 600;
+    int instructionsPerFrame = 500 / 60;
+
+    std::string romPath = "roms/PONG.ch8";
+};
+
+// Interpreter microbenchmarks.
+// Synthetic roms hammer one family of instruction handlers each, and the bundled roms are run end to end.
+// Both run through RunFrame with idle loop skipping off, so fused sequences and flagless handlers are measured as they run.
+// Every benchmark reports instructions per second, ns per instruction and cycles per instruction
+// as one JSON line so that runs can be diffed across commits.
+class Benchmark
+{
+public:
+    // runs every benchmark and writes the results to out. returns 0 if no errors. Otherwise returns an error code.
+    static int Run(const BenchmarkOptions& options, FILE* out);
+
+    // constructs many instances and runs them on a growing number of threads. Reports construction and Init time,
+    // resident memory per instance, aggregate throughput and per-frame latency percentiles as JSON lines.
+    // returns 0 if no errors. Otherwise returns an error code.
+    static int RunScaling(const ScalingOptions& options, FILE* out);
+
+    // pins the calling thread to a single cpu. returns 0 if no errors. Otherwise returns an error code.
+    static int PinThread(int cpu);
+
+    // returns the cpu timestamp counter, or 0 on platforms without one
+    static uint64_t ReadCycleCounter();
+
+    // returns the resident memory of the process in bytes, or 0 if it can't be determined
+    static size_t GetResidentMemory();
+
+    struct Summary
+    {
+        double mean;
+        double stddev;
+        double min;
+        double median;
+    };
+
+    static Summary Summarize(std::vector<double> samples);
+
+    // formats a summary as a JSON object
+    static std::string SummaryJson(const Summary& summary);
+};
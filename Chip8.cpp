@@ -1,48 +1,99 @@
+#include <algorithm>
 #include <chrono>
 #include <fstream>
+#include <memory>
+#include <thread>
+#include "AudioDevice.h"
 #include "Chip8.h"
 #include "Debug.h"
+#include "DynamicRateControl.h"
+#include "FlagLiveness.h"
+#include "FrameClock.h"
 #include "Font.h"
 #include "Instructions.h"
+#include "KeypadInput.h"
+#include "KeypadSpeculator.h"
+#include "LatencyHistogram.h"
+#include "RomAnalyzer.h"
+#include "ToneSynth.h"
 
 Chip8::Chip8() :
     m_active(true),
-    m_tickrate(500),
 
-    // first instruction is at 0x200
-    m_PC(FIRST_MEMORY_LOCATION),
+    // empty first opcode
+    m_currentOpcode(0),
+
+    // clear memory
+    m_fixedMemory({}),
+    m_megaMemory(),
+    m_memory(m_fixedMemory.data()),
+    m_memorySize(CLASSIC_MEMORY_SIZE),
+    m_memoryUsed(0),
+    m_machine(MACHINE_CHIP8),
+    m_quirkProfile(QUIRKS_DEFAULT),
 
+    // clear all registers
+    m_V({}),
     // clear index register
     m_I(0),
-    // clear all other registers
-    m_V({}),
 
-    // empty first opcode
-    m_currentOpcode(0),
+    // first instruction is at 0x200
+    m_PC(FIRST_MEMORY_LOCATION),
+    m_romSize(0),
+    m_romHash(0),
+    m_romKnown(false),
+    m_romInfo(RomDatabase::GetDefaults()),
+    m_romMachine(MACHINE_CHIP8),
+
+    // reset timers
+    m_delayTimer(0),
+    m_beepTimer(0),
 
     // reset stack pointer and 0 out stack
     m_stack({}),
     m_stackPointer(0),
 
-    // reset memmory
-    m_memory({}),
+    m_rplFlags({}),
+    m_audioPattern({}),
+    m_audioPatternLoaded(false),
+    m_pitch(64),
+    m_soundAddress(0),
+    m_soundLoop(false),
+    m_soundPlaying(false),
+    m_soundTrigger(0),
 
-    // reset timers
-    m_beepTimer(0),
-    m_delayTimer(0),
+    // everything but the program counter and pitch starts out zeroed, and zeroed slots don't contribute to the hash
+    m_stateHash(StateHash::Key(StateHash::SLOT_PROGRAM_COUNTER, FIRST_MEMORY_LOCATION) ^ StateHash::Key(StateHash::SLOT_PITCH, 64)),
 
-    // empty screen and disable draw flag
+    // disable draw flag. The screen starts out empty
     m_draw(false),
-    m_screen({}),
 
-    // clear keyboard states and init SDL keyboard mappings
+    // clear keyboard states
     m_keyboard({}),
-    m_keymap({
-        {SDLK_1, 0}, {SDLK_2, 1}, {SDLK_3, 2}, {SDLK_4, 3},
-        {SDLK_q, 4}, {SDLK_w, 5}, {SDLK_e, 6}, {SDLK_r, 7},
-        {SDLK_a, 8}, {SDLK_s, 9}, {SDLK_d, 10}, {SDLK_f, 11},
-        {SDLK_z, 12}, {SDLK_x, 13}, {SDLK_c, 14}, {SDLK_v, 15},
-        })
+    m_keysRead(0),
+    m_waitingForKey(false),
+    m_keyWaitRegister(0),
+    m_waitingForFrame(false),
+
+    m_superinstructionHandlers({}),
+    m_superinstructionsEnabled(true),
+    m_superinstructionCounts({}),
+    m_fusedInstructions(0),
+    m_deadFlagWriteCount(0),
+    m_flaglessArithmetic({}),
+    m_flaglessDraw(nullptr),
+    m_flaglessSuperDraw(nullptr),
+    m_lazyFlags(true),
+    m_flagChecking(false),
+    m_deadFlagAddress(-1),
+    m_flagCheckFailures(0),
+    m_tickrate(500),
+    m_runAheadFrames(0),
+    m_speculationBranches(0),
+    m_pacing(PACING_WALL_CLOCK),
+    m_idleSkipping(true),
+    m_idleInstructions(0),
+    m_randomDraws(0)
 {
     // seed RNG for Random instruction
     std::random_device rd;
@@ -52,21 +103,59 @@ Chip8::Chip8() :
 
 Chip8::~Chip8()
 {
-    SDL_FreeSurface(m_pixel);
-    SDL_Quit();
+    // headless instances never touch SDL
+    if (SDL_WasInit(SDL_INIT_EVERYTHING) != 0)
+        SDL_Quit();
 }
 
-int Chip8::Init(int tickrate)
+int Chip8::Init(uint32_t tickrate, MachineType machine, QuirkProfile quirks)
 {
+    uint32_t memorySize = CLASSIC_MEMORY_SIZE;
+    if (machine == MACHINE_XOCHIP)
+        memorySize = XO_MEMORY_SIZE;
+    else if (machine == MACHINE_MEGACHIP)
+        memorySize = MEGA_MEMORY_SIZE;
+
+    // this build doesn't reserve enough memory for the machine
+    if (machine != MACHINE_MEGACHIP && memorySize > MAX_MEMORY_SIZE)
+        return 1;
+
+    // MEGA-CHIP memory is allocated. Whatever was already written moves along with the machine type
+    if (machine == MACHINE_MEGACHIP && m_megaMemory.empty())
+    {
+        m_megaMemory.assign(memorySize, 0);
+        std::copy_n(m_fixedMemory.begin(), m_memoryUsed, m_megaMemory.begin());
+        std::fill_n(m_fixedMemory.begin(), m_memoryUsed, 0);
+        m_memory = m_megaMemory.data();
+    }
+    else if (machine != MACHINE_MEGACHIP && !m_megaMemory.empty())
+    {
+        m_memoryUsed = std::min(m_memoryUsed, (size_t)memorySize);
+        std::copy_n(m_megaMemory.begin(), m_memoryUsed, m_fixedMemory.begin());
+        m_megaMemory = std::vector<uint8_t>();
+        m_memory = m_fixedMemory.data();
+    }
+
     m_tickrate = tickrate;
+    m_machine = machine;
+    m_memorySize = memorySize;
+    m_memoryUsed = std::min(std::max(m_memoryUsed, (size_t)BIG_FONT_END_ADDR), (size_t)m_memorySize);
     
     // init fonts
     int fontIndex = 0;
     for (int i = FONT_START_ADDR; i < FONT_END_ADDR; ++i)
     {
+        UpdateStateHash(StateHash::SLOT_MEMORY + i, m_memory[i], fontset[fontIndex]);
         m_memory[i] = fontset[fontIndex++];
     }
 
+    fontIndex = 0;
+    for (int i = BIG_FONT_START_ADDR; i < BIG_FONT_END_ADDR; ++i)
+    {
+        UpdateStateHash(StateHash::SLOT_MEMORY + i, m_memory[i], bigFontset[fontIndex]);
+        m_memory[i] = bigFontset[fontIndex++];
+    }
+
     // clear opcode map
     m_instructionTable.clear();
     for (int i = 0; i <= 0xFFFF; ++i)
@@ -74,7 +163,16 @@ int Chip8::Init(int tickrate)
 
     m_instructionTable[0x00E0] = Instructions::Clear;
     m_instructionTable[0x00EE] = Instructions::Return;
-    
+
+    // SUPER-CHIP
+    for (int i = 0; i <= 0xF; ++i)
+        m_instructionTable[0x00C0 + i] = Instructions::ScrollDown;
+    m_instructionTable[0x00FB] = Instructions::ScrollRight;
+    m_instructionTable[0x00FC] = Instructions::ScrollLeft;
+    m_instructionTable[0x00FD] = Instructions::Exit;
+    m_instructionTable[0x00FE] = Instructions::LowResolution;
+    m_instructionTable[0x00FF] = Instructions::HighResolution;
+
     // precompute valid opcodes and map them to opcode handlers
     for (int i = 0; i <= 0x0FFF; ++i)
     {
@@ -87,38 +185,21 @@ int Chip8::Init(int tickrate)
         m_instructionTable[0x7000 + i] = Instructions::AddConst;
         m_instructionTable[0x9000 + i] = Instructions::SkipIfNotEqualVal;
         m_instructionTable[0xA000 + i] = Instructions::SetIndex;
-        m_instructionTable[0xB000 + i] = Instructions::JumpOffset;
         m_instructionTable[0xC000 + i] = Instructions::Random;
-        m_instructionTable[0xD000 + i] = Instructions::DrawSprite;
 
         switch (i & 0x00F)
         {
             case 0x000:
                 m_instructionTable[0x8000 + i] = Instructions::LoadVal;
                 break;
-            case 0x001:
-                m_instructionTable[0x8000 + i] = Instructions::LoadOr;
-                break;
-            case 0x002:
-                m_instructionTable[0x8000 + i] = Instructions::LoadAnd;
-                break;
-            case 0x003:
-                m_instructionTable[0x8000 + i] = Instructions::LoadXor;
-                break;
             case 0x004:
-                m_instructionTable[0x8000 + i] = Instructions::AddVal;
+                m_instructionTable[0x8000 + i] = Instructions::AddVal<true>;
                 break;
             case 0x005:
-                m_instructionTable[0x8000 + i] = Instructions::SubVal;
-                break;
-            case 0x006:
-                m_instructionTable[0x8000 + i] = Instructions::ShiftRight;
+                m_instructionTable[0x8000 + i] = Instructions::SubVal<true>;
                 break;
             case 0x007:
-                m_instructionTable[0x8000 + i] = Instructions::SubValInverse;
-                break;
-            case 0x00E:
-                m_instructionTable[0x8000 + i] = Instructions::ShiftLeft;
+                m_instructionTable[0x8000 + i] = Instructions::SubValInverse<true>;
                 break;
         }
 
@@ -142,14 +223,21 @@ int Chip8::Init(int tickrate)
             case 0x029:
                 m_instructionTable[0xF000 + i] = Instructions::SetIndexToFontIndex;
                 break;
+            case 0x030:
+                m_instructionTable[0xF000 + i] = Instructions::SetIndexToBigFontIndex;
+                break;
             case 0x033:
                 m_instructionTable[0xF000 + i] = Instructions::StoreBCDValInIndex;
                 break;
-            case 0x055:
-                m_instructionTable[0xF000 + i] = Instructions::DumpRegistersToMemory;
+            case 0x075:
+                m_instructionTable[0xF000 + i] = Instructions::DumpRegistersToRplFlags;
+                break;
+            case 0x085:
+                m_instructionTable[0xF000 + i] = Instructions::LoadRegistersFromRplFlags;
                 break;
-            case 0x065:
-                m_instructionTable[0xF000 + i] = Instructions::LoadRegistersFromMemory;
+            case 0x03A:
+                if (machine == MACHINE_XOCHIP)
+                    m_instructionTable[0xF000 + i] = Instructions::SetPitch;
                 break;
             case 0x09E:
                 m_instructionTable[0xE000 + i] = Instructions::SkipIfKeyPressed;
@@ -160,10 +248,122 @@ int Chip8::Init(int tickrate)
         }
     }
 
+    // XO-CHIP. 5XY2 and 5XY3 replace the 5XY0 handler that every 5XYN maps to on other machines
+    if (machine == MACHINE_XOCHIP)
+    {
+        for (int i = 0; i <= 0xF; ++i)
+        {
+            m_instructionTable[0x00D0 + i] = Instructions::ScrollUp;
+            m_instructionTable[0xF001 + (i << 8)] = Instructions::SelectPlanes;
+        }
+
+        for (int i = 0; i <= 0xFF; ++i)
+        {
+            m_instructionTable[0x5002 + (i << 4)] = Instructions::SaveRegisterRange;
+            m_instructionTable[0x5003 + (i << 4)] = Instructions::LoadRegisterRange;
+        }
+
+        m_instructionTable[0xF000] = Instructions::LoadLongIndex;
+        m_instructionTable[0xF002] = Instructions::LoadAudioPattern;
+    }
+
+    // MEGA-CHIP. All of it lives in the 0NNN range that is otherwise unused
+    if (machine == MACHINE_MEGACHIP)
+    {
+        m_instructionTable[0x0010] = Instructions::MegaModeOff;
+        m_instructionTable[0x0011] = Instructions::MegaModeOn;
+        m_instructionTable[0x0700] = Instructions::StopDigitizedSound;
+        for (int i = 0; i <= 0xF; ++i)
+        {
+            m_instructionTable[0x00B0 + i] = Instructions::ScrollUp;
+            m_instructionTable[0x0600 + i] = Instructions::PlayDigitizedSound;
+            m_instructionTable[0x0800 + i] = Instructions::SetBlendMode;
+        }
+
+        for (int i = 0; i <= 0xFF; ++i)
+        {
+            m_instructionTable[0x0100 + i] = Instructions::LoadMegaIndex;
+            m_instructionTable[0x0200 + i] = Instructions::LoadPalette;
+            m_instructionTable[0x0300 + i] = Instructions::SetSpriteWidth;
+            m_instructionTable[0x0400 + i] = Instructions::SetSpriteHeight;
+            m_instructionTable[0x0500 + i] = Instructions::SetScreenAlpha;
+            m_instructionTable[0x0900 + i] = Instructions::SetCollisionColor;
+        }
+    }
+
+    // superinstructions are predecoded as PC reaches them. PC is 16 bits wide, even with more memory than that
+    m_superinstructions.assign(std::min(m_memorySize, 0x10000u), SUPER_UNDECODED);
+    m_superinstructionHandlers[SUPER_LOAD_PAIR] = Instructions::LoadConstPair;
+    m_superinstructionHandlers[SUPER_DELAY_WAIT] = Instructions::WaitForDelayTimer;
+    m_superinstructionHandlers[SUPER_LOOP_COUNTER] = Instructions::CountAndSkipIfEqual;
+
+    m_deadFlagWrites.assign(m_superinstructions.size(), 0);
+    m_spriteCache.Reset(m_memory, m_memorySize);
+    m_flaglessArithmetic[0x4] = Instructions::AddVal<false>;
+    m_flaglessArithmetic[0x5] = Instructions::SubVal<false>;
+    m_flaglessArithmetic[0x7] = Instructions::SubValInverse<false>;
+
+    // the instructions that differ between interpreters get the handlers of the rom's profile
+    SetQuirkProfile(quirks);
+
+    // memory may have moved
+    BuildFlagGraph();
+
     // no errors
     return 0;
 }
 
+void Chip8::SetQuirkProfile(QuirkProfile profile)
+{
+    m_quirkProfile = profile;
+    switch (profile)
+    {
+        case QUIRKS_COSMAC:
+            InstallQuirkHandlers<QUIRKS_COSMAC_FLAGS>();
+            break;
+        case QUIRKS_SCHIP:
+            InstallQuirkHandlers<QUIRKS_SCHIP_FLAGS>();
+            break;
+        case QUIRKS_XOCHIP:
+            InstallQuirkHandlers<QUIRKS_XOCHIP_FLAGS>();
+            break;
+        default:
+            InstallQuirkHandlers<QUIRKS_DEFAULT_FLAGS>();
+            break;
+    }
+}
+
+template <unsigned Quirks>
+void Chip8::InstallQuirkHandlers()
+{
+    for (int i = 0; i <= 0x0FFF; ++i)
+    {
+        m_instructionTable[0xB000 + i] = Instructions::JumpOffset<Quirks>;
+        m_instructionTable[0xD000 + i] = Instructions::DrawSprite<Quirks>;
+    }
+
+    for (int i = 0; i <= 0xFF; ++i)
+    {
+        m_instructionTable[0x8001 + (i << 4)] = Instructions::LoadOr<Quirks>;
+        m_instructionTable[0x8002 + (i << 4)] = Instructions::LoadAnd<Quirks>;
+        m_instructionTable[0x8003 + (i << 4)] = Instructions::LoadXor<Quirks>;
+        m_instructionTable[0x8006 + (i << 4)] = Instructions::ShiftRight<Quirks>;
+        m_instructionTable[0x800E + (i << 4)] = Instructions::ShiftLeft<Quirks>;
+    }
+
+    for (int i = 0; i <= 0xF; ++i)
+    {
+        m_instructionTable[0xF055 + (i << 8)] = Instructions::DumpRegistersToMemory<Quirks>;
+        m_instructionTable[0xF065 + (i << 8)] = Instructions::LoadRegistersFromMemory<Quirks>;
+    }
+
+    m_superinstructionHandlers[SUPER_DRAW] = Instructions::SetIndexAndDraw<Quirks>;
+    m_flaglessArithmetic[0x6] = Instructions::ShiftRight<Quirks, false>;
+    m_flaglessArithmetic[0xE] = Instructions::ShiftLeft<Quirks, false>;
+    m_flaglessDraw = Instructions::DrawSprite<Quirks, false>;
+    m_flaglessSuperDraw = Instructions::SetIndexAndDraw<Quirks, false>;
+}
+
 int Chip8::LoadGame(const std::string& fileName)
 {
     // open file in binary mode
@@ -177,32 +377,65 @@ int Chip8::LoadGame(const std::string& fileName)
     // get file size and then return back to the start of the file
     int fileSize = (int)file.tellg();
     file.seekg(0, file.beg);
-    
+
     // read file bytes into buffer
     char* buffer = new char[fileSize];
     file.read(buffer, fileSize);
 
-    // place file contents (from buffer) into chip8 memory location
-    for (int i = 0; i < fileSize; ++i)
-    {
-        m_memory[FIRST_MEMORY_LOCATION + i] = buffer[i];
-    }
-    printf("Loaded %d bytes into memory\n", fileSize);
+    const int errorCode = LoadGame((const uint8_t*)buffer, fileSize);
 
     // delete the buffer
     delete[] buffer;
+    return errorCode;
+}
+
+int Chip8::LoadGame(const uint8_t* rom, int romSize)
+{
+    // rom doesn't fit in memory
+    if (romSize > GetMemorySize() - FIRST_MEMORY_LOCATION)
+        return 2;
+
+    // place rom contents into chip8 memory location
+    for (int i = 0; i < romSize; ++i)
+    {
+        UpdateStateHash(StateHash::SLOT_MEMORY + FIRST_MEMORY_LOCATION + i, m_memory[FIRST_MEMORY_LOCATION + i], rom[i]);
+        m_memory[FIRST_MEMORY_LOCATION + i] = rom[i];
+    }
+    InvalidateSuperinstructions(FIRST_MEMORY_LOCATION, FIRST_MEMORY_LOCATION + romSize);
+    m_romSize = romSize;
+    m_rom.assign(rom, rom + romSize);
+
+    // known roms come with the quirks, speed, colors and keys they need. For the rest they're inferred from the code
+    const RomAnalysis analysis = RomAnalyzer::Analyze(rom, romSize);
+    m_romMachine = analysis.machine;
+    m_romHash = RomDatabase::Hash(rom, romSize);
+    m_romInfo = RomDatabase::GetDefaults();
+    m_romKnown = RomDatabase::Lookup(m_romHash, m_romInfo);
+    if (!m_romKnown)
+    {
+        m_romInfo.quirks = analysis.quirks;
+        m_romInfo.instructionsPerFrame = analysis.instructionsPerFrame;
+    }
+    m_memoryUsed = std::max(m_memoryUsed, (size_t)(FIRST_MEMORY_LOCATION + romSize));
+    m_spriteCache.Refresh();
+    BuildFlagGraph();
+
     return 0;
 }
 
 void Chip8::Tick()
 {    
+    // suspended by FX0A until a key is pressed
+    if (m_waitingForKey)
+        return;
+
     // fetch opcode
     m_currentOpcode = m_memory[m_PC] << 8 | m_memory[m_PC + 1];
     //if (m_currentOpcode != 0x0)
     //    printf("0x%04X\n", m_currentOpcode);
 
     // increment program counter by 2 to skip to the next opcode
-    m_PC += 2;
+    SetProgramCounter(m_PC + 2);
 
     // execute opcode
     m_instructionTable[m_currentOpcode](m_currentOpcode, this);
@@ -210,71 +443,238 @@ void Chip8::Tick()
     // tick timers (60hz always)
 }
 
-void Chip8::RenderScreen(SDL_Surface* screen, SDL_Window* window) const
+int Chip8::RunFrame(int instructionsPerFrame)
 {
-    SDL_FillRect(screen, NULL, SDL_MapRGBA(screen->format, 0, 0, 0, 255));
+    // where the last backward jump went and the state it left. Timers and keys only change between frames, so getting
+    // back there in the same state means the guest is spinning in a loop (a delay timer wait, a key poll, a jump to
+    // itself...) that can't change anything before the frame ends. Every further pass through it is skipped
+    uint16_t loopStart = 0;
+    uint64_t loopHash = 0;
+    uint32_t loopRandomDraws = 0;
+    int loopExecuted = -1;
 
-    for (size_t x = 0; x < 64; ++x)
+    int executed = 0;
+    m_waitingForFrame = false;
+    while (executed < instructionsPerFrame && IsProgramCounterValid() && !m_waitingForKey && !m_waitingForFrame)
     {
-        for (size_t y = 0; y < 32; ++y)
-        {
-            if (m_screen[y * 64 + x] == 1)
-            {
-                SDL_Rect pixelPos;
-                pixelPos.x = x * 10;
-                pixelPos.y = y * 10;
+        const uint16_t pc = m_PC;
+        executed += Step(instructionsPerFrame - executed);
 
-                SDL_BlitSurface(m_pixel, NULL, screen, &pixelPos);
-            }
+        if (m_PC > pc || !m_idleSkipping)
+            continue;
+
+        // random numbers aren't part of the state, so a loop that draws them isn't idle
+        const uint64_t hash = GetStateHash();
+        if (loopExecuted >= 0 && m_PC == loopStart && hash == loopHash && m_randomDraws == loopRandomDraws)
+        {
+            const int period = executed - loopExecuted;
+            const int skipped = (instructionsPerFrame - executed) / period * period;
+            executed += skipped;
+            m_idleInstructions += skipped;
         }
+
+        loopStart = m_PC;
+        loopHash = hash;
+        loopRandomDraws = m_randomDraws;
+        loopExecuted = executed;
     }
 
-    SDL_UpdateWindowSurface(window);
+    TickTimers();
+    return executed;
 }
 
-uint8_t Chip8::PollEvents(bool block)
+int Chip8::Step(int budget)
 {
-    if (block)
+    // the longest superinstruction is 3 instructions, so there's no room for one at the end of a frame
+    Superinstruction kind = SUPER_NONE;
+    if (m_superinstructionsEnabled && budget >= 2)
+    {
+        Superinstruction& predecoded = m_superinstructions[m_PC];
+        if (predecoded == SUPER_UNDECODED)
+            predecoded = PredecodeSuperinstruction(m_PC);
+        kind = predecoded == SUPER_DELAY_WAIT && budget < 3 ? SUPER_NONE : predecoded;
+    }
+
+    if (kind == SUPER_NONE)
     {
-        SDL_WaitEvent(&m_event);
+        const uint16_t pc = m_PC;
+        if (!m_lazyFlags || m_deadFlagWrites[pc] == 0)
+            Tick();
+        else if (!m_flagChecking)
+            TickWithoutFlag();
+        else
+        {
+            Tick();
+            m_deadFlagAddress = pc;
+        }
+        return 1;
     }
+
+    // the predecoder made sure the whole sequence is in memory
+    const uint16_t pc = m_PC;
+    const uint16_t next = m_memory[pc + 2] << 8 | m_memory[pc + 3];
+    const uint16_t last = kind == SUPER_DELAY_WAIT ? m_memory[pc + 4] << 8 | m_memory[pc + 5] : 0;
+    m_currentOpcode = m_memory[pc] << 8 | m_memory[pc + 1];
+    SetProgramCounter(pc + 2);
+
+    // the DXYN of ANNN DXYN is the instruction at pc + 2, and its VF write is left out like Tick does it.
+    // PredecodeSuperinstruction doesn't fuse past 0xFFFF, which keeps pc + 2 inside m_deadFlagWrites
+    const bool deadDraw = kind == SUPER_DRAW && m_lazyFlags && m_deadFlagWrites[(uint16_t)(pc + 2)] != 0;
+    SuperinstructionHandler handler = m_superinstructionHandlers[kind];
+    if (deadDraw && !m_flagChecking)
+        handler = m_flaglessSuperDraw;
+
+    const int executed = handler(m_currentOpcode, next, last, this);
+    if (deadDraw && m_flagChecking)
+        m_deadFlagAddress = pc + 2;
+
+    ++m_superinstructionCounts[kind];
+    m_fusedInstructions += executed;
+    return executed;
+}
+
+void Chip8::TickWithoutFlag()
+{
+    m_currentOpcode = m_memory[m_PC] << 8 | m_memory[m_PC + 1];
+    SetProgramCounter(m_PC + 2);
+
+    // UpdateDeadFlagWrites only marks 8XY4 - 8XYE and DXYN
+    if ((m_currentOpcode & 0xF000) == 0xD000)
+        m_flaglessDraw(m_currentOpcode, this);
     else
+        m_flaglessArithmetic[m_currentOpcode & 0x000F](m_currentOpcode, this);
+}
+
+void Chip8::BuildFlagGraph()
+{
+    m_flagGraph.Build(m_memory, (uint32_t)m_deadFlagWrites.size(), 0, FIRST_MEMORY_LOCATION);
+    UpdateDeadFlagWrites();
+}
+
+void Chip8::UpdateDeadFlagWrites()
+{
+    std::fill(m_deadFlagWrites.begin(), m_deadFlagWrites.end(), 0);
+    m_deadFlagWriteCount = 0;
+
+    // the graph decodes F000 NNNN and 01NN NNNN as 4 byte instructions on every machine, but other machines
+    // run them as two. Then the graph isn't the program, and nothing is left out
+    for (const DecodedInstruction& instruction : m_flagGraph.GetInstructions())
     {
-        SDL_PollEvent(&m_event);
+        if ((instruction.operation == OP_LOAD_LONG_INDEX && m_machine != MACHINE_XOCHIP)
+            || (instruction.operation == OP_LOAD_MEGA_INDEX && m_machine != MACHINE_MEGACHIP))
+            return;
     }
 
-    switch (m_event.type)
+    for (uint32_t address : FlagLiveness::FindDeadFlagWrites(m_flagGraph))
     {
-    case SDL_QUIT:
-        m_active = false;
-        return 0;
-    case SDL_KEYDOWN:
-        if (m_keymap.count(m_event.key.keysym.sym) > 0)
-        {
-            const uint8_t keyIndex = m_keymap.at(m_event.key.keysym.sym);
-            m_keyboard[keyIndex] = true;
-            return keyIndex;
-        }
-    case SDL_KEYUP:
-        if (m_keymap.count(m_event.key.keysym.sym) > 0)
+        m_deadFlagWrites[address] = 1;
+        ++m_deadFlagWriteCount;
+    }
+}
+
+Superinstruction Chip8::PredecodeSuperinstruction(uint16_t address) const
+{
+    // the program counter is 16 bits and wraps to 0 past 0xFFFF, so a sequence that would cross it isn't fused.
+    // Tick runs the bytes at 0 next, not the ones above 0xFFFF that MEGA-CHIP memory has
+    auto opcodeAt = [this](uint32_t at) { return at + 1 < m_memorySize && at + 1 <= 0xFFFF ? m_memory[at] << 8 | m_memory[at + 1] : -1; };
+    const int opc = opcodeAt(address);
+    const int next = opcodeAt(address + 2);
+    const int last = opcodeAt(address + 4);
+    if (opc < 0 || next < 0)
+        return SUPER_NONE;
+
+    // none of these opcodes is the start of a 4 byte instruction, so the sequence is always 2 bytes apart
+    if ((opc & 0xF000) == 0x6000 && (next & 0xF000) == 0x6000)
+        return SUPER_LOAD_PAIR;
+    if ((opc & 0xF000) == 0xA000 && (next & 0xF000) == 0xD000)
+        return SUPER_DRAW;
+    if ((opc & 0xF0FF) == 0xF007 && (next & 0xF000) == 0x3000 && last >= 0 && (last & 0xF000) == 0x1000)
+        return SUPER_DELAY_WAIT;
+    if ((opc & 0xF000) == 0x7000 && (next & 0xF000) == 0x3000)
+        return SUPER_LOOP_COUNTER;
+
+    return SUPER_NONE;
+}
+
+void Chip8::InvalidateSuperinstructions(size_t first, size_t last)
+{
+    // a superinstruction is up to 6 bytes long, so it can start up to 5 bytes before the first byte written
+    first = first > 5 ? first - 5 : 0;
+    last = std::min(last, m_superinstructions.size());
+    if (first < last)
+        std::fill(m_superinstructions.begin() + first, m_superinstructions.begin() + last, SUPER_UNDECODED);
+}
+
+const char* Chip8::GetSuperinstructionName(Superinstruction kind)
+{
+    switch (kind)
+    {
+        case SUPER_LOAD_PAIR:
+            return "6XKK 6YKK";
+        case SUPER_DRAW:
+            return "ANNN DXYN";
+        case SUPER_DELAY_WAIT:
+            return "FX07 3XKK 1NNN";
+        case SUPER_LOOP_COUNTER:
+            return "7XKK 3XKK";
+        default:
+            return "none";
+    }
+}
+
+void Chip8::TickTimers()
+{
+    if (m_delayTimer > 0)
+        SetDelayTimer(m_delayTimer - 1);
+
+    if (m_beepTimer > 0)
+        SetBeepTimer(m_beepTimer - 1);
+}
+
+void Chip8::RenderScreen(const Frame& frame, SDL_Renderer* renderer, SDL_Texture* texture) const
+{
+    // the MEGA-CHIP screen is expanded through its palette straight into the texture
+    if (frame.megaScreen.IsEnabled())
+    {
+        const SDL_Rect megaRect = { 0, 0, MEGA_SCREEN_WIDTH, MEGA_SCREEN_HEIGHT };
+        void* texels;
+        int pitch;
+        if (SDL_LockTexture(texture, &megaRect, &texels, &pitch) == 0)
         {
-            const uint8_t keyIndex = m_keymap.at(m_event.key.keysym.sym);
-            if (m_keyboard[keyIndex])
-            {
-                m_keyboard[keyIndex] = false;
-                return 0;
-            }
+            frame.megaScreen.ExpandShownPage((uint32_t*)texels, pitch / (int)sizeof(uint32_t));
+            SDL_UnlockTexture(texture);
         }
+
+        SDL_RenderClear(renderer);
+        SDL_RenderCopy(renderer, texture, &megaRect, NULL);
+        SDL_RenderPresent(renderer);
+        return;
     }
 
-    return 0;
+    // colors of the 4 combinations of the 2 bitplanes. Classic roms only use the first two
+    const std::array<uint32_t, 4>& palette = m_romInfo.palette;
+
+    // one texel per chip8 pixel. The renderer scales it up to the window.
+    // The texture is sized for the MEGA-CHIP screen, smaller screens only use its top left corner
+    const SDL_Rect rect = { 0, 0, frame.screen.GetWidth(), frame.screen.GetHeight() };
+    std::array<uint32_t, HIRES_SCREEN_WIDTH * HIRES_SCREEN_HEIGHT> pixels;
+    for (int y = 0; y < rect.h; ++y)
+    {
+        for (int x = 0; x < rect.w; ++x)
+            pixels[y * rect.w + x] = palette[frame.screen.GetPixel(x, y)];
+    }
+
+    SDL_UpdateTexture(texture, &rect, pixels.data(), rect.w * sizeof(uint32_t));
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, &rect, NULL);
+    SDL_RenderPresent(renderer);
 }
 
 void Chip8::Run()
 {
     SDL_Window* window;
     SDL_Renderer* renderer;
-    SDL_Surface* screen;
+    SDL_Texture* texture;
     
     // initialize SDL
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
@@ -283,100 +683,434 @@ void Chip8::Run()
         return;
     }
 
-    if (SDL_CreateWindowAndRenderer(640, 320, 0, &window, &renderer))
+    // MEGA-CHIP roms mostly run in 256x192, which is 4:3 rather than 2:1
+    const bool megaChip = m_machine == MACHINE_MEGACHIP;
+    window = SDL_CreateWindow("Chip8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, megaChip ? 768 : 640, megaChip ? 576 : 320, 0);
+    if (window == NULL)
     {
         printf("Failed to create SDL window: %s\n", SDL_GetError());
         return;
     }
+
+    // with vsync, presenting blocks until the next refresh and the display paces everything
+    const Uint32 rendererFlags = m_pacing == PACING_VSYNC ? SDL_RENDERER_PRESENTVSYNC : 0;
+    renderer = SDL_CreateRenderer(window, -1, rendererFlags);
+    if (renderer == NULL)
+    {
+        printf("Failed to create SDL renderer: %s\n", SDL_GetError());
+        return;
+    }
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-    screen = SDL_GetWindowSurface(window);
 
-    // create a white 10x10 square to represent 1 chip8 pixel
-    m_pixel = SDL_CreateRGBSurface(0, 10, 10, 32, 0, 0, 0, 0);
-    SDL_FillRect(m_pixel, NULL, SDL_MapRGB(m_pixel->format, 255, 255, 255));
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, MEGA_SCREEN_WIDTH, MEGA_SCREEN_HEIGHT);
+    if (texture == NULL)
+    {
+        printf("Failed to create SDL texture: %s\n", SDL_GetError());
+        return;
+    }
+
+    // on a display close enough to 60hz every refresh runs exactly one frame. Other rates carry the fraction over
+    double refreshRate = 60.0;
+    if (m_pacing == PACING_VSYNC)
+    {
+        SDL_RendererInfo info;
+        SDL_DisplayMode mode;
+        if (SDL_GetRendererInfo(renderer, &info) != 0 || (info.flags & SDL_RENDERER_PRESENTVSYNC) == 0)
+        {
+            printf("Vsync is not available, pacing by the wall clock instead\n");
+            m_pacing = PACING_WALL_CLOCK;
+        }
+        else if (SDL_GetWindowDisplayMode(window, &mode) == 0 && mode.refresh_rate > 0 && abs(mode.refresh_rate - 60) > 1)
+        {
+            refreshRate = mode.refresh_rate;
+        }
+    }
+    FrameClock vsyncClock(60.0 / refreshRate);
 
-    // determine minimum time that must be spent on each tick to match the user-specified rate (or 500hz by default)
-    auto minTimePerTickms = std::chrono::milliseconds(1000 / m_tickrate);
+    // keyboard events are drained on this thread and applied on the emulation thread once per frame.
+    // Finished frames come back through a triple buffer, so neither thread ever waits for the other.
+    KeypadInput input;
+    input.SetKeymap(m_romInfo.keymap);
+    TripleBuffer<Frame> frames;
 
-    // delay and beep timer are always 60hz
-    auto minTimePerTimerms = std::chrono::milliseconds(1000 / 60);
+    std::unique_ptr<KeypadSpeculator> speculator;
+    if (m_speculationBranches > 0)
+    {
+        speculator.reset(new KeypadSpeculator(m_speculationBranches));
+        const int errorCode = speculator->Init(m_tickrate, m_machine, m_quirkProfile);
+        if (errorCode != 0)
+        {
+            printf("Failed to initialize speculation. Error code: %d\n", errorCode);
+            return;
+        }
+    }
 
-    auto tickStartTime = std::chrono::steady_clock::now();
-    auto timerStartTime = std::chrono::steady_clock::now();
-    while (m_active)
+    // the beep is synthesized on SDL's audio thread from the timer edges the emulation thread reports
+    ToneSynth synth;
+    AudioDevice audio;
+    ToneSynth* tone = &synth;
+    if (audio.Open(synth) != 0)
     {
-        auto tickTimeDiff = std::chrono::steady_clock::now() - tickStartTime;
+        printf("Failed to open audio device, continuing without sound: %s\n", SDL_GetError());
+        tone = nullptr;
 
-        if (tickTimeDiff >= minTimePerTickms)
+        if (m_pacing == PACING_AUDIO)
         {
-            tickStartTime = std::chrono::steady_clock::now();
-            //printf("TIME DIFF: %lld\n", tickTimeDiff.count());
+            printf("Pacing by the wall clock instead of the audio clock\n");
+            m_pacing = PACING_WALL_CLOCK;
+        }
+    }
 
-            // check for keyboard presses without blocking
-            PollEvents(false);
+    std::thread emulation(&Chip8::EmulationLoop, this, std::ref(input), std::ref(frames), speculator.get(), tone,
+        m_pacing == PACING_VSYNC ? &vsyncClock : nullptr);
 
-            // execute next instruction
-            Tick();
+    // without vsync, present at the guest's 60hz frame rate. Presenting half a period out of phase with the
+    // emulation thread keeps the two from racing for the same frame on every tick
+    const auto framePeriod = std::chrono::nanoseconds(1000000000 / 60);
+    auto nextPresentTime = std::chrono::steady_clock::now() + framePeriod / 2;
+    uint64_t presented = 0;
+
+    // time from a key press being drained to the first frame the guest read it in being presented
+    LatencyHistogram inputLatency;
+    std::array<uint64_t, 16> measuredPresses = {};
+    uint64_t reportedSamples = 0;
+    auto nextReportTime = nextPresentTime + std::chrono::seconds(1);
+
+    // how far the time between two presents strays from the refresh period
+    LatencyHistogram frameJitter;
+    const auto refreshPeriod = std::chrono::nanoseconds((int64_t)(1e9 / refreshRate));
+    std::chrono::steady_clock::time_point lastPresentTime;
+    std::chrono::nanoseconds presentIntervals(0);
+    uint64_t presents = 0;
+
+    while (m_active)
+    {
+        input.PollEvents();
+        if (input.IsQuitRequested())
+            m_active = false;
+
+        // nothing new to show keeps the previous frame on screen. With vsync it's presented again to wait for the refresh
+        const bool newFrame = frames.Acquire();
+        if (newFrame || m_pacing == PACING_VSYNC)
+        {
+            const Frame& frame = frames.GetFrontBuffer();
+            RenderScreen(frame, renderer, texture);
 
-            if (m_PC >= 4096)
+            const auto now = std::chrono::steady_clock::now();
+            if (presents++ > 0)
             {
-                printf("Memory out of bounds!");
-                break;
+                const auto interval = now - lastPresentTime;
+                presentIntervals += interval;
+                frameJitter.Add(interval > refreshPeriod ? (interval - refreshPeriod).count() : (refreshPeriod - interval).count());
             }
+            lastPresentTime = now;
 
-            // screen needs to be updated
-            if (m_draw)
+            if (newFrame)
             {
-                RenderScreen(screen, window);
+                ++presented;
+
+                const uint64_t presentTime = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count();
+                frame.presses.Measure(presentTime, measuredPresses, inputLatency);
             }
         }
 
-        auto timerTimeDiff = std::chrono::steady_clock::now() - timerStartTime;
-        if (timerTimeDiff >= minTimePerTimerms)
+        // live report in the title bar, once a second and only when there's something new
+        if (std::chrono::steady_clock::now() >= nextReportTime)
         {
-            if (m_delayTimer > 0)
-                m_delayTimer--;
-
-            if (m_beepTimer >= 1)
+            nextReportTime += std::chrono::seconds(1);
+            if (inputLatency.GetCount() != reportedSamples)
             {
-                m_beepTimer--;
-                if (m_beepTimer == 0)
-                    printf("BEEP\n");
+                reportedSamples = inputLatency.GetCount();
+
+                char title[128];
+                snprintf(title, sizeof(title), "Chip8 - input latency p50 %.1f ms, p95 %.1f ms, p99 %.1f ms",
+                    inputLatency.GetPercentile(0.50) / 1e6, inputLatency.GetPercentile(0.95) / 1e6, inputLatency.GetPercentile(0.99) / 1e6);
+                SDL_SetWindowTitle(window, title);
             }
         }
+
+        if (m_pacing == PACING_VSYNC)
+        {
+            // the present above waited for the refresh. Let the emulation thread run the frames it's worth
+            // and pick them up as soon as they're done, so that each is shown on the very next refresh
+            vsyncClock.Refresh();
+            vsyncClock.WaitForEmulation(refreshPeriod / 2);
+        }
+        else
+        {
+            nextPresentTime += framePeriod;
+            const auto now = std::chrono::steady_clock::now();
+            if (nextPresentTime < now)
+                nextPresentTime = now;
+            std::this_thread::sleep_until(nextPresentTime);
+        }
+    }
+
+    vsyncClock.Stop();
+    emulation.join();
+    printf("Frames presented: %llu, dropped: %llu, duplicated: %llu\n", (unsigned long long)presented,
+        (unsigned long long)frames.GetDroppedCount(), (unsigned long long)frames.GetDuplicatedCount());
+    inputLatency.Print("Input latency");
+    if (presents > 1)
+    {
+        printf("Present interval: %.3f ms on average for a %.1fhz target\n", presentIntervals.count() / 1e6 / (presents - 1), refreshRate);
+        frameJitter.Print("Frame time jitter");
+    }
+    if (speculator)
+        speculator->PrintStats();
+
+    audio.Close();
+    if (tone != nullptr)
+    {
+        printf("Audio underruns: %llu, skips: %llu, dropped edges: %llu\n", (unsigned long long)synth.GetUnderrunCount(),
+            (unsigned long long)synth.GetSkipCount(), (unsigned long long)synth.GetDroppedEdgeCount());
+        if (m_pacing == PACING_AUDIO)
+            printf("Audio pacing frame length adjustment: %+d ppm\n", (int)synth.GetRateAdjust());
+    }
+}
+
+void Chip8::EmulationLoop(KeypadInput& input, TripleBuffer<Frame>& frames, KeypadSpeculator* speculator, ToneSynth* synth, FrameClock* vsyncClock)
+{
+    const auto framePeriod = std::chrono::nanoseconds(1000000000 / 60);
+    auto nextFrameTime = std::chrono::steady_clock::now();
+
+    // spread the tickrate over the 60 frames of each second without drifting
+    auto instructionsInFrame = [this](uint64_t frame) { return (int)((frame + 1) * m_tickrate / 60 - frame * m_tickrate / 60); };
+
+    // presses read in frames that aren't known to have been presented yet. Each frame takes them along, so that
+    // whichever of them is shown first measures them
+    KeyPresses unpresented = {};
+
+    // run-ahead rewinds to this state after every frame. Lives here so that it's only allocated once
+    Chip8State runAheadState;
+
+    // time spent emulating the real frames and running ahead, to report what run-ahead costs
+    std::chrono::nanoseconds emulationTime(0);
+    std::chrono::nanoseconds runAheadTime(0);
+    uint64_t framesOverBudget = 0;
+    uint64_t frame = 0;
+    bool wasToneOn = false;
+    ToneVoice lastVoice = GetToneVoice();
+
+    // instructions of the real frames, and how many of them were skipped idle loop passes
+    uint64_t instructionsRun = 0;
+    uint64_t idleInstructions = 0;
+
+    // instructions run by superinstructions in the real frames, and the dispatches that saved
+    uint64_t fusedInstructions = 0;
+    uint64_t savedDispatches = 0;
+    auto superinstructionsRun = [this]()
+    {
+        uint64_t count = 0;
+        for (int kind = SUPER_LOAD_PAIR; kind < SUPERINSTRUCTION_KINDS; ++kind)
+            count += m_superinstructionCounts[kind];
+        return count;
+    };
+
+    // audio pacing keeps this many emulated frames ahead of the audio thread. Enough to cover the
+    // sound card pulling a buffer at a time, while keeping the delay before a beep is heard short
+    const int AUDIO_QUEUED_FRAMES = 3;
+    DynamicRateControl rateControl(synth != nullptr ? synth->GetSampleRate() : TONE_SAMPLE_RATE);
+
+    for (; m_active; ++frame)
+    {
+        // with vsync, each frame waits for the display refresh that allows it
+        if (vsyncClock != nullptr && !vsyncClock->WaitForFrame(frame))
+            break;
+
+        const auto frameStart = std::chrono::steady_clock::now();
+
+        input.Apply(*this);
+
+        if (speculator == nullptr || !speculator->TryCommit(*this))
+        {
+            const uint64_t idleBefore = m_idleInstructions;
+            const uint64_t fusedBefore = m_fusedInstructions;
+            const uint64_t superinstructionsBefore = superinstructionsRun();
+            instructionsRun += RunFrame(instructionsInFrame(frame));
+            idleInstructions += m_idleInstructions - idleBefore;
+            fusedInstructions += m_fusedInstructions - fusedBefore;
+            savedDispatches += (m_fusedInstructions - fusedBefore) - (superinstructionsRun() - superinstructionsBefore);
+        }
+
+        // a frame sounds if the beep timer or digitized sound is still running at its end. Only changes are sent to the audio thread
+        const bool toneOn = IsSoundOn();
+        const ToneVoice voice = GetToneVoice();
+        if (synth != nullptr)
+        {
+            if (toneOn != wasToneOn || voice != lastVoice)
+                synth->PushEdge(frame, toneOn, voice);
+            synth->SetRenderableFrames(frame + 1);
+        }
+        wasToneOn = toneOn;
+        lastVoice = voice;
+
+        if (!IsProgramCounterValid())
+        {
+            printf("Memory out of bounds!");
+            m_active = false;
+            break;
+        }
+
+        const auto runAheadStart = std::chrono::steady_clock::now();
+
+        // show where the game will be a few frames from now if the input stays as it is, then rewind
+        if (m_runAheadFrames > 0)
+        {
+            SaveState(runAheadState);
+            for (int i = 1; i <= m_runAheadFrames && IsProgramCounterValid(); ++i)
+                RunFrame(instructionsInFrame(frame + i));
+        }
+
+        KeyPresses readPresses;
+        input.CollectReadPresses(GetKeysRead(), readPresses);
+        unpresented.Merge(readPresses);
+
+        Frame& completed = frames.GetBackBuffer();
+        completed.number = frame;
+        completed.screen = m_screen;
+        completed.megaScreen = m_megaScreen;
+        completed.presses = unpresented;
+
+        if (m_runAheadFrames > 0)
+            LoadState(runAheadState);
+
+        // once published the frame belongs to the presentation thread. If it picked up the previous frame, every
+        // earlier press has been shown and only this frame's are still pending. The presentation thread measures
+        // each press once, so the frame after this one carrying them too doesn't count them twice
+        if (!frames.Publish())
+            unpresented = readPresses;
+
+        // the branches run on the workers while this thread waits for the next frame
+        if (speculator != nullptr)
+            speculator->Start(*this, instructionsInFrame(frame + 1));
+
+        const auto frameEnd = std::chrono::steady_clock::now();
+        emulationTime += runAheadStart - frameStart;
+        runAheadTime += frameEnd - runAheadStart;
+        if (frameEnd - frameStart > framePeriod)
+            ++framesOverBudget;
+
+        auto period = framePeriod;
+        if (m_pacing == PACING_AUDIO)
+        {
+            // nudge the frame length so that frames come out at the display's rate rather than the sound card's
+            synth->SetRateAdjust(rateControl.Update(synth->GetSamplesRendered(), frames.GetAcquireCount()));
+
+            // the sound card takes whole buffers at a time, so following it frame by frame would emulate in bursts.
+            // Instead keep a steady period and lengthen or shorten it by 2% per frame the audio queue is off target
+            const double queuedFrames = (double)(frame + 1) - (double)synth->GetRenderedFrames();
+            period = std::chrono::duration_cast<std::chrono::nanoseconds>(framePeriod * (1.0 + 0.02 * (queuedFrames - AUDIO_QUEUED_FRAMES)));
+
+            // far ahead of the sound card. Wait for it instead of queueing more
+            while (m_active && frame + 1 >= synth->GetRenderedFrames() + AUDIO_QUEUED_FRAMES * 2)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        if (vsyncClock != nullptr)
+        {
+            vsyncClock->FrameDone();
+            continue;
+        }
+
+        // catch up after a stall instead of running a burst of frames
+        nextFrameTime += period;
+        const auto now = std::chrono::steady_clock::now();
+        if (nextFrameTime + framePeriod * 4 < now)
+            nextFrameTime = now;
+        std::this_thread::sleep_until(nextFrameTime);
+    }
+
+    if (instructionsRun > 0)
+    {
+        printf("Idle loops: %llu of %llu instructions skipped (%.1f%%)\n", (unsigned long long)idleInstructions,
+            (unsigned long long)instructionsRun, idleInstructions * 100.0 / instructionsRun);
+
+        // the rest were skipped, so never dispatched at all
+        const uint64_t instructionsExecuted = std::max<uint64_t>(instructionsRun - idleInstructions, 1);
+        printf("Superinstructions: %llu of %llu instructions run fused, saving %.1f%% of dispatches\n",
+            (unsigned long long)fusedInstructions, (unsigned long long)instructionsExecuted, savedDispatches * 100.0 / instructionsExecuted);
+
+        const uint64_t spriteDraws = GetSpriteCacheHits() + GetSpriteCacheMisses();
+        printf("Sprite cache: %llu of %llu sprite draws hit (%.1f%%)\n", (unsigned long long)GetSpriteCacheHits(),
+            (unsigned long long)spriteDraws, GetSpriteCacheHits() * 100.0 / std::max<uint64_t>(spriteDraws, 1));
+    }
+
+    if (m_runAheadFrames > 0 && frame > 0)
+    {
+        const double emulationUs = emulationTime.count() / 1e3 / frame;
+        const double runAheadUs = runAheadTime.count() / 1e3 / frame;
+        printf("Run-ahead of %d frame(s): %.1f us per frame emulating, %.1f us per frame running ahead (%.1f%% of the frame budget), %llu of %llu frames over budget\n",
+            m_runAheadFrames, emulationUs, runAheadUs, (emulationUs + runAheadUs) * 100.0 / (framePeriod.count() / 1e3),
+            (unsigned long long)framesOverBudget, (unsigned long long)frame);
     }
 }
 
 void Chip8::SetProgramCounter(uint16_t pc)
 {
+    UpdateStateHash(StateHash::SLOT_PROGRAM_COUNTER, m_PC, pc);
     m_PC = pc;
 }
 
+void Chip8::SetStackPointer(uint16_t val)
+{
+    UpdateStateHash(StateHash::SLOT_STACK_POINTER, m_stackPointer, val);
+    m_stackPointer = val;
+}
+
+void Chip8::SetTopOfStack(uint16_t val)
+{
+    UpdateStateHash(StateHash::SLOT_STACK + m_stackPointer, m_stack[m_stackPointer], val);
+    m_stack[m_stackPointer] = val;
+}
+
+void Chip8::SetDelayTimer(uint8_t val)
+{
+    UpdateStateHash(StateHash::SLOT_DELAY_TIMER, m_delayTimer, val);
+    m_delayTimer = val;
+}
+
+void Chip8::SetBeepTimer(uint8_t val)
+{
+    UpdateStateHash(StateHash::SLOT_BEEP_TIMER, m_beepTimer, val);
+    m_beepTimer = val;
+}
+
 uint8_t Chip8::GetRegister(uint8_t regIndex) const
 {
-    if (regIndex > m_V.size())
+    if (regIndex >= m_V.size())
     {
         printf("GetRegister: Invalid register specified (%d)\n", regIndex);
         return 0;
     }
 
+    // only ever set while checking flags
+    if (regIndex == 0xF && m_deadFlagAddress >= 0)
+    {
+        printf("Flag check: VF read at 0x%03X, but the VF write at 0x%03X was taken to be dead\n", m_PC - 2, m_deadFlagAddress);
+        ++m_flagCheckFailures;
+    }
+
     return m_V[regIndex];
 }
 
 void Chip8::SetRegister(uint8_t regIndex, uint8_t val)
 {
-    if (regIndex > m_V.size())
+    if (regIndex >= m_V.size())
     {
         printf("SetRegister: Invalid register specified (%d)\n", regIndex);
         return;
     }
 
+    UpdateStateHash(StateHash::SLOT_REGISTER + regIndex, m_V[regIndex], val);
     m_V[regIndex] = val;
+    if (regIndex == 0xF)
+        m_deadFlagAddress = -1;
 }
 
-uint8_t Chip8::GetMemory(uint16_t memIndex) const
+uint8_t Chip8::GetMemory(uint32_t memIndex) const
 {
-    if (memIndex > m_memory.size())
+    if (memIndex >= m_memorySize)
     {
         printf("GetMemory: Invalid register specified (%d)\n", memIndex);
         return 0;
@@ -386,53 +1120,346 @@ uint8_t Chip8::GetMemory(uint16_t memIndex) const
     return m_memory[memIndex];
 }
 
-void Chip8::SetMemory(uint16_t memIndex, uint8_t val)
+void Chip8::SetMemory(uint32_t memIndex, uint8_t val)
 {
-    if (memIndex > m_memory.size())
+    if (memIndex >= m_memorySize)
     {
         printf("SetMemory: Invalid register specified (%d)\n", memIndex);
         return;
     }
 
+    if (memIndex >= m_memoryUsed)
+        m_memoryUsed = memIndex + 1;
+
+    UpdateStateHash(StateHash::SLOT_MEMORY + memIndex, m_memory[memIndex], val);
     m_memory[memIndex] = val;
+    InvalidateSuperinstructions(memIndex, memIndex + 1);
+    m_spriteCache.OnWrite(memIndex);
+    if (m_flagGraph.OnWrite(memIndex))
+        UpdateDeadFlagWrites();
     Debug::Log("\tSetMemory: memory[0x%X] = 0x%X\n", memIndex, m_memory[memIndex]);
     return;
 }
 
-uint16_t Chip8::GetIndex() const
+void Chip8::SkipNextInstruction()
+{
+    bool longInstruction = false;
+    if (m_machine == MACHINE_XOCHIP && IsProgramCounterValid())
+        longInstruction = m_memory[m_PC] == 0xF0 && m_memory[m_PC + 1] == 0x00;
+    else if (m_machine == MACHINE_MEGACHIP && IsProgramCounterValid())
+        longInstruction = m_memory[m_PC] == 0x01;
+
+    SetProgramCounter(m_PC + (longInstruction ? 4 : 2));
+}
+
+uint32_t Chip8::GetIndex() const
 {
     return m_I;
 }
 
-void Chip8::SetIndex(uint16_t val)
+void Chip8::SetIndex(uint32_t val)
 {
+    // 16 bits wide everywhere but on MEGA-CHIP
+    val &= m_machine == MACHINE_MEGACHIP ? 0xFFFFFF : 0xFFFF;
+
+    UpdateStateHash(StateHash::SLOT_INDEX, m_I, val);
     m_I = val;
 }
 
-bool Chip8::GetPixelStatus(uint16_t pixel) const
+bool Chip8::GetPixelStatus(int x, int y) const
+{
+    if (x < 0 || x >= m_screen.GetWidth() || y < 0 || y >= m_screen.GetHeight())
+    {
+        printf("GetPixelStatus: Invalid pixel specified (%d, %d)\n", x, y);
+        return false;
+    }
+
+    return m_screen.GetPixel(x, y);
+}
+
+void Chip8::ClearDisplay()
+{
+    // on MEGA-CHIP clearing is also what shows the finished picture
+    if (IsMegaMode())
+        m_megaScreen.Flip();
+    else
+        m_screen.Clear();
+}
+
+void Chip8::ScrollDisplayUp(int rows)
+{
+    if (IsMegaMode())
+        m_megaScreen.ScrollUp(rows);
+    else
+        m_screen.ScrollUp(rows);
+}
+
+void Chip8::ScrollDisplayDown(int rows)
+{
+    if (IsMegaMode())
+        m_megaScreen.ScrollDown(rows);
+    else
+        m_screen.ScrollDown(rows);
+}
+
+void Chip8::ScrollDisplayLeft(int pixels)
+{
+    if (IsMegaMode())
+        m_megaScreen.ScrollLeft(pixels);
+    else
+        m_screen.ScrollLeft(pixels);
+}
+
+void Chip8::ScrollDisplayRight(int pixels)
+{
+    if (IsMegaMode())
+        m_megaScreen.ScrollRight(pixels);
+    else
+        m_screen.ScrollRight(pixels);
+}
+
+void Chip8::LoadPalette(uint32_t address, int count)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const uint32_t entry = address + i * 4;
+        const uint32_t argb = (uint32_t)GetMemory(entry) << 24 | GetMemory(entry + 1) << 16 | GetMemory(entry + 2) << 8 | GetMemory(entry + 3);
+        m_megaScreen.SetPaletteEntry((uint8_t)(i + 1), argb);
+    }
+}
+
+bool Chip8::DrawMegaSprite(int x, int y)
 {
-    if (pixel > m_screen.size())
+    const size_t spriteSize = (size_t)m_megaScreen.GetSpriteWidth() * m_megaScreen.GetSpriteHeight();
+    if (m_I + spriteSize > m_memorySize)
     {
-        printf("GetPixelStatus: Invalid pixel specified (%d)\n", pixel);
+        printf("DrawMegaSprite: sprite at 0x%X runs past the end of memory\n", m_I);
         return false;
     }
 
-    return m_screen[pixel] == 1;
+    return m_megaScreen.DrawSprite(x, y, m_memory + m_I);
+}
+
+uint8_t Chip8::GetRplFlag(uint8_t flagIndex) const
+{
+    if (flagIndex >= m_rplFlags.size())
+    {
+        printf("GetRplFlag: Invalid flag specified (%d)\n", flagIndex);
+        return 0;
+    }
+
+    return m_rplFlags[flagIndex];
 }
 
-void Chip8::XorPixel(uint16_t pixel)
+void Chip8::SetRplFlag(uint8_t flagIndex, uint8_t val)
 {
-    if (pixel > m_screen.size())
+    if (flagIndex >= m_rplFlags.size())
     {
-        printf("SetPixelStatus: Invalid pixel specified (%d)\n", pixel);
+        printf("SetRplFlag: Invalid flag specified (%d)\n", flagIndex);
         return;
     }
 
-    m_screen[pixel] ^= 1;
+    UpdateStateHash(StateHash::SLOT_RPL_FLAG + flagIndex, m_rplFlags[flagIndex], val);
+    m_rplFlags[flagIndex] = val;
+}
+
+void Chip8::LoadAudioPattern(uint32_t address)
+{
+    for (size_t i = 0; i < m_audioPattern.size(); ++i)
+    {
+        const uint8_t val = GetMemory((uint16_t)(address + i));
+        UpdateStateHash(StateHash::SLOT_PATTERN + (uint32_t)i, m_audioPattern[i], val);
+        m_audioPattern[i] = val;
+    }
+
+    UpdateStateHash(StateHash::SLOT_PATTERN_LOADED, m_audioPatternLoaded ? 1 : 0, 1);
+    m_audioPatternLoaded = true;
+}
+
+void Chip8::SetPitch(uint8_t val)
+{
+    UpdateStateHash(StateHash::SLOT_PITCH, m_pitch, val);
+    m_pitch = val;
+}
+
+void Chip8::PlayDigitizedSound(uint32_t address, bool loop)
+{
+    const uint32_t oldStream = GetSoundStreamSlotValue();
+    m_soundAddress = address;
+    m_soundLoop = loop;
+    m_soundPlaying = true;
+    UpdateStateHash(StateHash::SLOT_SOUND_STREAM, oldStream, GetSoundStreamSlotValue());
+
+    UpdateStateHash(StateHash::SLOT_SOUND_TRIGGER, m_soundTrigger, m_soundTrigger + 1);
+    ++m_soundTrigger;
+}
+
+void Chip8::StopDigitizedSound()
+{
+    UpdateStateHash(StateHash::SLOT_SOUND_STREAM, GetSoundStreamSlotValue(), 0);
+    m_soundPlaying = false;
+}
+
+ToneVoice Chip8::GetToneVoice() const
+{
+    ToneVoice voice = {};
+    voice.usePattern = m_audioPatternLoaded;
+    voice.pattern = m_audioPattern;
+    voice.pitch = m_pitch;
+
+    // the samples are played straight out of the rom, which doesn't change while the machine runs
+    const uint32_t header = m_soundAddress - FIRST_MEMORY_LOCATION;
+    if (m_soundPlaying && m_soundAddress >= FIRST_MEMORY_LOCATION && header + 5 <= m_rom.size())
+    {
+        const uint8_t* sound = m_rom.data() + header;
+        voice.samples = sound + 5;
+        voice.sampleRate = (uint16_t)(sound[0] << 8 | sound[1]);
+        voice.sampleCount = std::min((uint32_t)(sound[2] << 16 | sound[3] << 8 | sound[4]), (uint32_t)m_rom.size() - header - 5);
+        voice.loop = m_soundLoop;
+        voice.trigger = m_soundTrigger;
+    }
+
+    return voice;
+}
+
+void Chip8::SaveState(Chip8State& state) const
+{
+    state.memoryUsed = (uint32_t)m_memoryUsed;
+    if (m_machine == MACHINE_MEGACHIP)
+        state.megaMemory.assign(m_memory, m_memory + m_memoryUsed);
+    else
+        std::copy_n(m_memory, m_memoryUsed, state.memory.begin());
+    state.V = m_V;
+    state.I = m_I;
+    state.PC = m_PC;
+    state.screen = m_screen;
+    state.megaScreen = m_megaScreen;
+    state.delayTimer = m_delayTimer;
+    state.beepTimer = m_beepTimer;
+    state.stack = m_stack;
+    state.stackPointer = m_stackPointer;
+    state.rplFlags = m_rplFlags;
+    state.audioPattern = m_audioPattern;
+    state.audioPatternLoaded = m_audioPatternLoaded;
+    state.pitch = m_pitch;
+    state.soundAddress = m_soundAddress;
+    state.soundLoop = m_soundLoop;
+    state.soundPlaying = m_soundPlaying;
+    state.soundTrigger = m_soundTrigger;
+    state.stateHash = m_stateHash;
+    state.draw = m_draw;
+    for (size_t i = 0; i < m_keyboard.size(); ++i)
+        state.keyboard[i] = m_keyboard[i];
+    state.keysRead = m_keysRead;
+    state.waitingForKey = m_waitingForKey;
+    state.keyWaitRegister = m_keyWaitRegister;
+    state.mersenneTwister = m_mersenneTwister;
+}
+
+void Chip8::LoadState(const Chip8State& state)
+{
+    // whatever was written since the state was saved has to go back to zero
+    const uint8_t* memory = m_machine == MACHINE_MEGACHIP ? state.megaMemory.data() : state.memory.data();
+    const size_t restored = std::max(m_memoryUsed, (size_t)state.memoryUsed);
+    auto restoredByte = [&](size_t i) { return i < state.memoryUsed ? memory[i] : (uint8_t)0; };
+
+    // only superinstructions over bytes restored to something else are predecoded again, and the graph is only
+    // rebuilt if one of those bytes is code. A graph with no code yet belongs to a machine that never loaded the rom itself
+    bool codeChanged = m_flagGraph.GetInstructions().empty();
+    size_t first = 0;
+    while (first < restored)
+    {
+        // skip the bytes that stay the same
+        if (first < state.memoryUsed)
+            first = std::mismatch(m_memory + first, m_memory + state.memoryUsed, memory + first).first - m_memory;
+        while (first < restored && m_memory[first] == restoredByte(first))
+            ++first;
+        if (first == restored)
+            break;
+
+        size_t last = first;
+        for (; last < restored && m_memory[last] != restoredByte(last); ++last)
+            codeChanged = codeChanged || m_flagGraph.IsCode((uint32_t)last);
+
+        InvalidateSuperinstructions(first, last);
+        first = last;
+    }
+
+    std::copy_n(memory, state.memoryUsed, m_memory);
+    if (m_memoryUsed > state.memoryUsed)
+        std::fill(m_memory + state.memoryUsed, m_memory + m_memoryUsed, 0);
+    m_memoryUsed = state.memoryUsed;
+    m_spriteCache.Refresh();
+    if (codeChanged)
+        BuildFlagGraph();
+    m_deadFlagAddress = -1;
+
+    m_V = state.V;
+    m_I = state.I;
+    m_PC = state.PC;
+    m_screen = state.screen;
+    m_megaScreen = state.megaScreen;
+    m_delayTimer = state.delayTimer;
+    m_beepTimer = state.beepTimer;
+    m_stack = state.stack;
+    m_stackPointer = state.stackPointer;
+    m_rplFlags = state.rplFlags;
+    m_audioPattern = state.audioPattern;
+    m_audioPatternLoaded = state.audioPatternLoaded;
+    m_pitch = state.pitch;
+    m_soundAddress = state.soundAddress;
+    m_soundLoop = state.soundLoop;
+    m_soundPlaying = state.soundPlaying;
+    m_soundTrigger = state.soundTrigger;
+    m_stateHash = state.stateHash;
+    m_draw = state.draw;
+    for (size_t i = 0; i < m_keyboard.size(); ++i)
+        m_keyboard[i] = state.keyboard[i];
+    m_keysRead = state.keysRead;
+    m_waitingForKey = state.waitingForKey;
+    m_keyWaitRegister = state.keyWaitRegister;
+    m_mersenneTwister = state.mersenneTwister;
+}
+
+uint64_t Chip8::ComputeStateHash() const
+{
+    uint64_t hash = 0;
+
+    for (size_t i = 0; i < m_memorySize; ++i)
+        hash ^= StateHash::Key(StateHash::SLOT_MEMORY + (uint32_t)i, m_memory[i]);
+
+    for (size_t i = 0; i < m_V.size(); ++i)
+        hash ^= StateHash::Key(StateHash::SLOT_REGISTER + i, m_V[i]);
+
+    for (size_t i = 0; i < m_stack.size(); ++i)
+        hash ^= StateHash::Key(StateHash::SLOT_STACK + i, m_stack[i]);
+
+    for (size_t i = 0; i < m_rplFlags.size(); ++i)
+        hash ^= StateHash::Key(StateHash::SLOT_RPL_FLAG + i, m_rplFlags[i]);
+
+    for (size_t i = 0; i < m_audioPattern.size(); ++i)
+        hash ^= StateHash::Key(StateHash::SLOT_PATTERN + i, m_audioPattern[i]);
+
+    hash ^= m_screen.ComputeHash();
+    hash ^= m_megaScreen.ComputeHash();
+
+    hash ^= StateHash::Key(StateHash::SLOT_INDEX, m_I);
+    hash ^= StateHash::Key(StateHash::SLOT_PROGRAM_COUNTER, m_PC);
+    hash ^= StateHash::Key(StateHash::SLOT_STACK_POINTER, m_stackPointer);
+    hash ^= StateHash::Key(StateHash::SLOT_DELAY_TIMER, m_delayTimer);
+    hash ^= StateHash::Key(StateHash::SLOT_BEEP_TIMER, m_beepTimer);
+    hash ^= StateHash::Key(StateHash::SLOT_KEY_WAIT, m_waitingForKey ? 0x100 | m_keyWaitRegister : 0);
+    hash ^= StateHash::Key(StateHash::SLOT_PATTERN_LOADED, m_audioPatternLoaded ? 1 : 0);
+    hash ^= StateHash::Key(StateHash::SLOT_PITCH, m_pitch);
+    hash ^= StateHash::Key(StateHash::SLOT_SOUND_STREAM, GetSoundStreamSlotValue());
+    hash ^= StateHash::Key(StateHash::SLOT_SOUND_TRIGGER, m_soundTrigger);
+
+    return hash;
 }
 
 uint8_t Chip8::GetRandomNumber()
 {
+    ++m_randomDraws;
     return m_randomDist(m_mersenneTwister);
 }
 
@@ -444,5 +1471,46 @@ bool Chip8::IsKeyPressed(uint8_t keyIndex)
         return false;
     }
 
+    m_keysRead |= 1 << keyIndex;
     return m_keyboard[keyIndex];
 }
+
+uint16_t Chip8::GetKeyboardState() const
+{
+    uint16_t keyMask = 0;
+    for (size_t i = 0; i < m_keyboard.size(); ++i)
+        keyMask |= (uint16_t)(m_keyboard[i] ? 1 : 0) << i;
+
+    return keyMask;
+}
+
+void Chip8::SetKeyboardState(uint16_t keyMask)
+{
+    for (size_t i = 0; i < m_keyboard.size(); ++i)
+        SetKeyState((uint8_t)i, (keyMask >> i) & 1);
+}
+
+void Chip8::SetKeyState(uint8_t keyIndex, bool pressed)
+{
+    if (keyIndex >= m_keyboard.size())
+        return;
+
+    const bool newPress = pressed && !m_keyboard[keyIndex];
+    m_keyboard[keyIndex] = pressed;
+
+    // a key going down completes a pending FX0A
+    if (newPress && m_waitingForKey)
+    {
+        UpdateStateHash(StateHash::SLOT_KEY_WAIT, 0x100 | m_keyWaitRegister, 0);
+        m_waitingForKey = false;
+        m_keysRead |= 1 << keyIndex;
+        SetRegister(m_keyWaitRegister, keyIndex);
+    }
+}
+
+void Chip8::WaitForKeyPress(uint8_t regIndex)
+{
+    UpdateStateHash(StateHash::SLOT_KEY_WAIT, m_waitingForKey ? 0x100 | m_keyWaitRegister : 0, 0x100 | regIndex);
+    m_waitingForKey = true;
+    m_keyWaitRegister = regIndex;
+}
@@ -1,18 +1,129 @@
 #pragma once
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <random>
 #include <string>
 #include <unordered_map>
 #include <functional>
+#include <vector>
 #include <SDL.h>
+#include "ControlFlowGraph.h"
+#include "Framebuffer.h"
+#include "KeypadInput.h"
+#include "MegaFramebuffer.h"
+#include "Quirks.h"
+#include "RomDatabase.h"
+#include "SpriteCache.h"
+#include "StateHash.h"
+#include "ToneSynth.h"
+#include "TripleBuffer.h"
 
 //#define DEBUG
 
 #define FONT_START_ADDR 0x050
 #define FONT_END_ADDR 0x0A0
+#define BIG_FONT_START_ADDR 0x0A0
+#define BIG_FONT_END_ADDR 0x140
 #define FIRST_MEMORY_LOCATION 0x200
 
+// memory of each machine type
+#define CLASSIC_MEMORY_SIZE 0x1000
+#define XO_MEMORY_SIZE 0x10000
+#define MEGA_MEMORY_SIZE 0x1000000
+
+// storage reserved for memory in every machine and save state. Builds that only run classic roms can define this as
+// CLASSIC_MEMORY_SIZE to shrink both to the classic size, at the cost of XO-CHIP support.
+// Classic machines never touch more than the first 4K either way. MEGA-CHIP's 16M is too much to reserve
+// everywhere, so only MEGA-CHIP machines and their save states allocate their memory
+#ifndef MAX_MEMORY_SIZE
+#define MAX_MEMORY_SIZE XO_MEMORY_SIZE
+#endif
+
+// instruction set and memory of the emulated machine
+enum MachineType
+{
+    MACHINE_CHIP8,          // CHIP-8 with the SUPER-CHIP extensions. 4K of memory
+    MACHINE_XOCHIP,         // XO-CHIP. 64K of memory, two bitplanes and audio patterns
+    MACHINE_MEGACHIP,       // MEGA-CHIP. SUPER-CHIP plus 16M of memory, a 256x192 256 color mode and digitized sound
+};
+
+// common sequences of instructions that RunFrame runs with a single dispatch. See the superinstructions in Instructions.h
+enum Superinstruction : uint8_t
+{
+    SUPER_UNDECODED,            // not looked at since the memory there was last written
+    SUPER_NONE,                 // no sequence starts here. The instruction runs on its own
+    SUPER_LOAD_PAIR,            // 6XKK 6YKK
+    SUPER_DRAW,                 // ANNN DXYN
+    SUPER_DELAY_WAIT,           // FX07 3XKK 1NNN
+    SUPER_LOOP_COUNTER,         // 7XKK 3XKK
+    SUPERINSTRUCTION_KINDS
+};
+
+// a completed frame, handed from the emulation thread to the presentation thread
+struct Frame
+{
+    // number of the emulated 60hz frame this screen was captured after
+    uint64_t number;
+
+    Framebuffer screen;
+
+    // shown instead of screen while MEGA-CHIP 256x192 mode is on
+    MegaFramebuffer megaScreen;
+
+    // key presses first read by the guest in this frame, or in earlier frames that weren't known to be presented
+    // when this one was published. Some of them may have been measured already
+    KeyPresses presses;
+};
+
+// everything that changes while the guest runs, copied out by Chip8::SaveState.
+// Only valid for machines of the same type. Memory is only copied up to the last byte that was ever written, since
+// everything past that is still zero. Fixed size for classic and XO-CHIP machines, so saving and restoring never
+// allocates. A MEGA-CHIP state keeps its memory and pages on the heap instead: saving allocates the first time
+// and when they grow, restoring never does.
+struct Chip8State
+{
+    // bytes of memory saved, in memory or in megaMemory on MEGA-CHIP
+    uint32_t memoryUsed;
+    std::array<uint8_t, MAX_MEMORY_SIZE> memory;
+    std::vector<uint8_t> megaMemory;
+
+    std::array<uint8_t, 16> V;
+    uint32_t I;
+    uint16_t PC;
+    Framebuffer screen;
+    MegaFramebuffer megaScreen;
+    uint8_t delayTimer;
+    uint8_t beepTimer;
+    std::array<uint16_t, 64> stack;
+    uint16_t stackPointer;
+    std::array<uint8_t, 16> rplFlags;
+    std::array<uint8_t, 16> audioPattern;
+    bool audioPatternLoaded;
+    uint8_t pitch;
+    uint32_t soundAddress;
+    bool soundLoop;
+    bool soundPlaying;
+    uint32_t soundTrigger;
+    uint64_t stateHash;
+    bool draw;
+    std::array<bool, 16> keyboard;
+    uint16_t keysRead;
+    bool waitingForKey;
+    uint8_t keyWaitRegister;
+    std::mt19937 mersenneTwister;
+};
+
+// what decides when Run() emulates the next frame
+enum PacingMode
+{
+    PACING_WALL_CLOCK,      // a 60hz timer
+    PACING_AUDIO,           // the sound card. A frame runs whenever the audio thread is about to run out of them
+    PACING_VSYNC,           // the display. Each refresh is worth 60 / refresh rate frames
+};
+
+class KeypadSpeculator;
+class FrameClock;
 
 class Chip8
 {
@@ -22,82 +133,333 @@ public:
 
     // initializes chip8 registers and memory for first run
     // returns 0 if no errors. Otherwise returns an error code.
-    int Init(int tickrate);
+    int Init(uint32_t tickrate, MachineType machine = MACHINE_CHIP8, QuirkProfile quirks = QUIRKS_DEFAULT);
+
+    MachineType GetMachine() const { return m_machine; }
+
+    // switches the handlers of the quirky instructions to the ones compiled for profile. Safe between any two ticks
+    void SetQuirkProfile(QuirkProfile profile);
+    QuirkProfile GetQuirkProfile() const { return m_quirkProfile; }
 
     // loads game at specified location into chip8 memory.
     // returns 0 if no errors. Otherwise returns an error code.
     int LoadGame(const std::string& fileName);
 
-    // starts the chip8 emulation cycle
+    // loads a rom that's already in memory. Same error codes as loading from a file
+    int LoadGame(const uint8_t* rom, int romSize);
+
+    // starts the chip8 emulation cycle. The core runs on its own thread while the calling thread
+    // owns the window, polls input and presents the frames the core publishes.
     void Run();
 
-    // emulates 1 cpu cycle
+    // number of frames Run() emulates ahead of the real machine with the current input before presenting.
+    // Each frame, the state is saved, the extra frames are run and shown, and the state is restored, so input
+    // shows up on screen that many frames sooner at the cost of emulating frames + 1 frames per frame. 0 disables it
+    void SetRunAhead(int frames) { m_runAheadFrames = frames; }
+
+    // number of key presses Run() speculatively runs the next frame for while the rom waits on FX0A or polls
+    // the keypad. A frame whose input matches a branch commits the precomputed result. 0 disables it
+    void SetSpeculation(int branches) { m_speculationBranches = branches; }
+
+    // selects what paces Run(). Audio and vsync pacing fall back to the wall clock if there is no audio device / vsync
+    void SetPacing(PacingMode pacing) { m_pacing = pacing; }
+
+    // emulates 1 cpu cycle. Does nothing while the machine is waiting for a key press (FX0A)
     void Tick();
 
+    // emulates one 60hz frame without any SDL involvement: executes up to instructionsPerFrame instructions
+    // and then ticks the timers once. Returns the number of instructions executed, which is only
+    // less than instructionsPerFrame if the program counter left memory or the machine started waiting for a key.
+    // Passes through a loop that provably does nothing until the next frame are counted but not run.
+    int RunFrame(int instructionsPerFrame);
+
+    // skipping of idle loops in RunFrame. On by default. Skipping never changes the results, so this is only
+    // useful to measure the interpreter itself
+    void SetIdleSkipping(bool enabled) { m_idleSkipping = enabled; }
+
+    // instructions RunFrame counted as executed without running them, because the guest was spinning in an idle loop
+    uint64_t GetIdleInstructionCount() const { return m_idleInstructions; }
+
+    // running common instruction sequences as superinstructions in RunFrame. On by default. Like idle loop skipping
+    // this never changes the results
+    void SetSuperinstructions(bool enabled) { m_superinstructionsEnabled = enabled; }
+
+    // times RunFrame ran a superinstruction of kind, and the instructions all superinstructions ran.
+    // Each superinstruction saves all but one dispatch of the instructions it runs
+    uint64_t GetSuperinstructionCount(Superinstruction kind) const { return m_superinstructionCounts[kind]; }
+    uint64_t GetFusedInstructionCount() const { return m_fusedInstructions; }
+
+    // instruction sequence a kind of superinstruction stands for, like "ANNN DXYN"
+    static const char* GetSuperinstructionName(Superinstruction kind);
+
+    // leaving out the VF writes of 8XY4 - 8XYE and DXYN wherever FlagLiveness proved VF is overwritten before it's
+    // read. On by default. Nothing the rom does can tell, but until VF is overwritten the state hash and saved
+    // states hold the stale VF
+    void SetLazyFlags(bool enabled) { m_lazyFlags = enabled; }
+
+    // debug mode for lazy flags: every flag is computed, and each read of a VF write the liveness pass took to be
+    // dead is printed and counted as a failure
+    void SetFlagChecking(bool enabled) { m_flagChecking = enabled; }
+    uint64_t GetFlagCheckFailures() const { return m_flagCheckFailures; }
+
+    // instructions whose VF write is currently left out
+    int GetDeadFlagWriteCount() const { return m_deadFlagWriteCount; }
+
+    // decrements the delay and beep timers. Should be called at 60hz
+    void TickTimers();
+
+    // returns false once the program counter points outside of memory
+    bool IsProgramCounterValid() const { return m_PC + 1u < m_memorySize; }
+
+    // bytes of memory the machine has
+    int GetMemorySize() const { return (int)m_memorySize; }
+
+    // moves the program counter past the next instruction. That's 4 bytes if it's F000 NNNN on XO-CHIP
+    // or 01NN NNNN on MEGA-CHIP
+    void SkipNextInstruction();
+
+    // size in bytes of the last rom loaded with LoadGame
+    int GetRomSize() const { return m_romSize; }
+
+    // RomDatabase hash of the last rom loaded, and whether the database knows it
+    uint64_t GetRomHash() const { return m_romHash; }
+    bool IsRomKnown() const { return m_romKnown; }
+
+    // how the loaded rom wants to be run: its database entry, or what RomAnalyzer inferred if it has none.
+    // Run() always uses its palette and keymap, the quirks and tickrate are up to the caller
+    const RomInfo& GetRomInfo() const { return m_romInfo; }
+
+    // smallest machine that has every instruction RomAnalyzer found in the loaded rom
+    MachineType GetRomMachine() const { return m_romMachine; }
+
+    // tick rate of the main chip8 cpu in hz. Call before Run
+    void SetTickrate(uint32_t tickrate) { m_tickrate = tickrate; }
+    uint32_t GetTickrate() const { return m_tickrate; }
+
     void SetProgramCounter(uint16_t pc);
     uint16_t GetProgramCounter() { return m_PC; }
 
     uint8_t GetRegister(uint8_t regIndex) const;
     void SetRegister(uint8_t regIndex, uint8_t val);
 
-    uint16_t GetIndex() const;
-    void SetIndex(uint16_t val);
+    // I is 24 bits wide on MEGA-CHIP
+    uint32_t GetIndex() const;
+    void SetIndex(uint32_t val);
+
+    uint8_t GetMemory(uint32_t memIndex) const;
+    void SetMemory(uint32_t memIndex, uint8_t val);
+
+    bool GetPixelStatus(int x, int y) const;
+
+    // rows of the sprite DXYN draws from address, packed for XorSpriteRow. Null if the sprite can't be cached,
+    // and it has to be read with GetMemory
+    const uint64_t* GetSpriteRows(uint32_t address, int height, bool wide) { return m_spriteCache.GetRows(address, height, wide); }
+
+    // sprite draws whose rows came from / had to be read into the sprite cache
+    uint64_t GetSpriteCacheHits() const { return m_spriteCache.GetHits(); }
+    uint64_t GetSpriteCacheMisses() const { return m_spriteCache.GetMisses(); }
+
+    // xors a row of a sprite into a plane of the screen at x, y. The top bit of bits is the pixel at x.
+    // Returns true if a pixel was turned off
+    bool XorSpriteRow(int plane, int x, int y, uint64_t bits) { return m_screen.XorRow(plane, x, y, bits); }
 
-    uint8_t GetMemory(uint16_t memIndex) const;
-    void SetMemory(uint16_t memIndex, uint8_t val);
+    // bitplanes that drawing, clearing and scrolling apply to (XO-CHIP). Bit n is plane n
+    void SelectPlanes(uint8_t planeMask) { m_screen.SelectPlanes(planeMask); }
 
-    void XorPixel(uint16_t pixel);
-    bool GetPixelStatus(uint16_t pixel) const;
+    // switches between 64x32 and 128x64 (SUPER-CHIP). Clears the screen
+    void SetHighRes(bool highRes) { m_screen.SetHighRes(highRes); }
+
+    // scrolls whichever screen is in use
+    void ScrollDisplayUp(int rows);
+    void ScrollDisplayDown(int rows);
+    void ScrollDisplayLeft(int pixels);
+    void ScrollDisplayRight(int pixels);
+
+    // MEGA-CHIP 256x192 mode (0011 / 0010). While it's on, drawing, clearing and scrolling go to the MEGA-CHIP screen
+    void SetMegaMode(bool enabled) { m_megaScreen.SetEnabled(enabled); }
+    bool IsMegaMode() const { return m_megaScreen.IsEnabled(); }
+
+    // loads count ARGB colors from memory at address into palette entries 1 - count (02NN)
+    void LoadPalette(uint32_t address, int count);
+
+    void SetSpriteSize(int width, int height) { m_megaScreen.SetSpriteSize(width, height); }
+    void SetScreenAlpha(uint8_t alpha) { m_megaScreen.SetScreenAlpha(alpha); }
+    void SetBlendMode(uint8_t mode) { m_megaScreen.SetBlendMode(mode); }
+    void SetCollisionColor(uint8_t index) { m_megaScreen.SetCollisionColor(index); }
+
+    // draws the MEGA-CHIP sprite at I to x, y. Returns true if it hit a pixel of the collision color.
+    // A sprite that runs past the end of memory isn't drawn
+    bool DrawMegaSprite(int x, int y);
 
     bool GetDrawFlag() { return m_draw; }
     void SetDrawFlag(bool flag) { m_draw = flag; }
 
-    void IncrementStackPointer() { m_stackPointer++; }
-    void DecrementStackPointer() { m_stackPointer--; }
+    void IncrementStackPointer() { SetStackPointer(m_stackPointer + 1); }
+    void DecrementStackPointer() { SetStackPointer(m_stackPointer - 1); }
 
     uint16_t GetStackPointer() { return m_stackPointer; }
     uint16_t GetTopOfStack() { return m_stack[m_stackPointer]; }
-    void SetTopOfStack(uint16_t val) { m_stack[m_stackPointer] = val; }
+    void SetTopOfStack(uint16_t val);
 
-    void ClearDisplay() { m_screen = {}; }
+    void ClearDisplay();
 
-    uint8_t GetRandomNumber();
+    const Framebuffer& GetScreen() const { return m_screen; }
+    const MegaFramebuffer& GetMegaScreen() const { return m_megaScreen; }
 
-    // Polls for SDL events. If block is true, the program will halt until an event occurs
-    uint8_t PollEvents(bool block);
+    uint8_t GetRandomNumber();
 
     // Returns true if the given key index maps to a key that is pressed
     bool IsKeyPressed(uint8_t keyIndex);
 
-    void SetDelayTimer(uint8_t val) { m_delayTimer = val; }
+    // returns the state of all 16 keys. Bit n is key n
+    uint16_t GetKeyboardState() const;
+
+    // sets the state of all 16 keys at once. Bit n of keyMask is key n. Used to drive the keypad without SDL
+    void SetKeyboardState(uint16_t keyMask);
+
+    // keys the guest has read with EX9E, EXA1 or FX0A since the last ClearKeysRead. Bit n is key n
+    uint16_t GetKeysRead() const { return m_keysRead; }
+    void ClearKeysRead() { m_keysRead = 0; }
+
+    // presses or releases a single key. Pressing a key resumes a machine that is waiting for a key press
+    void SetKeyState(uint8_t keyIndex, bool pressed);
+
+    // FX0A - suspends execution until the next key press, which is then stored in V[regIndex].
+    // The host keeps running frames and timers in the meantime.
+    void WaitForKeyPress(uint8_t regIndex);
+
+    // true while execution is suspended by FX0A
+    bool IsWaitingForKey() const { return m_waitingForKey; }
+
+    // ends the current frame after this instruction. DXYN does this under QUIRK_DISPLAY_WAIT
+    void WaitForNextFrame() { m_waitingForFrame = true; }
+
+    void SetDelayTimer(uint8_t val);
     uint8_t GetDelayTimer() { return m_delayTimer; }
 
-    void SetBeepTimer(uint8_t val) { m_beepTimer = val; }
+    void SetBeepTimer(uint8_t val);
+    uint8_t GetBeepTimer() const { return m_beepTimer; }
+
+    // SUPER-CHIP RPL user flags, saved and restored by FX75 / FX85
+    uint8_t GetRplFlag(uint8_t flagIndex) const;
+    void SetRplFlag(uint8_t flagIndex, uint8_t val);
+
+    // XO-CHIP audio. F002 loads the 16 byte pattern at address, FX3A sets the pitch it plays at
+    void LoadAudioPattern(uint32_t address);
+    void SetPitch(uint8_t val);
+    uint8_t GetPitch() const { return m_pitch; }
+
+    // MEGA-CHIP digitized sound. 060N plays the sound at address, looping it if loop is set, 0700 stops it.
+    // The sound is a 2 byte sample rate and a 3 byte sample count followed by 8-bit samples, and has to be part of the rom
+    void PlayDigitizedSound(uint32_t address, bool loop);
+    void StopDigitizedSound();
+
+    // true while the sound timer runs or digitized sound plays
+    bool IsSoundOn() const { return m_beepTimer > 0 || m_soundPlaying; }
+
+    // what the sound sounds like right now
+    ToneVoice GetToneVoice() const;
+
+    // returns a 64-bit hash of the full machine state (memory, registers, I, PC, stack, timers and screen).
+    // The hash is updated on every write, so reading it is O(1). Equal states always have equal hashes.
+    uint64_t GetStateHash() const { return m_stateHash ^ GetScreenHash(); }
+
+    // returns the part of the state hash that covers the screen
+    uint64_t GetScreenHash() const { return m_screen.GetHash() ^ m_megaScreen.GetHash(); }
+
+    // copies the machine state into state / restores it. Cheap enough to run every frame
+    void SaveState(Chip8State& state) const;
+    void LoadState(const Chip8State& state);
+
+    // recomputes the state hash from scratch. Slow - only useful to verify the incremental hash
+    uint64_t ComputeStateHash() const;
 
 private:
-    // renders screen based on internal pixel array
-    void RenderScreen(SDL_Surface* surface, SDL_Window* window) const;
+    void SetStackPointer(uint16_t val);
+
+    // applies a write of a slot from oldVal to newVal to the state hash
+    void UpdateStateHash(uint32_t slot, uint32_t oldVal, uint32_t newVal) { m_stateHash ^= StateHash::Delta(slot, oldVal, newVal); }
+
+    // value of the digitized sound's hash slot: the address, whether it loops and whether it plays
+    uint32_t GetSoundStreamSlotValue() const { return m_soundPlaying ? m_soundAddress << 2 | (m_soundLoop ? 2 : 0) | 1 : 0; }
+
+    // points the opcodes of every quirky instruction at the handlers compiled with Quirks
+    template <unsigned Quirks>
+    void InstallQuirkHandlers();
+
+    // runs the superinstruction starting at the program counter if there is one and it fits in budget instructions,
+    // and the instruction there otherwise. Returns the number of instructions run
+    int Step(int budget);
+
+    // which superinstruction starts at address, going by the opcodes in memory now
+    Superinstruction PredecodeSuperinstruction(uint16_t address) const;
+
+    // forgets what was predecoded for the bytes from first up to last. Called whenever they're written
+    void InvalidateSuperinstructions(size_t first, size_t last);
+
+    // rebuilds the control flow graph of the program in memory, then finds the dead VF writes in it again
+    void BuildFlagGraph();
+    void UpdateDeadFlagWrites();
+
+    // Tick for an instruction whose VF write is dead. Runs the handler that leaves VF alone
+    void TickWithoutFlag();
+
+    // emulation thread of Run(). Runs 60hz frames paced by the wall clock and publishes each one to frames.
+    // speculator is null unless speculation is enabled, synth is null if there's no audio device
+    // and vsyncClock is null unless the display paces emulation
+    void EmulationLoop(KeypadInput& input, TripleBuffer<Frame>& frames, KeypadSpeculator* speculator, ToneSynth* synth, FrameClock* vsyncClock);
+
+    // uploads a published frame to texture and presents it. Blocks until the next refresh if the renderer has vsync
+    void RenderScreen(const Frame& frame, SDL_Renderer* renderer, SDL_Texture* texture) const;
 
-    // true while emulation is active
-    bool m_active;
+    // true while emulation is active. Cleared by either thread of Run()
+    std::atomic<bool> m_active;
 
     // opcode that we're currently executing
     uint16_t  m_currentOpcode;
 
-    // chip8 has 4K of memmory
-    std::array<uint8_t, 4096> m_memory;
+    // chip8 has 4K of memmory and XO-CHIP 64K, both kept in m_fixedMemory. MEGA-CHIP's 16M are allocated in
+    // m_megaMemory instead. m_memory points at the m_memorySize bytes the machine has
+    std::array<uint8_t, MAX_MEMORY_SIZE> m_fixedMemory;
+    std::vector<uint8_t> m_megaMemory;
+    uint8_t* m_memory;
+    uint32_t m_memorySize;
+
+    // bytes up to the last one ever written. Everything past it is zero
+    size_t m_memoryUsed;
+
+    MachineType m_machine;
+    QuirkProfile m_quirkProfile;
 
     // 15 registers (0-14). V[15] is the carry flag
     std::array<uint8_t, 16> m_V;
 
     // index register
-    uint16_t m_I;
+    uint32_t m_I;
 
     // program counter
     uint16_t m_PC;
 
-    // 64px x 32px pixel screen - 2048 pixels total
-    std::array<uint8_t, 64 * 32> m_screen;
+    // size of the loaded rom in bytes
+    int m_romSize;
+
+    // the rom as loaded, for the audio thread to play digitized sound from
+    std::vector<uint8_t> m_rom;
+
+    // RomDatabase entry of the rom, looked up by LoadGame
+    uint64_t m_romHash;
+    bool m_romKnown;
+    RomInfo m_romInfo;
+    MachineType m_romMachine;
+
+    // 64px x 32px pixel screen, or 128px x 64px in SUPER-CHIP high resolution mode. Hashes itself
+    Framebuffer m_screen;
+
+    // MEGA-CHIP 256x192 screen, palette and sprite settings. Hashes itself
+    MegaFramebuffer m_megaScreen;
+
+    // packed rows of the sprites drawn lately. Kept up to date by every write to memory
+    SpriteCache m_spriteCache;
 
     // 60hz timer
     uint8_t m_delayTimer;
@@ -109,23 +471,89 @@ private:
     std::array<uint16_t, 64> m_stack;
     uint16_t m_stackPointer;
 
+    // SUPER-CHIP RPL user flags
+    std::array<uint8_t, 16> m_rplFlags;
+
+    // XO-CHIP audio pattern, whether F002 has loaded one yet, and the pitch it plays at
+    std::array<uint8_t, 16> m_audioPattern;
+    bool m_audioPatternLoaded;
+    uint8_t m_pitch;
+
+    // MEGA-CHIP digitized sound and the number of times 060N has started one
+    uint32_t m_soundAddress;
+    bool m_soundLoop;
+    bool m_soundPlaying;
+    uint32_t m_soundTrigger;
+
+    // incrementally updated Zobrist hash of everything but the screen
+    uint64_t m_stateHash;
+
     // flag is set when the screen needs to be updated
     bool m_draw;
 
     // true if key is pressed, false otherwise
     std::array<volatile bool, 16> m_keyboard;
 
+    // keys read by the guest since the last ClearKeysRead
+    uint16_t m_keysRead;
+
+    // set by FX0A. Tick does nothing until a key is pressed, which is then stored in V[m_keyWaitRegister]
+    bool m_waitingForKey;
+    uint8_t m_keyWaitRegister;
+
+    // set by WaitForNextFrame. RunFrame stops there and clears it for the next frame
+    bool m_waitingForFrame;
+
     // maps opcodes to functions that handle them
     std::unordered_map<uint16_t, std::function<void(uint16_t opc, Chip8* chip8)>> m_instructionTable;
 
-    // represents 1 chip8 pixel
-    SDL_Surface* m_pixel;
+    // the superinstruction starting at each address PC can reach, predecoded the first time it's reached
+    std::vector<Superinstruction> m_superinstructions;
+
+    // handler of each kind of superinstruction. SUPER_DRAW changes with the quirk profile
+    using SuperinstructionHandler = int (*)(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8);
+    std::array<SuperinstructionHandler, SUPERINSTRUCTION_KINDS> m_superinstructionHandlers;
+
+    bool m_superinstructionsEnabled;
+    std::array<uint64_t, SUPERINSTRUCTION_KINDS> m_superinstructionCounts;
+    uint64_t m_fusedInstructions;
+
+    // the program's control flow graph from FIRST_MEMORY_LOCATION, and whether the instruction at each address
+    // has a dead VF write. Rebuilt when code is written
+    ControlFlowGraph m_flagGraph;
+    std::vector<uint8_t> m_deadFlagWrites;
+    int m_deadFlagWriteCount;
+
+    // handlers that leave VF alone for 8XYN, indexed by N, for DXYN and for the DXYN of ANNN DXYN.
+    // Shifts and both draws change with the quirk profile
+    using InstructionHandler = void (*)(uint16_t opc, Chip8* chip8);
+    std::array<InstructionHandler, 16> m_flaglessArithmetic;
+    InstructionHandler m_flaglessDraw;
+    SuperinstructionHandler m_flaglessSuperDraw;
+
+    bool m_lazyFlags;
+    bool m_flagChecking;
+
+    // while checking flags, the address of the last VF write taken to be dead if VF still holds it, and -1 otherwise
+    int m_deadFlagAddress;
+    mutable uint64_t m_flagCheckFailures;
 
-    // SDL events for keypresses
-    SDL_Event m_event;
+    // tick rate of the main chip8 cpu in hz. MEGA-CHIP roms run at well over 65535
+    uint32_t m_tickrate;
 
-    // tick rate of the main chip8 cpu in hz
-    uint16_t m_tickrate;
+    // frames Run() emulates ahead of the real machine
+    int m_runAheadFrames;
+
+    // key presses Run() speculates on per frame
+    int m_speculationBranches;
+
+    PacingMode m_pacing;
+
+    bool m_idleSkipping;
+    uint64_t m_idleInstructions;
+
+    // random numbers drawn so far. The generator's state isn't hashed, so loops that use it are never skipped
+    uint32_t m_randomDraws;
 
     // objects for random number generation
     std::mt19937 m_mersenneTwister;
@@ -151,5 +579,24 @@ private:
       0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
 
-    const std::unordered_map<SDL_Keycode, uint8_t> m_keymap;
+    // SUPER-CHIP 8x10 digits for FX30
+    const std::array<unsigned char, 160> bigFontset =
+    {
+      0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+      0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+      0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+      0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+      0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+      0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+      0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+      0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+      0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+      0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+      0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+      0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+      0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+    };
 };
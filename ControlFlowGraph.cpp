@@ -0,0 +1,177 @@
+#include <algorithm>
+#include "ControlFlowGraph.h"
+
+ControlFlowGraph::ControlFlowGraph() :
+    m_image(nullptr),
+    m_size(0),
+    m_base(0),
+    m_entry(0)
+{
+}
+
+void ControlFlowGraph::Build(const uint8_t* image, uint32_t size, uint32_t base, uint32_t entry)
+{
+    m_image = image;
+    m_size = size;
+    m_base = base;
+    m_entry = entry;
+    Rebuild();
+}
+
+bool ControlFlowGraph::OnWrite(uint32_t address)
+{
+    if (!IsCode(address))
+        return false;
+
+    // the write landed in one of the (at most 4) bytes of an instruction. Rebuild only if it decodes differently now
+    auto instruction = std::upper_bound(m_instructions.begin(), m_instructions.end(), address,
+        [](uint32_t a, const DecodedInstruction& i) { return a < i.address; });
+    if (instruction != m_instructions.begin())
+    {
+        --instruction;
+        DecodedInstruction decoded;
+        if (address < instruction->address + instruction->length
+            && Disassembler::Decode(m_image, m_size, m_base, instruction->address, decoded)
+            && decoded.opcode == instruction->opcode && decoded.length == instruction->length && decoded.target == instruction->target)
+            return false;
+    }
+
+    Rebuild();
+    return true;
+}
+
+bool ControlFlowGraph::IsCode(uint32_t address) const
+{
+    return Contains(address) && (m_flags[address - m_base] & BYTE_CODE) != 0;
+}
+
+const BasicBlock* ControlFlowGraph::FindBlock(uint32_t address) const
+{
+    auto block = std::lower_bound(m_blocks.begin(), m_blocks.end(), address,
+        [](const BasicBlock& b, uint32_t a) { return b.start < a; });
+    return block != m_blocks.end() && block->start == address ? &*block : nullptr;
+}
+
+void ControlFlowGraph::Rebuild()
+{
+    m_flags.assign(m_size, 0);
+    m_instructions.clear();
+    m_blocks.clear();
+    m_calls.clear();
+
+    auto markLeader = [this](uint32_t address)
+    {
+        if (Contains(address))
+            m_flags[address - m_base] |= BYTE_LEADER;
+    };
+
+    // depth first from the entry point, following the straight-line code from each address and queueing the
+    // other side of every branch. Each instruction is decoded once, however many paths lead to it
+    std::vector<uint32_t> pending;
+    pending.push_back(m_entry);
+    markLeader(m_entry);
+
+    while (!pending.empty())
+    {
+        uint32_t address = pending.back();
+        pending.pop_back();
+
+        DecodedInstruction instruction;
+        while (Contains(address) && (m_flags[address - m_base] & BYTE_INSTRUCTION_START) == 0
+            && Disassembler::Decode(m_image, m_size, m_base, address, instruction) && instruction.operation != OP_INVALID)
+        {
+            m_flags[address - m_base] |= BYTE_INSTRUCTION_START;
+            for (uint32_t i = 0; i < instruction.length; ++i)
+                m_flags[address - m_base + i] |= BYTE_CODE;
+            m_instructions.push_back(instruction);
+
+            const uint32_t next = address + instruction.length;
+            if (instruction.flow == FLOW_JUMP)
+            {
+                markLeader(instruction.target);
+                pending.push_back(instruction.target);
+                break;
+            }
+            else if (instruction.flow == FLOW_CALL)
+            {
+                markLeader(instruction.target);
+                markLeader(next);
+                pending.push_back(instruction.target);
+                m_calls.push_back({ address, instruction.target });
+            }
+            else if (instruction.flow == FLOW_SKIP)
+            {
+                markLeader(next);
+                markLeader(instruction.target);
+                pending.push_back(instruction.target);
+            }
+            else if (instruction.flow != FLOW_NEXT)
+                break;
+
+            address = next;
+        }
+    }
+
+    std::sort(m_instructions.begin(), m_instructions.end(),
+        [](const DecodedInstruction& a, const DecodedInstruction& b) { return a.address < b.address; });
+
+    std::vector<uint32_t> callTargets;
+    for (const CallEdge& call : m_calls)
+        callTargets.push_back(call.target);
+    std::sort(callTargets.begin(), callTargets.end());
+
+    // a block runs until an instruction that branches, a gap, or the next leader
+    for (int i = 0; i < (int)m_instructions.size(); ++i)
+    {
+        const DecodedInstruction& instruction = m_instructions[i];
+        const bool startsBlock = m_blocks.empty() || (m_flags[instruction.address - m_base] & BYTE_LEADER) != 0
+            || m_blocks.back().end != instruction.address || m_instructions[i - 1].flow != FLOW_NEXT;
+
+        if (startsBlock)
+        {
+            BasicBlock block;
+            block.start = instruction.address;
+            block.end = instruction.address;
+            block.firstInstruction = i;
+            block.lastInstruction = i;
+            block.successorCount = 0;
+            block.unresolved = false;
+            block.subroutine = std::binary_search(callTargets.begin(), callTargets.end(), instruction.address);
+            m_blocks.push_back(block);
+        }
+
+        m_blocks.back().end = instruction.address + instruction.length;
+        m_blocks.back().lastInstruction = i + 1;
+    }
+
+    // edges into data (a jump outside the image, or onto bytes that don't decode) are dropped
+    auto addSuccessor = [this](BasicBlock& block, uint32_t address)
+    {
+        if (Contains(address) && (m_flags[address - m_base] & BYTE_INSTRUCTION_START) != 0)
+            block.successors[block.successorCount++] = address;
+    };
+
+    for (BasicBlock& block : m_blocks)
+    {
+        const DecodedInstruction& last = m_instructions[block.lastInstruction - 1];
+        switch (last.flow)
+        {
+            case FLOW_NEXT:
+                addSuccessor(block, block.end);
+                break;
+            case FLOW_JUMP:
+                addSuccessor(block, last.target);
+                break;
+            case FLOW_CALL:
+            case FLOW_SKIP:
+                addSuccessor(block, last.target);
+                addSuccessor(block, block.end);
+                break;
+            case FLOW_INDIRECT:
+                block.unresolved = true;
+                break;
+            default:
+                break;
+        }
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "Disassembler.h"
+
+// a straight run of instructions that is only entered at the top and only left at the bottom
+struct BasicBlock
+{
+    // address of the first instruction, and the address just past the last one
+    uint32_t start;
+    uint32_t end;
+
+    // first and one past the last of the block's instructions in ControlFlowGraph::GetInstructions
+    int firstInstruction;
+    int lastInstruction;
+
+    // addresses of the blocks execution can continue in. A call's successors are the subroutine and the return site
+    uint32_t successors[2];
+    int successorCount;
+
+    // ends in BNNN, whose target isn't known. Code reached only that way isn't in the graph
+    bool unresolved;
+
+    // entered by a 2NNN
+    bool subroutine;
+};
+
+// a 2NNN and the subroutine it calls
+struct CallEdge
+{
+    uint32_t site;
+    uint32_t target;
+};
+
+// The control flow graph of a chip8 program: every instruction reachable from the entry point through jumps,
+// calls, returns and skips, split into basic blocks, plus the call graph. Whatever isn't reached is data.
+// Built once over a memory image, then kept up to date cheaply when the program writes to itself: writes to data
+// cost one lookup, and only writes that change decoded code rebuild the graph.
+class ControlFlowGraph
+{
+public:
+    ControlFlowGraph();
+
+    // decodes the program in image, a memory image of size bytes that starts at address base, from entry.
+    // The image must stay valid while the graph is used
+    void Build(const uint8_t* image, uint32_t size, uint32_t base, uint32_t entry);
+
+    // call after the program wrote to address of the image. returns true if that changed code and the graph was
+    // rebuilt, which invalidates everything handed out before
+    bool OnWrite(uint32_t address);
+
+    // true if the byte at address belongs to a reachable instruction
+    bool IsCode(uint32_t address) const;
+
+    // the block starting at address, or null
+    const BasicBlock* FindBlock(uint32_t address) const;
+
+    // reachable instructions in address order
+    const std::vector<DecodedInstruction>& GetInstructions() const { return m_instructions; }
+
+    // blocks in address order
+    const std::vector<BasicBlock>& GetBlocks() const { return m_blocks; }
+
+    const std::vector<CallEdge>& GetCalls() const { return m_calls; }
+
+private:
+    // byte is the first byte of an instruction / belongs to an instruction / starts a block
+    enum ByteFlags : uint8_t
+    {
+        BYTE_INSTRUCTION_START = 0x1,
+        BYTE_CODE = 0x2,
+        BYTE_LEADER = 0x4,
+    };
+
+    void Rebuild();
+
+    // whether an address is inside the image
+    bool Contains(uint32_t address) const { return address >= m_base && address - m_base < m_size; }
+
+    const uint8_t* m_image;
+    uint32_t m_size;
+    uint32_t m_base;
+    uint32_t m_entry;
+
+    // ByteFlags of every byte of the image
+    std::vector<uint8_t> m_flags;
+
+    std::vector<DecodedInstruction> m_instructions;
+    std::vector<BasicBlock> m_blocks;
+    std::vector<CallEdge> m_calls;
+};
@@ -0,0 +1,346 @@
+#include <cstdio>
+#include "Disassembler.h"
+
+namespace
+{
+    // decodes the 0NNN range: the display instructions, SUPER-CHIP, XO-CHIP scrolling and all of MEGA-CHIP
+    void DecodeSystem(DecodedInstruction& instruction)
+    {
+        const uint16_t opc = instruction.opcode;
+        instruction.set = SET_SUPERCHIP;
+
+        if (opc == 0x00E0)
+        {
+            instruction.operation = OP_CLEAR;
+            instruction.set = SET_CHIP8;
+        }
+        else if (opc == 0x00EE)
+        {
+            instruction.operation = OP_RETURN;
+            instruction.set = SET_CHIP8;
+            instruction.flow = FLOW_RETURN;
+        }
+        else if ((opc & 0xFFF0) == 0x00C0)
+            instruction.operation = OP_SCROLL_DOWN;
+        else if (opc == 0x00FB)
+            instruction.operation = OP_SCROLL_RIGHT;
+        else if (opc == 0x00FC)
+            instruction.operation = OP_SCROLL_LEFT;
+        else if (opc == 0x00FD)
+        {
+            instruction.operation = OP_EXIT;
+            instruction.flow = FLOW_STOP;
+        }
+        else if (opc == 0x00FE)
+            instruction.operation = OP_LOW_RES;
+        else if (opc == 0x00FF)
+            instruction.operation = OP_HIGH_RES;
+        else if ((opc & 0xFFF0) == 0x00D0)
+        {
+            instruction.operation = OP_SCROLL_UP;
+            instruction.set = SET_XOCHIP;
+        }
+        else
+        {
+            instruction.set = SET_MEGACHIP;
+            if ((opc & 0xFFF0) == 0x00B0)
+                instruction.operation = OP_SCROLL_UP;
+            else if (opc == 0x0010)
+                instruction.operation = OP_MEGA_OFF;
+            else if (opc == 0x0011)
+                instruction.operation = OP_MEGA_ON;
+            else if ((opc & 0xFF00) == 0x0200)
+                instruction.operation = OP_LOAD_PALETTE;
+            else if ((opc & 0xFF00) == 0x0300)
+                instruction.operation = OP_SPRITE_WIDTH;
+            else if ((opc & 0xFF00) == 0x0400)
+                instruction.operation = OP_SPRITE_HEIGHT;
+            else if ((opc & 0xFF00) == 0x0500)
+                instruction.operation = OP_SCREEN_ALPHA;
+            else if ((opc & 0xFFF0) == 0x0600)
+                instruction.operation = OP_PLAY_SOUND;
+            else if (opc == 0x0700)
+                instruction.operation = OP_STOP_SOUND;
+            else if ((opc & 0xFFF0) == 0x0800)
+                instruction.operation = OP_BLEND_MODE;
+            else if ((opc & 0xFF00) == 0x0900)
+                instruction.operation = OP_COLLISION_COLOR;
+        }
+    }
+
+    void DecodeArithmetic(DecodedInstruction& instruction)
+    {
+        static const Operation operations[16] =
+        {
+            OP_LOAD_REG, OP_OR, OP_AND, OP_XOR, OP_ADD, OP_SUB, OP_SHIFT_RIGHT, OP_SUB_INVERSE,
+            OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID, OP_SHIFT_LEFT, OP_INVALID,
+        };
+
+        instruction.operation = operations[instruction.n];
+    }
+
+    void DecodeMisc(DecodedInstruction& instruction)
+    {
+        switch (instruction.nn)
+        {
+            case 0x00:
+                if (instruction.x == 0)
+                {
+                    instruction.operation = OP_LOAD_LONG_INDEX;
+                    instruction.set = SET_XOCHIP;
+                }
+                break;
+            case 0x01:
+                instruction.operation = OP_SELECT_PLANES;
+                instruction.set = SET_XOCHIP;
+                break;
+            case 0x02:
+                if (instruction.x == 0)
+                {
+                    instruction.operation = OP_LOAD_AUDIO_PATTERN;
+                    instruction.set = SET_XOCHIP;
+                }
+                break;
+            case 0x07: instruction.operation = OP_GET_DELAY; break;
+            case 0x0A: instruction.operation = OP_WAIT_KEY; break;
+            case 0x15: instruction.operation = OP_SET_DELAY; break;
+            case 0x18: instruction.operation = OP_SET_BEEP; break;
+            case 0x1E: instruction.operation = OP_ADD_INDEX; break;
+            case 0x29: instruction.operation = OP_FONT; break;
+            case 0x33: instruction.operation = OP_BCD; break;
+            case 0x55: instruction.operation = OP_STORE_REGS; break;
+            case 0x65: instruction.operation = OP_LOAD_REGS; break;
+            case 0x30:
+                instruction.operation = OP_BIG_FONT;
+                instruction.set = SET_SUPERCHIP;
+                break;
+            case 0x75:
+                instruction.operation = OP_STORE_RPL;
+                instruction.set = SET_SUPERCHIP;
+                break;
+            case 0x85:
+                instruction.operation = OP_LOAD_RPL;
+                instruction.set = SET_SUPERCHIP;
+                break;
+            case 0x3A:
+                instruction.operation = OP_SET_PITCH;
+                instruction.set = SET_XOCHIP;
+                break;
+        }
+    }
+}
+
+bool Disassembler::Decode(const uint8_t* image, uint32_t size, uint32_t base, uint32_t address, DecodedInstruction& instruction)
+{
+    if (address < base || address - base + 2 > size)
+        return false;
+
+    const uint8_t* bytes = image + (address - base);
+    const uint16_t opc = (uint16_t)(bytes[0] << 8 | bytes[1]);
+
+    instruction = {};
+    instruction.address = address;
+    instruction.opcode = opc;
+    instruction.length = 2;
+    instruction.operation = OP_INVALID;
+    instruction.set = SET_CHIP8;
+    instruction.flow = FLOW_NEXT;
+    instruction.x = (opc & 0x0F00) >> 8;
+    instruction.y = (opc & 0x00F0) >> 4;
+    instruction.n = opc & 0x000F;
+    instruction.nn = opc & 0x00FF;
+    instruction.nnn = opc & 0x0FFF;
+
+    switch (opc >> 12)
+    {
+        case 0x0:
+            DecodeSystem(instruction);
+            break;
+        case 0x1:
+            instruction.operation = OP_JUMP;
+            instruction.flow = FLOW_JUMP;
+            instruction.target = instruction.nnn;
+            break;
+        case 0x2:
+            instruction.operation = OP_CALL;
+            instruction.flow = FLOW_CALL;
+            instruction.target = instruction.nnn;
+            break;
+        case 0x3:
+            instruction.operation = OP_SKIP_EQ_CONST;
+            break;
+        case 0x4:
+            instruction.operation = OP_SKIP_NE_CONST;
+            break;
+        case 0x5:
+            if (instruction.n == 0x0)
+                instruction.operation = OP_SKIP_EQ_REG;
+            else if (instruction.n == 0x2 || instruction.n == 0x3)
+            {
+                instruction.operation = instruction.n == 0x2 ? OP_SAVE_RANGE : OP_LOAD_RANGE;
+                instruction.set = SET_XOCHIP;
+            }
+            break;
+        case 0x6:
+            instruction.operation = OP_LOAD_CONST;
+            break;
+        case 0x7:
+            instruction.operation = OP_ADD_CONST;
+            break;
+        case 0x8:
+            DecodeArithmetic(instruction);
+            break;
+        case 0x9:
+            if (instruction.n == 0x0)
+                instruction.operation = OP_SKIP_NE_REG;
+            break;
+        case 0xA:
+            instruction.operation = OP_SET_INDEX;
+            instruction.target = instruction.nnn;
+            break;
+        case 0xB:
+            instruction.operation = OP_JUMP_OFFSET;
+            instruction.flow = FLOW_INDIRECT;
+            break;
+        case 0xC:
+            instruction.operation = OP_RANDOM;
+            break;
+        case 0xD:
+            instruction.operation = OP_DRAW;
+            if (instruction.n == 0)
+                instruction.set = SET_SUPERCHIP;
+            break;
+        case 0xE:
+            if (instruction.nn == 0x9E)
+                instruction.operation = OP_SKIP_KEY;
+            else if (instruction.nn == 0xA1)
+                instruction.operation = OP_SKIP_NOT_KEY;
+            break;
+        case 0xF:
+            DecodeMisc(instruction);
+            break;
+    }
+
+    // F000 NNNN and 01NN NNNN carry a 16-bit address in a second word
+    if (instruction.operation == OP_LOAD_LONG_INDEX || (opc & 0xFF00) == 0x0100)
+    {
+        if (address - base + 4 > size)
+            return false;
+
+        instruction.length = 4;
+        instruction.target = (uint32_t)(bytes[2] << 8 | bytes[3]);
+        if (opc != 0xF000)
+        {
+            instruction.operation = OP_LOAD_MEGA_INDEX;
+            instruction.set = SET_MEGACHIP;
+            instruction.target |= (uint32_t)instruction.nn << 16;
+        }
+    }
+
+    switch (instruction.operation)
+    {
+        case OP_SKIP_EQ_CONST:
+        case OP_SKIP_NE_CONST:
+        case OP_SKIP_EQ_REG:
+        case OP_SKIP_NE_REG:
+        case OP_SKIP_KEY:
+        case OP_SKIP_NOT_KEY:
+        {
+            // the skipped instruction may be a long one
+            instruction.flow = FLOW_SKIP;
+            const uint32_t next = address + 2;
+            bool longNext = false;
+            if (next - base + 2 <= size)
+            {
+                const uint16_t nextOpc = (uint16_t)(bytes[2] << 8 | bytes[3]);
+                longNext = nextOpc == 0xF000 || (nextOpc & 0xFF00) == 0x0100;
+            }
+            instruction.target = next + (longNext ? 4 : 2);
+            break;
+        }
+        case OP_INVALID:
+            instruction.flow = FLOW_STOP;
+            break;
+        default:
+            break;
+    }
+
+    return true;
+}
+
+std::string Disassembler::Format(const DecodedInstruction& instruction)
+{
+    const int x = instruction.x;
+    const int y = instruction.y;
+    const int n = instruction.n;
+    const int nn = instruction.nn;
+
+    char text[48];
+    switch (instruction.operation)
+    {
+        case OP_CLEAR:              snprintf(text, sizeof(text), "cls"); break;
+        case OP_RETURN:             snprintf(text, sizeof(text), "ret"); break;
+        case OP_SCROLL_DOWN:        snprintf(text, sizeof(text), "scd %d", n); break;
+        case OP_SCROLL_UP:          snprintf(text, sizeof(text), "scu %d", n); break;
+        case OP_SCROLL_RIGHT:       snprintf(text, sizeof(text), "scr"); break;
+        case OP_SCROLL_LEFT:        snprintf(text, sizeof(text), "scl"); break;
+        case OP_EXIT:               snprintf(text, sizeof(text), "exit"); break;
+        case OP_LOW_RES:            snprintf(text, sizeof(text), "low"); break;
+        case OP_HIGH_RES:           snprintf(text, sizeof(text), "high"); break;
+        case OP_MEGA_OFF:           snprintf(text, sizeof(text), "megaoff"); break;
+        case OP_MEGA_ON:            snprintf(text, sizeof(text), "megaon"); break;
+        case OP_LOAD_MEGA_INDEX:    snprintf(text, sizeof(text), "ldhi i, 0x%06X", instruction.target); break;
+        case OP_LOAD_PALETTE:       snprintf(text, sizeof(text), "ldpal %d", nn); break;
+        case OP_SPRITE_WIDTH:       snprintf(text, sizeof(text), "sprw %d", nn); break;
+        case OP_SPRITE_HEIGHT:      snprintf(text, sizeof(text), "sprh %d", nn); break;
+        case OP_SCREEN_ALPHA:       snprintf(text, sizeof(text), "alpha %d", nn); break;
+        case OP_PLAY_SOUND:         snprintf(text, sizeof(text), "digisnd %d", n); break;
+        case OP_STOP_SOUND:         snprintf(text, sizeof(text), "stopsnd"); break;
+        case OP_BLEND_MODE:         snprintf(text, sizeof(text), "bmode %d", n); break;
+        case OP_COLLISION_COLOR:    snprintf(text, sizeof(text), "ccol %d", nn); break;
+        case OP_JUMP:               snprintf(text, sizeof(text), "jp 0x%03X", instruction.target); break;
+        case OP_CALL:               snprintf(text, sizeof(text), "call 0x%03X", instruction.target); break;
+        case OP_SKIP_EQ_CONST:      snprintf(text, sizeof(text), "se v%X, 0x%02X", x, nn); break;
+        case OP_SKIP_NE_CONST:      snprintf(text, sizeof(text), "sne v%X, 0x%02X", x, nn); break;
+        case OP_SKIP_EQ_REG:        snprintf(text, sizeof(text), "se v%X, v%X", x, y); break;
+        case OP_SAVE_RANGE:         snprintf(text, sizeof(text), "save v%X - v%X", x, y); break;
+        case OP_LOAD_RANGE:         snprintf(text, sizeof(text), "load v%X - v%X", x, y); break;
+        case OP_LOAD_CONST:         snprintf(text, sizeof(text), "ld v%X, 0x%02X", x, nn); break;
+        case OP_ADD_CONST:          snprintf(text, sizeof(text), "add v%X, 0x%02X", x, nn); break;
+        case OP_LOAD_REG:           snprintf(text, sizeof(text), "ld v%X, v%X", x, y); break;
+        case OP_OR:                 snprintf(text, sizeof(text), "or v%X, v%X", x, y); break;
+        case OP_AND:                snprintf(text, sizeof(text), "and v%X, v%X", x, y); break;
+        case OP_XOR:                snprintf(text, sizeof(text), "xor v%X, v%X", x, y); break;
+        case OP_ADD:                snprintf(text, sizeof(text), "add v%X, v%X", x, y); break;
+        case OP_SUB:                snprintf(text, sizeof(text), "sub v%X, v%X", x, y); break;
+        case OP_SHIFT_RIGHT:        snprintf(text, sizeof(text), "shr v%X, v%X", x, y); break;
+        case OP_SUB_INVERSE:        snprintf(text, sizeof(text), "subn v%X, v%X", x, y); break;
+        case OP_SHIFT_LEFT:         snprintf(text, sizeof(text), "shl v%X, v%X", x, y); break;
+        case OP_SKIP_NE_REG:        snprintf(text, sizeof(text), "sne v%X, v%X", x, y); break;
+        case OP_SET_INDEX:          snprintf(text, sizeof(text), "ld i, 0x%03X", instruction.target); break;
+        case OP_JUMP_OFFSET:        snprintf(text, sizeof(text), "jp v0, 0x%03X", instruction.nnn); break;
+        case OP_RANDOM:             snprintf(text, sizeof(text), "rnd v%X, 0x%02X", x, nn); break;
+        case OP_DRAW:               snprintf(text, sizeof(text), "drw v%X, v%X, %d", x, y, n); break;
+        case OP_SKIP_KEY:           snprintf(text, sizeof(text), "skp v%X", x); break;
+        case OP_SKIP_NOT_KEY:       snprintf(text, sizeof(text), "sknp v%X", x); break;
+        case OP_LOAD_LONG_INDEX:    snprintf(text, sizeof(text), "ld i, long 0x%04X", instruction.target); break;
+        case OP_SELECT_PLANES:      snprintf(text, sizeof(text), "plane %d", x); break;
+        case OP_LOAD_AUDIO_PATTERN: snprintf(text, sizeof(text), "audio"); break;
+        case OP_GET_DELAY:          snprintf(text, sizeof(text), "ld v%X, dt", x); break;
+        case OP_WAIT_KEY:           snprintf(text, sizeof(text), "ld v%X, k", x); break;
+        case OP_SET_DELAY:          snprintf(text, sizeof(text), "ld dt, v%X", x); break;
+        case OP_SET_BEEP:           snprintf(text, sizeof(text), "ld st, v%X", x); break;
+        case OP_ADD_INDEX:          snprintf(text, sizeof(text), "add i, v%X", x); break;
+        case OP_FONT:               snprintf(text, sizeof(text), "ld f, v%X", x); break;
+        case OP_BIG_FONT:           snprintf(text, sizeof(text), "ld hf, v%X", x); break;
+        case OP_BCD:                snprintf(text, sizeof(text), "ld b, v%X", x); break;
+        case OP_SET_PITCH:          snprintf(text, sizeof(text), "pitch v%X", x); break;
+        case OP_STORE_REGS:         snprintf(text, sizeof(text), "ld [i], v%X", x); break;
+        case OP_LOAD_REGS:          snprintf(text, sizeof(text), "ld v%X, [i]", x); break;
+        case OP_STORE_RPL:          snprintf(text, sizeof(text), "ld r, v%X", x); break;
+        case OP_LOAD_RPL:           snprintf(text, sizeof(text), "ld v%X, r", x); break;
+        default:                    snprintf(text, sizeof(text), "db 0x%02X, 0x%02X", instruction.opcode >> 8, instruction.opcode & 0xFF); break;
+    }
+
+    return text;
+}
@@ -0,0 +1,127 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+// every instruction of every supported machine
+enum Operation : uint8_t
+{
+    OP_INVALID,                 // doesn't decode, or 0NNN machine code. Treated as data
+    OP_CLEAR,                   // 00E0
+    OP_RETURN,                  // 00EE
+    OP_SCROLL_DOWN,             // 00CN
+    OP_SCROLL_UP,               // 00DN (XO-CHIP) or 00BN (MEGA-CHIP)
+    OP_SCROLL_RIGHT,            // 00FB
+    OP_SCROLL_LEFT,             // 00FC
+    OP_EXIT,                    // 00FD
+    OP_LOW_RES,                 // 00FE
+    OP_HIGH_RES,                // 00FF
+    OP_MEGA_OFF,                // 0010
+    OP_MEGA_ON,                 // 0011
+    OP_LOAD_MEGA_INDEX,         // 01NN NNNN
+    OP_LOAD_PALETTE,            // 02NN
+    OP_SPRITE_WIDTH,            // 03NN
+    OP_SPRITE_HEIGHT,           // 04NN
+    OP_SCREEN_ALPHA,            // 05NN
+    OP_PLAY_SOUND,              // 060N
+    OP_STOP_SOUND,              // 0700
+    OP_BLEND_MODE,              // 080N
+    OP_COLLISION_COLOR,         // 09NN
+    OP_JUMP,                    // 1NNN
+    OP_CALL,                    // 2NNN
+    OP_SKIP_EQ_CONST,           // 3XNN
+    OP_SKIP_NE_CONST,           // 4XNN
+    OP_SKIP_EQ_REG,             // 5XY0
+    OP_SAVE_RANGE,              // 5XY2
+    OP_LOAD_RANGE,              // 5XY3
+    OP_LOAD_CONST,              // 6XNN
+    OP_ADD_CONST,               // 7XNN
+    OP_LOAD_REG,                // 8XY0
+    OP_OR,                      // 8XY1
+    OP_AND,                     // 8XY2
+    OP_XOR,                     // 8XY3
+    OP_ADD,                     // 8XY4
+    OP_SUB,                     // 8XY5
+    OP_SHIFT_RIGHT,             // 8XY6
+    OP_SUB_INVERSE,             // 8XY7
+    OP_SHIFT_LEFT,              // 8XYE
+    OP_SKIP_NE_REG,             // 9XY0
+    OP_SET_INDEX,               // ANNN
+    OP_JUMP_OFFSET,             // BNNN
+    OP_RANDOM,                  // CXNN
+    OP_DRAW,                    // DXYN
+    OP_SKIP_KEY,                // EX9E
+    OP_SKIP_NOT_KEY,            // EXA1
+    OP_LOAD_LONG_INDEX,         // F000 NNNN
+    OP_SELECT_PLANES,           // FN01
+    OP_LOAD_AUDIO_PATTERN,      // F002
+    OP_GET_DELAY,               // FX07
+    OP_WAIT_KEY,                // FX0A
+    OP_SET_DELAY,               // FX15
+    OP_SET_BEEP,                // FX18
+    OP_ADD_INDEX,               // FX1E
+    OP_FONT,                    // FX29
+    OP_BIG_FONT,                // FX30
+    OP_BCD,                     // FX33
+    OP_SET_PITCH,               // FX3A
+    OP_STORE_REGS,              // FX55
+    OP_LOAD_REGS,               // FX65
+    OP_STORE_RPL,               // FX75
+    OP_LOAD_RPL,                // FX85
+};
+
+// the first machine an instruction appeared on
+enum InstructionSet : uint8_t
+{
+    SET_CHIP8,
+    SET_SUPERCHIP,
+    SET_XOCHIP,
+    SET_MEGACHIP,
+};
+
+// where execution goes after an instruction
+enum ControlFlow : uint8_t
+{
+    FLOW_NEXT,                  // on to the next instruction
+    FLOW_JUMP,                  // to target only
+    FLOW_CALL,                  // to target, and back to the next instruction on 00EE
+    FLOW_RETURN,                // to wherever the call came from
+    FLOW_SKIP,                  // to the next instruction, or to target past it
+    FLOW_INDIRECT,              // BNNN. Depends on a register, so the target isn't known
+    FLOW_STOP,                  // 00FD, or an instruction that doesn't decode
+};
+
+struct DecodedInstruction
+{
+    uint32_t address;
+    uint16_t opcode;
+
+    // 2, or 4 for F000 NNNN and 01NN NNNN
+    uint8_t length;
+
+    Operation operation;
+    InstructionSet set;
+    ControlFlow flow;
+
+    // the fields of the opcode
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t nn;
+    uint16_t nnn;
+
+    // jump / call target, the address a skip lands on, or the address loaded by F000 NNNN / 01NN NNNN
+    uint32_t target;
+};
+
+// Decodes chip8 instructions of every machine into their fields, their operation and how they affect control flow,
+// and prints them as assembly. The one place outside Instructions.cpp that knows what each opcode means.
+class Disassembler
+{
+public:
+    // decodes the instruction at address of a memory image that starts at base and is size bytes long.
+    // returns false if the instruction doesn't lie entirely within the image
+    static bool Decode(const uint8_t* image, uint32_t size, uint32_t base, uint32_t address, DecodedInstruction& instruction);
+
+    // assembly text of an instruction, like "ld v3, 0x12" or "drw v0, v1, 5"
+    static std::string Format(const DecodedInstruction& instruction);
+};
@@ -0,0 +1,42 @@
+#include "DynamicRateControl.h"
+
+DynamicRateControl::DynamicRateControl(int sampleRate, int32_t maxAdjustPpm) :
+    m_sampleRate(sampleRate),
+    m_maxAdjustPpm(maxAdjustPpm),
+    m_hasBase(false),
+    m_baseSamples(0),
+    m_baseRefreshes(0),
+    m_adjustPpm(0.0)
+{
+}
+
+int32_t DynamicRateControl::Update(uint64_t samplesConsumed, uint64_t displayRefreshes)
+{
+    if (!m_hasBase)
+    {
+        if (displayRefreshes >= WARMUP_REFRESHES)
+        {
+            m_hasBase = true;
+            m_baseSamples = samplesConsumed;
+            m_baseRefreshes = displayRefreshes;
+        }
+
+        return GetAdjust();
+    }
+
+    const uint64_t refreshes = displayRefreshes - m_baseRefreshes;
+    if (refreshes < MIN_MEASURED_REFRESHES)
+        return GetAdjust();
+
+    // samples the sound card consumes per refresh, relative to the nominal samples per 60hz frame
+    const double samplesPerRefresh = (double)(samplesConsumed - m_baseSamples) / refreshes;
+    double target = (samplesPerRefresh * 60.0 / m_sampleRate - 1.0) * 1e6;
+    if (target > m_maxAdjustPpm)
+        target = m_maxAdjustPpm;
+    if (target < -m_maxAdjustPpm)
+        target = -m_maxAdjustPpm;
+
+    // ease towards the measurement so that a hitch doesn't change the frame rate abruptly
+    m_adjustPpm += (target - m_adjustPpm) * 0.1;
+    return GetAdjust();
+}
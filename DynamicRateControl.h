@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+// Matches the emulated frame rate to the display when emulation is paced by the audio clock.
+// Neither the sound card nor the display runs at exactly the rate it claims. Counting the samples the sound card
+// consumes against the refreshes the display shows gives the number of samples per refresh, and stretching each
+// emulated frame to that length makes one frame come out per refresh. The adjustment is limited to a fraction of a
+// percent, so real rate mismatches still fall back to dropping or repeating frames.
+class DynamicRateControl
+{
+public:
+    // maxAdjustPpm limits how far frames are stretched or shrunk, in parts per million
+    DynamicRateControl(int sampleRate, int32_t maxAdjustPpm = 5000);
+
+    // feeds the running totals of samples consumed and display refreshes.
+    // returns the frame length adjustment in parts per million, for ToneSynth::SetRateAdjust
+    int32_t Update(uint64_t samplesConsumed, uint64_t displayRefreshes);
+
+    int32_t GetAdjust() const { return (int32_t)m_adjustPpm; }
+
+private:
+    // refreshes to skip while the audio device and the window settle, and the least to measure over
+    static const uint64_t WARMUP_REFRESHES = 60;
+    static const uint64_t MIN_MEASURED_REFRESHES = 120;
+
+    int m_sampleRate;
+    int32_t m_maxAdjustPpm;
+
+    // totals at the end of the warmup. Rates are measured from here on, so they get more accurate over time
+    bool m_hasBase;
+    uint64_t m_baseSamples;
+    uint64_t m_baseRefreshes;
+
+    double m_adjustPpm;
+};
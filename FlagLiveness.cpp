@@ -0,0 +1,167 @@
+#include <algorithm>
+#include "FlagLiveness.h"
+
+namespace
+{
+    // true if an instruction may read VF. Register fields are taken at face value even where a quirk picks
+    // another register, which only ever makes VF live where it isn't
+    bool ReadsFlag(const DecodedInstruction& instruction)
+    {
+        switch (instruction.operation)
+        {
+            case OP_SKIP_EQ_CONST:
+            case OP_SKIP_NE_CONST:
+            case OP_ADD_CONST:
+            case OP_JUMP_OFFSET:
+            case OP_SKIP_KEY:
+            case OP_SKIP_NOT_KEY:
+            case OP_SET_DELAY:
+            case OP_SET_BEEP:
+            case OP_ADD_INDEX:
+            case OP_FONT:
+            case OP_BIG_FONT:
+            case OP_BCD:
+            case OP_SET_PITCH:
+            case OP_STORE_REGS:
+            case OP_STORE_RPL:
+                return instruction.x == 0xF;
+            case OP_SKIP_EQ_REG:
+            case OP_SKIP_NE_REG:
+            case OP_SAVE_RANGE:
+            case OP_LOAD_REG:
+            case OP_OR:
+            case OP_AND:
+            case OP_XOR:
+            case OP_ADD:
+            case OP_SUB:
+            case OP_SHIFT_RIGHT:
+            case OP_SUB_INVERSE:
+            case OP_SHIFT_LEFT:
+            case OP_DRAW:
+                return instruction.x == 0xF || instruction.y == 0xF;
+            default:
+                return false;
+        }
+    }
+
+    // true if an instruction always overwrites VF. 8XY4 only sets VF on a carry, and 8XY1 - 8XY3 only clear it
+    // with QUIRK_VF_RESET, so they don't count
+    bool KillsFlag(const DecodedInstruction& instruction)
+    {
+        switch (instruction.operation)
+        {
+            case OP_SUB:
+            case OP_SHIFT_RIGHT:
+            case OP_SUB_INVERSE:
+            case OP_SHIFT_LEFT:
+            case OP_DRAW:
+                return true;
+            case OP_LOAD_CONST:
+            case OP_LOAD_REG:
+            case OP_RANDOM:
+            case OP_GET_DELAY:
+            case OP_LOAD_REGS:
+            case OP_LOAD_RPL:
+                return instruction.x == 0xF;
+            default:
+                return false;
+        }
+    }
+
+    // the instructions that compute a flag into VF, which can be left out when it's dead
+    bool SetsFlag(const DecodedInstruction& instruction)
+    {
+        switch (instruction.operation)
+        {
+            case OP_ADD:
+            case OP_SUB:
+            case OP_SHIFT_RIGHT:
+            case OP_SUB_INVERSE:
+            case OP_SHIFT_LEFT:
+            case OP_DRAW:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // whether VF is live in front of an instruction, given whether it's live after it
+    bool LiveBefore(const DecodedInstruction& instruction, bool liveAfter)
+    {
+        return ReadsFlag(instruction) || (liveAfter && !KillsFlag(instruction));
+    }
+}
+
+std::vector<uint32_t> FlagLiveness::FindDeadFlagWrites(const ControlFlowGraph& graph)
+{
+    const std::vector<BasicBlock>& blocks = graph.GetBlocks();
+    const std::vector<DecodedInstruction>& instructions = graph.GetInstructions();
+
+    // whether VF is live on entry to each block. Starts out dead everywhere and only grows until nothing changes
+    std::vector<uint8_t> liveIn(blocks.size(), 0);
+
+    auto liveOut = [&](const BasicBlock& block)
+    {
+        int expectedSuccessors = 0;
+        switch (instructions[block.lastInstruction - 1].flow)
+        {
+            case FLOW_NEXT:
+            case FLOW_JUMP:
+                expectedSuccessors = 1;
+                break;
+            case FLOW_CALL:
+            case FLOW_SKIP:
+                expectedSuccessors = 2;
+                break;
+            default:
+                return true;
+        }
+
+        // the graph drops edges into data
+        if (block.successorCount < expectedSuccessors)
+            return true;
+
+        for (int i = 0; i < block.successorCount; ++i)
+        {
+            const BasicBlock* successor = graph.FindBlock(block.successors[i]);
+            if (successor == nullptr || liveIn[successor - blocks.data()] != 0)
+                return true;
+        }
+        return false;
+    };
+
+    // blocks mostly flow to later blocks, so going backwards settles in a few passes
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int b = (int)blocks.size() - 1; b >= 0; --b)
+        {
+            bool live = liveOut(blocks[b]);
+            for (int i = blocks[b].lastInstruction - 1; i >= blocks[b].firstInstruction; --i)
+                live = LiveBefore(instructions[i], live);
+
+            if (live && liveIn[b] == 0)
+            {
+                liveIn[b] = 1;
+                changed = true;
+            }
+        }
+    }
+
+    std::vector<uint32_t> deadWrites;
+    for (const BasicBlock& block : blocks)
+    {
+        bool live = liveOut(block);
+        for (int i = block.lastInstruction - 1; i >= block.firstInstruction; --i)
+        {
+            if (!live && SetsFlag(instructions[i]))
+                deadWrites.push_back(instructions[i].address);
+            live = LiveBefore(instructions[i], live);
+        }
+    }
+
+    // each block's instructions were visited last to first
+    std::sort(deadWrites.begin(), deadWrites.end());
+    return deadWrites;
+}
@@ -0,0 +1,14 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "ControlFlowGraph.h"
+
+// Finds the instructions whose write to VF is dead: on every path from them VF is written again before anything
+// reads it, so the flag doesn't have to be computed. A backward liveness pass over the blocks of a ControlFlowGraph.
+// Returns, BNNN jumps and edges into data go somewhere the graph doesn't know, so VF is taken to be live there.
+class FlagLiveness
+{
+public:
+    // addresses of the 8XY4, 8XY5, 8XY6, 8XY7, 8XYE and DXYN instructions of graph whose VF write is dead, in address order
+    static std::vector<uint32_t> FindDeadFlagWrites(const ControlFlowGraph& graph);
+};
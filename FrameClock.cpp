@@ -0,0 +1,61 @@
+#include "FrameClock.h"
+
+FrameClock::FrameClock(double framesPerRefresh) :
+    m_framesPerRefresh(framesPerRefresh),
+    m_credit(0.0),
+    m_allowedFrames(0),
+    m_doneFrames(0),
+    m_stopped(false)
+{
+}
+
+void FrameClock::Refresh()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_credit += m_framesPerRefresh;
+        const uint64_t frames = (uint64_t)m_credit;
+        if (frames == 0)
+            return;
+
+        m_credit -= frames;
+        m_allowedFrames += frames;
+    }
+
+    m_frameAllowed.notify_one();
+}
+
+bool FrameClock::WaitForEmulation(std::chrono::nanoseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_frameDone.wait_for(lock, timeout, [this]() { return m_stopped || m_doneFrames >= m_allowedFrames; });
+}
+
+bool FrameClock::WaitForFrame(uint64_t frame)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_frameAllowed.wait(lock, [this, frame]() { return m_stopped || frame < m_allowedFrames; });
+    return !m_stopped;
+}
+
+void FrameClock::FrameDone()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_doneFrames;
+    }
+
+    m_frameDone.notify_one();
+}
+
+void FrameClock::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopped = true;
+    }
+
+    m_frameAllowed.notify_all();
+    m_frameDone.notify_all();
+}
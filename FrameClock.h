@@ -0,0 +1,44 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+
+// Lets the display refresh drive emulation when presenting with vsync.
+// The presentation thread adds the emulated frames each refresh is worth - exactly one on a 60hz display, a fraction
+// on faster ones with the remainder carried over - and the emulation thread waits until it's allowed the next frame.
+class FrameClock
+{
+public:
+    // framesPerRefresh is 60 / the display's refresh rate
+    explicit FrameClock(double framesPerRefresh);
+
+    // presentation thread. Called once per display refresh
+    void Refresh();
+
+    // presentation thread. Waits up to timeout for the emulation thread to finish the frames Refresh allowed,
+    // so that they're shown on the next refresh. returns false on timeout
+    bool WaitForEmulation(std::chrono::nanoseconds timeout);
+
+    // emulation thread. Blocks until frame may be emulated. returns false if the clock was stopped
+    bool WaitForFrame(uint64_t frame);
+
+    // emulation thread. Called once the allowed frame has been published
+    void FrameDone();
+
+    // wakes the emulation thread for good
+    void Stop();
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_frameAllowed;
+    std::condition_variable m_frameDone;
+
+    double m_framesPerRefresh;
+    double m_credit;
+
+    // frames the emulation thread may run, counted from frame 0
+    uint64_t m_allowedFrames;
+    uint64_t m_doneFrames;
+    bool m_stopped;
+};
@@ -0,0 +1,177 @@
+#include "Framebuffer.h"
+
+Framebuffer::Framebuffer() :
+    m_planes(),
+    m_highRes(false),
+    m_selectedPlanes(1),
+    m_planeHashes({}),
+    m_modeHash(0)
+{
+    m_modeHash = ComputeModeHash();
+}
+
+void Framebuffer::SetHighRes(bool highRes)
+{
+    m_highRes = highRes;
+    m_modeHash = ComputeModeHash();
+
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        m_planes[plane] = {};
+        m_planeHashes[plane] = 0;
+    }
+}
+
+void Framebuffer::SelectPlanes(uint8_t planeMask)
+{
+    m_selectedPlanes = planeMask & ((1 << FRAMEBUFFER_PLANES) - 1);
+    m_modeHash = ComputeModeHash();
+}
+
+bool Framebuffer::IsPlaneEmpty(int plane) const
+{
+    for (uint64_t word : m_planes[plane])
+    {
+        if (word != 0)
+            return false;
+    }
+
+    return true;
+}
+
+void Framebuffer::Clear()
+{
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        if ((m_selectedPlanes >> plane) & 1)
+        {
+            m_planes[plane] = {};
+            m_planeHashes[plane] = 0;
+        }
+    }
+}
+
+bool Framebuffer::XorRow(int plane, int x, int y, uint64_t bits)
+{
+    const Plane& words = m_planes[plane];
+    const int index = y * ROW_WORDS + (x >> 6);
+    const int shift = x & 63;
+
+    // the sprite row straddles two words unless it starts on a word boundary
+    const uint64_t first = bits >> shift;
+    bool collision = (words[index] & first) != 0;
+    SetWord(plane, index, words[index] ^ first);
+
+    if (shift != 0 && (x >> 6) + 1 < GetRowWords())
+    {
+        const uint64_t second = bits << (64 - shift);
+        collision |= (words[index + 1] & second) != 0;
+        SetWord(plane, index + 1, words[index + 1] ^ second);
+    }
+
+    return collision;
+}
+
+void Framebuffer::MoveRow(int plane, int dst, int src)
+{
+    const bool onScreen = src >= 0 && src < GetHeight();
+    for (int word = 0; word < GetRowWords(); ++word)
+        SetWord(plane, dst * ROW_WORDS + word, onScreen ? m_planes[plane][src * ROW_WORDS + word] : 0);
+}
+
+void Framebuffer::ScrollUp(int rows)
+{
+    if (rows <= 0)
+        return;
+
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        if ((m_selectedPlanes >> plane) & 1)
+        {
+            for (int y = 0; y < GetHeight(); ++y)
+                MoveRow(plane, y, y + rows);
+        }
+    }
+}
+
+void Framebuffer::ScrollDown(int rows)
+{
+    if (rows <= 0)
+        return;
+
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        if ((m_selectedPlanes >> plane) & 1)
+        {
+            for (int y = GetHeight() - 1; y >= 0; --y)
+                MoveRow(plane, y, y - rows);
+        }
+    }
+}
+
+void Framebuffer::ScrollLeft(int pixels)
+{
+    if (pixels <= 0)
+        return;
+
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        if (((m_selectedPlanes >> plane) & 1) == 0)
+            continue;
+
+        const Plane& words = m_planes[plane];
+        for (int y = 0; y < GetHeight(); ++y)
+        {
+            const int index = y * ROW_WORDS;
+            if (m_highRes)
+            {
+                SetWord(plane, index, words[index] << pixels | words[index + 1] >> (64 - pixels));
+                SetWord(plane, index + 1, words[index + 1] << pixels);
+            }
+            else
+                SetWord(plane, index, words[index] << pixels);
+        }
+    }
+}
+
+void Framebuffer::ScrollRight(int pixels)
+{
+    if (pixels <= 0)
+        return;
+
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        if (((m_selectedPlanes >> plane) & 1) == 0)
+            continue;
+
+        const Plane& words = m_planes[plane];
+        for (int y = 0; y < GetHeight(); ++y)
+        {
+            const int index = y * ROW_WORDS;
+            if (m_highRes)
+            {
+                SetWord(plane, index + 1, words[index + 1] >> pixels | words[index] << (64 - pixels));
+                SetWord(plane, index, words[index] >> pixels);
+            }
+            else
+                SetWord(plane, index, words[index] >> pixels);
+        }
+    }
+}
+
+uint64_t Framebuffer::ComputeHash() const
+{
+    uint64_t hash = ComputeModeHash();
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        for (size_t i = 0; i < m_planes[plane].size(); ++i)
+            hash ^= StateHash::WordKey(Slot(plane, (int)i), m_planes[plane][i]);
+    }
+
+    return hash;
+}
+
+uint64_t Framebuffer::ComputeModeHash() const
+{
+    return StateHash::Key(StateHash::SLOT_HIGH_RES, m_highRes ? 1 : 0) ^ StateHash::Key(StateHash::SLOT_SELECTED_PLANES, m_selectedPlanes);
+}
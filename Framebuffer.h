@@ -0,0 +1,105 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "StateHash.h"
+
+#define SCREEN_WIDTH 64
+#define SCREEN_HEIGHT 32
+
+// SUPER-CHIP high resolution mode
+#define HIRES_SCREEN_WIDTH 128
+#define HIRES_SCREEN_HEIGHT 64
+
+// XO-CHIP bitplanes. A pixel's color is the index made of its bit in each plane
+#define FRAMEBUFFER_PLANES 2
+
+// The display, packed one bit per pixel into 64-bit words with the leftmost pixel of a row in the top bit of its first
+// word. Sprites are xored in and the picture is scrolled a word at a time rather than a pixel at a time.
+// Each bitplane is a separate packed array, so drawing to or scrolling several planes is the same word operations per plane.
+// Storage is always sized for 128x64. In 64x32 mode only the first word of the first 32 rows is used.
+// A Zobrist hash of the contents is kept up to date on every change, like the rest of the machine state.
+class Framebuffer
+{
+public:
+    // words per row in 128x64 mode
+    static const int ROW_WORDS = HIRES_SCREEN_WIDTH / 64;
+
+    Framebuffer();
+
+    // switches between 64x32 and 128x64 (00FE / 00FF). Clears every plane
+    void SetHighRes(bool highRes);
+    bool IsHighRes() const { return m_highRes; }
+
+    // planes that drawing, clearing and scrolling apply to (FN01). Bit n is plane n. Plane 0 only by default
+    void SelectPlanes(uint8_t planeMask);
+    uint8_t GetSelectedPlanes() const { return m_selectedPlanes; }
+
+    int GetWidth() const { return m_highRes ? HIRES_SCREEN_WIDTH : SCREEN_WIDTH; }
+    int GetHeight() const { return m_highRes ? HIRES_SCREEN_HEIGHT : SCREEN_HEIGHT; }
+
+    // words of each row that are in use
+    int GetRowWords() const { return m_highRes ? ROW_WORDS : 1; }
+
+    // color index of a pixel: bit n is set if the pixel is on in plane n. No bounds checks
+    uint8_t GetPixel(int x, int y) const
+    {
+        const int index = y * ROW_WORDS + (x >> 6);
+        const int shift = 63 - (x & 63);
+        return (uint8_t)((m_planes[0][index] >> shift & 1) | (m_planes[1][index] >> shift & 1) << 1);
+    }
+
+    uint64_t GetWord(int plane, int y, int word) const { return m_planes[plane][y * ROW_WORDS + word]; }
+
+    // true if no pixel of the plane is on
+    bool IsPlaneEmpty(int plane) const;
+
+    // clears the selected planes (00E0)
+    void Clear();
+
+    // xors bits into row y of a plane starting at column x. The top bit of bits lands on x, pixels past the right edge
+    // are clipped. returns true if any pixel was turned off (a collision)
+    bool XorRow(int plane, int x, int y, uint64_t bits);
+
+    // moves the picture in the selected planes up or down by rows or sideways by pixels (less than 64).
+    // Pixels scrolled in are off
+    void ScrollUp(int rows);
+    void ScrollDown(int rows);
+    void ScrollLeft(int pixels);
+    void ScrollRight(int pixels);
+
+    // hash of the resolution, plane selection and every pixel. O(1)
+    uint64_t GetHash() const { return m_planeHashes[0] ^ m_planeHashes[1] ^ m_modeHash; }
+
+    // recomputes the hash from scratch. Slow - only useful to verify the incremental hash
+    uint64_t ComputeHash() const;
+
+private:
+    typedef std::array<uint64_t, ROW_WORDS * HIRES_SCREEN_HEIGHT> Plane;
+
+    // hash slot of a word of a plane
+    static uint32_t Slot(int plane, int index) { return StateHash::SLOT_SCREEN + plane * 0x100 + index; }
+
+    void SetWord(int plane, int index, uint64_t value)
+    {
+        // most of a scrolled screen is usually blank, and blank words don't need rehashing
+        if (value == m_planes[plane][index])
+            return;
+
+        m_planeHashes[plane] ^= StateHash::WordDelta(Slot(plane, index), m_planes[plane][index], value);
+        m_planes[plane][index] = value;
+    }
+
+    // copies row src of a plane to row dst, or blanks row dst if src is off screen
+    void MoveRow(int plane, int dst, int src);
+
+    uint64_t ComputeModeHash() const;
+
+    std::array<Plane, FRAMEBUFFER_PLANES> m_planes;
+    bool m_highRes;
+    uint8_t m_selectedPlanes;
+
+    // hash of each plane's words, and of the resolution and plane selection
+    std::array<uint64_t, FRAMEBUFFER_PLANES> m_planeHashes;
+    uint64_t m_modeHash;
+};
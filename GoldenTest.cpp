@@ -0,0 +1,302 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <unordered_set>
+#include <vector>
+#include "BatchRunner.h"
+#include "Chip8.h"
+#include "GoldenTest.h"
+#include "InputMovie.h"
+#include "KeypadInput.h"
+#include "LatencyHistogram.h"
+#include "ThreadPool.h"
+#include "VisitedSet.h"
+
+namespace
+{
+    // returns everything after the last path separator
+    std::string FileName(const std::string& path)
+    {
+        const size_t separator = path.find_last_of("/\\");
+        return separator == std::string::npos ? path : path.substr(separator + 1);
+    }
+
+    // returns everything up to and including the last path separator
+    std::string DirectoryName(const std::string& path)
+    {
+        const size_t separator = path.find_last_of("/\\");
+        return separator == std::string::npos ? "" : path.substr(0, separator + 1);
+    }
+
+    // reads a golden file: an "ipf n" line followed by one hex screen hash per frame.
+    // returns 0 if no errors. Otherwise returns an error code.
+    int LoadGolden(const std::string& fileName, int& instructionsPerFrame, std::vector<uint64_t>& hashes)
+    {
+        std::ifstream file(fileName);
+        if (!file)
+            return 1;
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            if (line.compare(0, 4, "ipf ") == 0)
+                instructionsPerFrame = atoi(line.c_str() + 4);
+            else
+                hashes.push_back(strtoull(line.c_str(), nullptr, 16));
+        }
+
+        return instructionsPerFrame > 0 ? 0 : 2;
+    }
+
+    int SaveGolden(const std::string& fileName, const BatchJob& job, int instructionsPerFrame, const std::vector<uint64_t>& hashes)
+    {
+        FILE* file = fopen(fileName.c_str(), "w");
+        if (file == nullptr)
+            return 1;
+
+        fprintf(file, "# %s - screen hash after every frame. Regenerate with -golden <case list> -update\n", job.romPath.c_str());
+        fprintf(file, "ipf %d\n", instructionsPerFrame);
+        for (uint64_t hash : hashes)
+            fprintf(file, "%016llx\n", (unsigned long long)hash);
+
+        fclose(file);
+        return 0;
+    }
+}
+
+int GoldenTest::Run(const std::string& caseListFile, bool update, bool checkFlags)
+{
+    BatchRunner cases;
+    if (cases.LoadJobs(caseListFile) != 0)
+        return -1;
+
+    const std::string goldenDir = DirectoryName(caseListFile);
+    int failures = 0;
+
+    for (const BatchJob& job : cases.GetJobs())
+    {
+        const std::string goldenFile = goldenDir + FileName(job.romPath) + ".golden";
+
+        // new goldens are recorded at the default 500hz tickrate
+        int instructionsPerFrame = 500 / 60;
+        std::vector<uint64_t> expected;
+        if (!update && LoadGolden(goldenFile, instructionsPerFrame, expected) != 0)
+        {
+            printf("FAIL %s: can't read %s\n", job.romPath.c_str(), goldenFile.c_str());
+            ++failures;
+            continue;
+        }
+
+        Chip8 emu;
+        InputMovie movie;
+        if (emu.Init(instructionsPerFrame * 60) != 0 || emu.LoadGame(job.romPath) != 0
+            || (job.moviePath != "-" && movie.Load(job.moviePath) != 0))
+        {
+            printf("FAIL %s: can't load rom or movie\n", job.romPath.c_str());
+            ++failures;
+            continue;
+        }
+        emu.SetFlagChecking(checkFlags);
+
+        std::vector<uint64_t> actual;
+        bool mismatch = false;
+        for (uint32_t frame = 0; frame < job.frames && !mismatch; ++frame)
+        {
+            emu.SetKeyboardState(movie.GetKeyState(frame));
+            emu.RunFrame(instructionsPerFrame);
+            actual.push_back(HashScreen(emu));
+
+            if (!update && (frame >= expected.size() || actual[frame] != expected[frame]))
+            {
+                const std::string dumpFile = FileName(job.romPath) + ".frame" + std::to_string(frame) + ".pbm";
+                WriteScreenPbm(emu, dumpFile);
+                printf("FAIL %s: frame %u differs from golden, screen written to %s\n", job.romPath.c_str(), frame, dumpFile.c_str());
+                mismatch = true;
+            }
+        }
+
+        if (update)
+        {
+            if (SaveGolden(goldenFile, job, instructionsPerFrame, actual) != 0)
+            {
+                printf("FAIL %s: can't write %s\n", job.romPath.c_str(), goldenFile.c_str());
+                ++failures;
+                continue;
+            }
+            printf("UPDATED %s: %zu frames\n", job.romPath.c_str(), actual.size());
+        }
+        else if (mismatch)
+            ++failures;
+        else if (emu.GetFlagCheckFailures() > 0)
+        {
+            printf("FAIL %s: %llu read(s) of a dead VF write\n", job.romPath.c_str(), (unsigned long long)emu.GetFlagCheckFailures());
+            ++failures;
+        }
+        else
+            printf("PASS %s: %u frames\n", job.romPath.c_str(), job.frames);
+    }
+
+    if (!update)
+    {
+        if (CheckKeyWaitLatency())
+            printf("PASS input latency: a press that ends FX0A is measured once\n");
+        else
+        {
+            printf("FAIL input latency: a press that ends FX0A isn't measured once\n");
+            ++failures;
+        }
+
+        if (CheckVisitedSet())
+            printf("PASS visited set: concurrent inserts keep each state once\n");
+        else
+        {
+            printf("FAIL visited set: concurrent inserts don't keep each state once\n");
+            ++failures;
+        }
+    }
+
+    return failures;
+}
+
+bool GoldenTest::CheckKeyWaitLatency()
+{
+    // ld v0, k / jp 0x202
+    const uint8_t rom[] = { 0xF0, 0x0A, 0x12, 0x02 };
+    const int instructionsPerFrame = 500 / 60;
+    const uint8_t key = 5;
+
+    Chip8 emu;
+    KeypadInput input;
+    if (emu.Init(instructionsPerFrame * 60) != 0 || emu.LoadGame(rom, sizeof(rom)) != 0)
+        return false;
+
+    LatencyHistogram latency;
+    std::array<uint64_t, 16> measured = {};
+    KeyPresses unpresented = {};
+
+    // the rom waits from the first frame on, the key goes down before the second. Every frame is shown, and each
+    // also carries the presses of the one before it, as if it wasn't known yet whether that one was dropped
+    for (int frame = 0; frame < 4; ++frame)
+    {
+        if (frame == 1)
+            input.PublishKeys(1 << key);
+
+        input.Apply(emu);
+        emu.RunFrame(instructionsPerFrame);
+
+        KeyPresses readPresses = {};
+        input.CollectReadPresses(emu.GetKeysRead(), readPresses);
+        unpresented.Merge(readPresses);
+
+        const uint64_t presentTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        unpresented.Measure(presentTime, measured, latency);
+        unpresented = readPresses;
+    }
+
+    return emu.GetRegister(0) == key && latency.GetCount() == 1;
+}
+
+bool GoldenTest::CheckVisitedSet()
+{
+    // add v0, 1 / jp 0x200. 512 distinct states, each reached many times over
+    const uint8_t rom[] = { 0x70, 0x01, 0x12, 0x00 };
+    const int threads = 4;
+
+    Chip8 emu;
+    if (emu.Init(500) != 0 || emu.LoadGame(rom, sizeof(rom)) != 0)
+        return false;
+
+    std::vector<uint64_t> hashes;
+    for (int i = 0; i < 4096; ++i)
+    {
+        emu.RunFrame(1);
+        hashes.push_back(emu.GetStateHash());
+    }
+
+    // 0 is the empty slot marker, and must still be a state of its own
+    hashes.push_back(0);
+    hashes.push_back(0x8000000000000000ull);
+    const std::unordered_set<uint64_t> distinct(hashes.begin(), hashes.end());
+
+    // every thread inserts every hash, starting at a different one, so most inserts race with an insert of the same hash
+    VisitedSet visited(distinct.size() * 2);
+    std::atomic<size_t> inserted(0);
+    std::atomic<size_t> tableFull(0);
+    {
+        ThreadPool pool(threads);
+        for (int thread = 0; thread < threads; ++thread)
+        {
+            pool.Submit([&, thread]()
+            {
+                for (size_t i = 0; i < hashes.size(); ++i)
+                {
+                    const VisitedSet::InsertResult result = visited.Insert(hashes[(i + thread * hashes.size() / threads) % hashes.size()]);
+                    if (result == VisitedSet::InsertResult::Inserted)
+                        ++inserted;
+                    else if (result == VisitedSet::InsertResult::TableFull)
+                        ++tableFull;
+                }
+            });
+        }
+        pool.Wait();
+    }
+
+    bool found = true;
+    for (uint64_t hash : distinct)
+        found = found && visited.Contains(hash);
+
+    return found && tableFull == 0 && inserted == distinct.size() && visited.GetSize() == distinct.size();
+}
+
+uint64_t GoldenTest::HashScreen(const Chip8& chip8)
+{
+    // FNV-1a over the screen packed into 64-bit words, one per 64 pixels of a row.
+    // The second bitplane only counts once it's used, so roms that don't use it hash the same as before it existed
+    const Framebuffer& screen = chip8.GetScreen();
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
+    {
+        if (plane > 0 && screen.IsPlaneEmpty(plane))
+            continue;
+
+        for (int y = 0; y < screen.GetHeight(); ++y)
+        {
+            for (int word = 0; word < screen.GetRowWords(); ++word)
+            {
+                const uint64_t row = screen.GetWord(plane, y, word);
+                for (int i = 0; i < 8; ++i)
+                {
+                    hash ^= (row >> (i * 8)) & 0xFF;
+                    hash *= 0x100000001B3ull;
+                }
+            }
+        }
+    }
+
+    return hash;
+}
+
+int GoldenTest::WriteScreenPbm(const Chip8& chip8, const std::string& fileName)
+{
+    FILE* file = fopen(fileName.c_str(), "w");
+    if (file == nullptr)
+        return 1;
+
+    const Framebuffer& screen = chip8.GetScreen();
+    fprintf(file, "P1\n%d %d\n", screen.GetWidth(), screen.GetHeight());
+    for (int y = 0; y < screen.GetHeight(); ++y)
+    {
+        for (int x = 0; x < screen.GetWidth(); ++x)
+            fprintf(file, x == 0 ? "%d" : " %d", screen.GetPixel(x, y) != 0 ? 1 : 0);
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return 0;
+}
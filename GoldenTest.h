@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+class Chip8;
+
+// Golden-frame regression checks.
+// Runs every case of a case list (same format as a batch job list, see BatchRunner) headlessly and compares
+// the screen after every frame against the hashes stored next to the case list in <rom file name>.golden.
+// The first mismatching frame of a failing case is dumped as a PBM image into the working directory.
+class GoldenTest
+{
+public:
+    // runs all cases. With update set, the golden files are rewritten from the current results instead.
+    // With checkFlags the cases run in the lazy flag debug mode, and reading a VF write taken to be dead fails a case.
+    // returns the number of failed cases, or -1 if the case list can't be loaded
+    static int Run(const std::string& caseListFile, bool update, bool checkFlags = false);
+
+    // drives a key press through the input path the way Chip8::Run does, into a rom waiting on FX0A, and checks
+    // that the press is measured exactly once by the input latency histogram. returns true if it is
+    static bool CheckKeyWaitLatency();
+
+    // inserts the state hashes of a running rom into a VisitedSet from several threads at once, and checks that
+    // each distinct state is inserted exactly once and found afterwards. returns true if it is
+    static bool CheckVisitedSet();
+
+    // hashes the screen contents. Only depends on which pixels are lit, not on how the screen is stored
+    static uint64_t HashScreen(const Chip8& chip8);
+
+    // writes the screen as a plain PBM image. returns 0 if no errors. Otherwise returns an error code.
+    static int WriteScreenPbm(const Chip8& chip8, const std::string& fileName);
+};
@@ -0,0 +1,57 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include "InputMovie.h"
+
+int InputMovie::Load(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+
+    // file not found
+    if (!file)
+        return 1;
+
+    m_changes.clear();
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream fields(line);
+        uint32_t frame;
+        uint32_t keyMask;
+        if (!(fields >> std::hex >> frame >> keyMask) || keyMask > 0xFFFF)
+            return 2;
+
+        // frames out of order
+        if (!m_changes.empty() && frame < m_changes.back().frame)
+            return 3;
+
+        AddChange(frame, (uint16_t)keyMask);
+    }
+
+    return 0;
+}
+
+void InputMovie::AddChange(uint32_t frame, uint16_t keyMask)
+{
+    // a later change on the same frame wins
+    if (!m_changes.empty() && m_changes.back().frame == frame)
+        m_changes.back().keyMask = keyMask;
+    else
+        m_changes.push_back({ frame, keyMask });
+}
+
+uint16_t InputMovie::GetKeyState(uint32_t frame) const
+{
+    // find the last change at or before this frame
+    auto next = std::upper_bound(m_changes.begin(), m_changes.end(), frame,
+        [](uint32_t f, const Change& change) { return f < change.frame; });
+
+    if (next == m_changes.begin())
+        return 0;
+
+    return (next - 1)->keyMask;
+}
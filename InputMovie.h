@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Scripted keypad input for headless runs.
+// A movie file is a list of "frame keyMask" lines, both in hex, sorted by frame. Each line sets the state of
+// all 16 keys (bit n = key n) from that frame on. Empty lines and lines starting with # are ignored.
+class InputMovie
+{
+public:
+    // loads a movie file, replacing any changes already added.
+    // returns 0 if no errors. Otherwise returns an error code.
+    int Load(const std::string& fileName);
+
+    // sets the keypad state from the given frame on. Frames must be added in increasing order
+    void AddChange(uint32_t frame, uint16_t keyMask);
+
+    // returns the keypad state during the given frame
+    uint16_t GetKeyState(uint32_t frame) const;
+
+private:
+    struct Change
+    {
+        uint32_t frame;
+        uint16_t keyMask;
+    };
+
+    std::vector<Change> m_changes;
+};
@@ -23,6 +23,64 @@ void Instructions::Return(uint16_t opc, Chip8* chip8)
     chip8->DecrementStackPointer();
 }
 
+void Instructions::ScrollDown(uint16_t opc, Chip8* chip8)
+{
+    uint8_t rows = opc & 0x000F;
+    Debug::Log("0x%04X: ScrollDown %d\n", opc, rows);
+
+    chip8->ScrollDisplayDown(rows);
+    chip8->SetDrawFlag(true);
+}
+
+void Instructions::ScrollRight(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: ScrollRight 4\n", opc);
+
+    chip8->ScrollDisplayRight(4);
+    chip8->SetDrawFlag(true);
+}
+
+void Instructions::ScrollLeft(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: ScrollLeft 4\n", opc);
+
+    chip8->ScrollDisplayLeft(4);
+    chip8->SetDrawFlag(true);
+}
+
+void Instructions::ScrollUp(uint16_t opc, Chip8* chip8)
+{
+    uint8_t rows = opc & 0x000F;
+    Debug::Log("0x%04X: ScrollUp %d\n", opc, rows);
+
+    chip8->ScrollDisplayUp(rows);
+    chip8->SetDrawFlag(true);
+}
+
+void Instructions::Exit(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: Exit\n", opc);
+
+    // jump back onto this instruction. Idle loop skipping makes the spinning free
+    chip8->SetProgramCounter(chip8->GetProgramCounter() - 2);
+}
+
+void Instructions::LowResolution(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: LowResolution\n", opc);
+
+    chip8->SetHighRes(false);
+    chip8->SetDrawFlag(true);
+}
+
+void Instructions::HighResolution(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: HighResolution\n", opc);
+
+    chip8->SetHighRes(true);
+    chip8->SetDrawFlag(true);
+}
+
 void Instructions::Jump(uint16_t opc, Chip8* chip8)
 {
     uint16_t addr = opc & 0x0FFF;
@@ -51,7 +109,7 @@ void Instructions::SkipIfEqualConst(uint16_t opc, Chip8* chip8)
 
     if (val == regVal)
     {
-        chip8->SetProgramCounter(chip8->GetProgramCounter() + 2);
+        chip8->SkipNextInstruction();
         Debug::Log("Yes\n");
     }
     else
@@ -70,7 +128,7 @@ void Instructions::SkipIfNotEqualConst(uint16_t opc, Chip8* chip8)
 
     if (val != regVal)
     {
-        chip8->SetProgramCounter(chip8->GetProgramCounter() + 2);
+        chip8->SkipNextInstruction();
         Debug::Log("No\n");
     }
     else
@@ -91,7 +149,7 @@ void Instructions::SkipIfEqualVal(uint16_t opc, Chip8* chip8)
 
     if (regVal1 == regVal2)
     {
-        chip8->SetProgramCounter(chip8->GetProgramCounter() + 2);
+        chip8->SkipNextInstruction();
         Debug::Log("Yes\n");
     }
     else
@@ -100,6 +158,35 @@ void Instructions::SkipIfEqualVal(uint16_t opc, Chip8* chip8)
     return;
 }
 
+void Instructions::SaveRegisterRange(uint16_t opc, Chip8* chip8)
+{
+    uint8_t regIndex1 = (opc & 0x0F00) >> 8;
+    uint8_t regIndex2 = (opc & 0x00F0) >> 4;
+    uint32_t I = chip8->GetIndex();
+
+    Debug::Log("0x%04X: SaveRegisterRange V[%d] to V[%d] starting at Memory[0x%X]\n", opc, regIndex1, regIndex2, I);
+
+    // the registers go out in the order given, which can be backwards
+    const int count = regIndex1 <= regIndex2 ? regIndex2 - regIndex1 : regIndex1 - regIndex2;
+    const int step = regIndex1 <= regIndex2 ? 1 : -1;
+    for (int i = 0; i <= count; ++i)
+        chip8->SetMemory(I + i, chip8->GetRegister(regIndex1 + i * step));
+}
+
+void Instructions::LoadRegisterRange(uint16_t opc, Chip8* chip8)
+{
+    uint8_t regIndex1 = (opc & 0x0F00) >> 8;
+    uint8_t regIndex2 = (opc & 0x00F0) >> 4;
+    uint32_t I = chip8->GetIndex();
+
+    Debug::Log("0x%04X: LoadRegisterRange V[%d] to V[%d] starting at Memory[0x%X]\n", opc, regIndex1, regIndex2, I);
+
+    const int count = regIndex1 <= regIndex2 ? regIndex2 - regIndex1 : regIndex1 - regIndex2;
+    const int step = regIndex1 <= regIndex2 ? 1 : -1;
+    for (int i = 0; i <= count; ++i)
+        chip8->SetRegister(regIndex1 + i * step, chip8->GetMemory(I + i));
+}
+
 void Instructions::LoadConst(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex = (opc & 0x0F00) >> 8;
@@ -133,6 +220,7 @@ void Instructions::LoadVal(uint16_t opc, Chip8* chip8)
     chip8->SetRegister(regIndex1, regVal2);
 }
 
+template <unsigned Quirks>
 void Instructions::LoadOr(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex1 = (opc & 0x0F00) >> 8;
@@ -144,8 +232,12 @@ void Instructions::LoadOr(uint16_t opc, Chip8* chip8)
     Debug::Log("0x%04X: LoadOr V[%d] = 0x%02x | (V[%d] = 0x%02x)\n", opc, regIndex1, regVal1, regIndex2, regVal2);
 
     chip8->SetRegister(regIndex1, regVal1 | regVal2);
+
+    if (Quirks & QUIRK_VF_RESET)
+        chip8->SetRegister(0xF, 0);
 }
 
+template <unsigned Quirks>
 void Instructions::LoadAnd(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex1 = (opc & 0x0F00) >> 8;
@@ -157,8 +249,12 @@ void Instructions::LoadAnd(uint16_t opc, Chip8* chip8)
     Debug::Log("0x%04X: LoadAnd V[%d] = 0x%02x & (V[%d] = 0x%02x)\n", opc, regIndex1, regVal1, regIndex2, regVal2);
 
     chip8->SetRegister(regIndex1, regVal1 & regVal2);
+
+    if (Quirks & QUIRK_VF_RESET)
+        chip8->SetRegister(0xF, 0);
 }
 
+template <unsigned Quirks>
 void Instructions::LoadXor(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex1 = (opc & 0x0F00) >> 8;
@@ -170,8 +266,12 @@ void Instructions::LoadXor(uint16_t opc, Chip8* chip8)
     Debug::Log("0x%04X: LoadXor V[%d] = 0x%02x ^ (V[%d] = 0x%02x)\n", opc, regIndex1, regVal1, regIndex2, regVal2);
 
     chip8->SetRegister(regIndex1, regVal1 ^ regVal2);
+
+    if (Quirks & QUIRK_VF_RESET)
+        chip8->SetRegister(0xF, 0);
 }
 
+template <bool SetFlag>
 void Instructions::AddVal(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex1 = (opc & 0x0F00) >> 8;
@@ -185,12 +285,13 @@ void Instructions::AddVal(uint16_t opc, Chip8* chip8)
     uint16_t sum = regVal1 + regVal2;
 
     // Set carry flag to 1 if sum requires more than 8 bits (> 255)
-    if (sum > 0xFF)
+    if (SetFlag && sum > 0xFF)
         chip8->SetRegister(0xF, 1);
 
     chip8->SetRegister(regIndex1, (sum & 0xFF));
 }
 
+template <bool SetFlag>
 void Instructions::SubVal(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex1 = (opc & 0x0F00) >> 8;
@@ -202,31 +303,29 @@ void Instructions::SubVal(uint16_t opc, Chip8* chip8)
     Debug::Log("0x%04X: SubVal (V[%d] = 0x%02x) - (V[%d] = 0x%02x)\n", opc, regIndex1, regVal1, regIndex2, regVal2);
 
     // Set carry flag to 1 if the result of subtraction will be negative
-    if (regVal2 > regVal1)
-        chip8->SetRegister(0xF, 0);
-    else
-        chip8->SetRegister(0xF, 1);
+    if (SetFlag)
+        chip8->SetRegister(0xF, regVal2 > regVal1 ? 0 : 1);
 
     uint8_t diff = regVal1 - regVal2;
     chip8->SetRegister(regIndex1, diff);
 }
 
+template <unsigned Quirks, bool SetFlag>
 void Instructions::ShiftRight(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex = (opc & 0x0F00) >> 8;
-    uint8_t regVal = chip8->GetRegister(regIndex);
+    uint8_t regVal = chip8->GetRegister((Quirks & QUIRK_SHIFT_VY) ? (opc & 0x00F0) >> 4 : regIndex);
 
     // set carry flag if least significant bit of the value is 1
-    if ((regVal & 0x1) == 1)
-        chip8->SetRegister(0xF, 1);
-    else
-        chip8->SetRegister(0xF, 0);
+    if (SetFlag)
+        chip8->SetRegister(0xF, regVal & 0x1);
 
     uint8_t res = (regVal >> 1);
     Debug::Log("0x%04X: ShiftRight (V[%d] = 0x%02x) >> 1 = 0x%02x\n", opc, regIndex, regVal, res);
     chip8->SetRegister(regIndex, res);
 }
 
+template <bool SetFlag>
 void Instructions::SubValInverse(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex1 = (opc & 0x0F00) >> 8;
@@ -238,22 +337,22 @@ void Instructions::SubValInverse(uint16_t opc, Chip8* chip8)
     Debug::Log("0x%04X: SubValInverse (V[%d] = 0x%02x) - (V[%d] = 0x%02x)\n", opc, regIndex2, regVal2, regIndex1, regVal1);
 
     // Set carry flag to 1 if the result of subtraction will be negative
-    if (regVal1 > regVal2)
-        chip8->SetRegister(0xF, 0);
-    else
-        chip8->SetRegister(0xF, 1);
+    if (SetFlag)
+        chip8->SetRegister(0xF, regVal1 > regVal2 ? 0 : 1);
 
     uint8_t diff = regVal2 - regVal1;
     chip8->SetRegister(regIndex1, diff);
 }
 
+template <unsigned Quirks, bool SetFlag>
 void Instructions::ShiftLeft(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex = (opc & 0x0F00) >> 8;
-    uint8_t regVal = chip8->GetRegister(regIndex);
+    uint8_t regVal = chip8->GetRegister((Quirks & QUIRK_SHIFT_VY) ? (opc & 0x00F0) >> 4 : regIndex);
 
     // set V[F] to the most significant bit
-    chip8->SetRegister(0xF, (regVal & 0x80) >> 7);
+    if (SetFlag)
+        chip8->SetRegister(0xF, (regVal & 0x80) >> 7);
 
     uint8_t res = (regVal << 1);
     Debug::Log("0x%04X: ShiftLeft V[%d] = ((V[%d]) 0x%04x << 1) = 0x%04x\n", opc, regIndex, regIndex, regVal, res);
@@ -272,7 +371,7 @@ void Instructions::SkipIfNotEqualVal(uint16_t opc, Chip8* chip8)
 
     if (regVal1 != regVal2)
     {
-        chip8->SetProgramCounter(chip8->GetProgramCounter() + 2);
+        chip8->SkipNextInstruction();
         Debug::Log("No\n");
     }
     else
@@ -290,13 +389,15 @@ void Instructions::SetIndex(uint16_t opc, Chip8* chip8)
     chip8->SetIndex(addr);
 }
 
+template <unsigned Quirks>
 void Instructions::JumpOffset(uint16_t opc, Chip8* chip8)
 {
     uint16_t baseAddr = opc & 0x0FFF;
-    uint8_t v0 = chip8->GetRegister(0x0);
-    uint16_t addr = baseAddr + v0;
-    Debug::Log("0x%04X: JumpOffset 0x%03x (0x%03x + V[0](0x%02x))\n", opc, addr, baseAddr, v0);
-    chip8->SetProgramCounter(baseAddr + v0);
+    uint8_t offsetIndex = (Quirks & QUIRK_JUMP_VX) ? (opc & 0x0F00) >> 8 : 0x0;
+    uint8_t offset = chip8->GetRegister(offsetIndex);
+    uint16_t addr = baseAddr + offset;
+    Debug::Log("0x%04X: JumpOffset 0x%03x (0x%03x + V[%d](0x%02x))\n", opc, addr, baseAddr, offsetIndex, offset);
+    chip8->SetProgramCounter(addr);
     return;
 }
 
@@ -312,38 +413,81 @@ void Instructions::Random(uint16_t opc, Chip8* chip8)
     chip8->SetRegister(regIndex, val);
 }
 
+template <unsigned Quirks, bool SetFlag>
 void Instructions::DrawSprite(uint16_t opc, Chip8* chip8)
 {
     uint8_t xRegIndex = (opc & 0x0F00) >> 8;
     uint8_t yRegIndex = (opc & 0x00F0) >> 4;
     Debug::Log("0x%04X: DrawSprite: xReg(%d) yReg(%d)\n", opc, xRegIndex, yRegIndex);
+
+    // MEGA-CHIP sprites are sized by 03NN / 04NN instead of N, and VF is set if they hit the collision color
+    if (chip8->IsMegaMode())
+    {
+        const bool hit = chip8->DrawMegaSprite(chip8->GetRegister(xRegIndex), chip8->GetRegister(yRegIndex));
+        if (SetFlag)
+            chip8->SetRegister(0xF, hit ? 1 : 0);
+        chip8->SetDrawFlag(true);
+        if (Quirks & QUIRK_DISPLAY_WAIT)
+            chip8->WaitForNextFrame();
+        return;
+    }
     
-    uint16_t x = chip8->GetRegister(xRegIndex);
-    uint16_t y = chip8->GetRegister(yRegIndex);
-    uint16_t height = opc & 0x000F;
+    const int screenWidth = chip8->GetScreen().GetWidth();
+    const int screenHeight = chip8->GetScreen().GetHeight();
+
+    // the starting position wraps around the screen
+    int x = chip8->GetRegister(xRegIndex) % screenWidth;
+    int y = chip8->GetRegister(yRegIndex) % screenHeight;
+
+    // DXY0 draws 16 rows of 16 pixels, 2 bytes per row
+    const bool wide = (opc & 0x000F) == 0;
+    const int height = wide ? 16 : opc & 0x000F;
     Debug::Log("0x%04X: DrawSprite: x(%d) y(%d) height(%d)\n", opc, x, y, height);
-    uint16_t pixel;
 
-    // reset collision flag to 0
-    chip8->SetRegister(0xF, 0);
+    // rows that start below the bottom edge are clipped, unless they wrap around to the top
+    const int visibleRows = (Quirks & QUIRK_WRAP_SPRITES) || y + height <= screenHeight ? height : screenHeight - y;
+    const int spriteWidth = wide ? 16 : 8;
 
-    for (int yInd = 0; yInd < height; yInd++)
+    // each selected bitplane gets its own copy of the sprite, one after the other in memory.
+    // Each row is xored into the screen a word at a time. Pixels past the right edge are clipped by the framebuffer
+    const uint8_t planes = chip8->GetScreen().GetSelectedPlanes();
+    uint32_t address = chip8->GetIndex();
+    bool collision = false;
+    for (int plane = 0; plane < FRAMEBUFFER_PLANES; ++plane)
     {
-        pixel = chip8->GetMemory(chip8->GetIndex() + yInd);
-        for (int xInd = 0; xInd < 8; xInd++)
+        if (((planes >> plane) & 1) == 0)
+            continue;
+
+        // the rows come from the sprite cache, unless the sprite runs off the memory it covers
+        const uint64_t* rows = chip8->GetSpriteRows(address, height, wide);
+        for (int yInd = 0; yInd < visibleRows; yInd++)
         {
-            if ((pixel & (0x80 >> xInd)) != 0)
-            {
-                // check for a collision (pixel is already 1)
-                if ((chip8->GetPixelStatus(x + xInd + ((y + yInd) * 64))) == 1)
-                    chip8->SetRegister(0xF, 1);
-
-                chip8->XorPixel(x + xInd + ((y + yInd) * 64));
-            }
+            uint64_t row;
+            if (rows != nullptr)
+                row = rows[yInd];
+            else if (wide)
+                row = (uint64_t)(chip8->GetMemory(address + yInd * 2) << 8 | chip8->GetMemory(address + yInd * 2 + 1)) << 48;
+            else
+                row = (uint64_t)chip8->GetMemory(address + yInd) << 56;
+
+            const int rowY = (Quirks & QUIRK_WRAP_SPRITES) ? (y + yInd) % screenHeight : y + yInd;
+            if (chip8->XorSpriteRow(plane, x, rowY, row))
+                collision = true;
+
+            // the pixels the framebuffer clipped at the right edge go in at the left
+            if ((Quirks & QUIRK_WRAP_SPRITES) && x + spriteWidth > screenWidth && chip8->XorSpriteRow(plane, 0, rowY, row << (screenWidth - x)))
+                collision = true;
         }
+
+        address += wide ? height * 2 : height;
     }
 
+    // VF is set to 1 if any pixel was turned off
+    if (SetFlag)
+        chip8->SetRegister(0xF, collision ? 1 : 0);
     chip8->SetDrawFlag(true);
+    if (Quirks & QUIRK_DISPLAY_WAIT)
+        chip8->WaitForNextFrame();
     return;
 }
 
@@ -356,7 +500,7 @@ void Instructions::SkipIfKeyPressed(uint16_t opc, Chip8* chip8)
 
     if (chip8->IsKeyPressed(regVal))
     {
-        chip8->SetProgramCounter(chip8->GetProgramCounter() + 2);
+        chip8->SkipNextInstruction();
         Debug::Log("Pressed\n");
     }
     else
@@ -374,7 +518,7 @@ void Instructions::SkipIfKeyNotPressed(uint16_t opc, Chip8* chip8)
 
     if (!chip8->IsKeyPressed(regVal))
     {
-        chip8->SetProgramCounter(chip8->GetProgramCounter() + 2);
+        chip8->SkipNextInstruction();
         Debug::Log("Not Pressed\n");
     }
     else
@@ -395,11 +539,10 @@ void Instructions::WaitForNextKeyPress(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex = (opc & 0x0F00) >> 8;
 
-    Debug::Log("0x%04X: WaitForNextKeyPress V[%d] = ... ", opc, regIndex);
-    uint8_t key = chip8->PollEvents(true);
+    Debug::Log("0x%04X: WaitForNextKeyPress V[%d]\n", opc, regIndex);
 
-    chip8->SetRegister(regIndex, key);
-    Debug::Log("%d\n", key);
+    // doesn't block. The machine stops executing until the host reports a key press
+    chip8->WaitForKeyPress(regIndex);
 }
 
 void Instructions::SetDelayTimer(uint16_t opc, Chip8* chip8)
@@ -439,6 +582,16 @@ void Instructions::SetIndexToFontIndex(uint16_t opc, Chip8* chip8)
     chip8->SetIndex(addr);
 }
 
+void Instructions::SetIndexToBigFontIndex(uint16_t opc, Chip8* chip8)
+{
+    uint8_t regIndex = (opc & 0x0F00) >> 8;
+    uint8_t regVal = chip8->GetRegister(regIndex);
+    uint16_t addr = ((regVal & 0xF) * 10) + BIG_FONT_START_ADDR;
+
+    Debug::Log("0x%04X: SetIndexToBigFontIndex index for V[%d] (0x%X) is 0x%04X\n", opc, regIndex, regVal, addr);
+    chip8->SetIndex(addr);
+}
+
 void Instructions::StoreBCDValInIndex(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex = (opc & 0x0F00) >> 8;
@@ -454,10 +607,11 @@ void Instructions::StoreBCDValInIndex(uint16_t opc, Chip8* chip8)
     chip8->SetMemory(chip8->GetIndex() + 2, c);
 }
 
+template <unsigned Quirks>
 void Instructions::DumpRegistersToMemory(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex = (opc & 0x0F00) >> 8;
-    uint16_t I = chip8->GetIndex();
+    uint32_t I = chip8->GetIndex();
 
     Debug::Log("0x%04X: DumpRegistersToMemory V[0] to V[%d] starting at Memory[0x%X]\n", opc, regIndex, I);
     for (int i = 0; i <= regIndex; ++i)
@@ -465,12 +619,16 @@ void Instructions::DumpRegistersToMemory(uint16_t opc, Chip8* chip8)
         chip8->SetMemory(I + i, chip8->GetRegister(i));
         Debug::Log("\t[0x%X] = V[%d] = 0x%X\n", I+i, i, chip8->GetRegister(i));
     }
+
+    if (Quirks & QUIRK_INCREMENT_INDEX)
+        chip8->SetIndex(I + regIndex + 1);
 }
 
+template <unsigned Quirks>
 void Instructions::LoadRegistersFromMemory(uint16_t opc, Chip8* chip8)
 {
     uint8_t regIndex = (opc & 0x0F00) >> 8;
-    uint16_t I = chip8->GetIndex();
+    uint32_t I = chip8->GetIndex();
 
     Debug::Log("0x%04X: LoadRegistersFromMemory V[0] to V[%d] starting at Memory[0x%X]\n", opc, regIndex, I);
     for (int i = 0; i <= regIndex; ++i)
@@ -478,4 +636,229 @@ void Instructions::LoadRegistersFromMemory(uint16_t opc, Chip8* chip8)
         chip8->SetRegister(i, chip8->GetMemory(I + i));
         Debug::Log("\tV[%d] = 0x%X\n", i, chip8->GetMemory(I+i));
     }
+
+    if (Quirks & QUIRK_INCREMENT_INDEX)
+        chip8->SetIndex(I + regIndex + 1);
 }
+
+void Instructions::DumpRegistersToRplFlags(uint16_t opc, Chip8* chip8)
+{
+    uint8_t regIndex = (opc & 0x0F00) >> 8;
+
+    Debug::Log("0x%04X: DumpRegistersToRplFlags V[0] to V[%d]\n", opc, regIndex);
+    for (int i = 0; i <= regIndex; ++i)
+        chip8->SetRplFlag(i, chip8->GetRegister(i));
+}
+
+void Instructions::LoadRegistersFromRplFlags(uint16_t opc, Chip8* chip8)
+{
+    uint8_t regIndex = (opc & 0x0F00) >> 8;
+
+    Debug::Log("0x%04X: LoadRegistersFromRplFlags V[0] to V[%d]\n", opc, regIndex);
+    for (int i = 0; i <= regIndex; ++i)
+        chip8->SetRegister(i, chip8->GetRplFlag(i));
+}
+
+void Instructions::LoadLongIndex(uint16_t opc, Chip8* chip8)
+{
+    // the address is the next 2 bytes, which the program counter then skips
+    uint16_t pc = chip8->GetProgramCounter();
+    uint16_t addr = chip8->GetMemory(pc) << 8 | chip8->GetMemory(pc + 1);
+
+    Debug::Log("0x%04X: LoadLongIndex 0x%04X\n", opc, addr);
+    chip8->SetIndex(addr);
+    chip8->SetProgramCounter(pc + 2);
+}
+
+void Instructions::SelectPlanes(uint16_t opc, Chip8* chip8)
+{
+    uint8_t planes = (opc & 0x0F00) >> 8;
+
+    Debug::Log("0x%04X: SelectPlanes %d\n", opc, planes);
+    chip8->SelectPlanes(planes);
+}
+
+void Instructions::LoadAudioPattern(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: LoadAudioPattern from Memory[0x%X]\n", opc, chip8->GetIndex());
+    chip8->LoadAudioPattern(chip8->GetIndex());
+}
+
+void Instructions::SetPitch(uint16_t opc, Chip8* chip8)
+{
+    uint8_t regIndex = (opc & 0x0F00) >> 8;
+    uint8_t regVal = chip8->GetRegister(regIndex);
+
+    Debug::Log("0x%04X: SetPitch = V[%d] = %d\n", opc, regIndex, regVal);
+    chip8->SetPitch(regVal);
+}
+
+void Instructions::MegaModeOff(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: MegaModeOff\n", opc);
+
+    chip8->SetMegaMode(false);
+    chip8->SetDrawFlag(true);
+}
+
+void Instructions::MegaModeOn(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: MegaModeOn\n", opc);
+
+    chip8->SetMegaMode(true);
+    chip8->SetDrawFlag(true);
+}
+
+void Instructions::LoadMegaIndex(uint16_t opc, Chip8* chip8)
+{
+    // the low 16 bits of the address are the next 2 bytes, which the program counter then skips
+    uint16_t pc = chip8->GetProgramCounter();
+    uint32_t addr = (uint32_t)(opc & 0x00FF) << 16 | chip8->GetMemory(pc) << 8 | chip8->GetMemory(pc + 1);
+
+    Debug::Log("0x%04X: LoadMegaIndex 0x%06X\n", opc, addr);
+    chip8->SetIndex(addr);
+    chip8->SetProgramCounter(pc + 2);
+}
+
+void Instructions::LoadPalette(uint16_t opc, Chip8* chip8)
+{
+    uint8_t count = opc & 0x00FF;
+
+    Debug::Log("0x%04X: LoadPalette %d colors from Memory[0x%X]\n", opc, count, chip8->GetIndex());
+    chip8->LoadPalette(chip8->GetIndex(), count);
+}
+
+void Instructions::SetSpriteWidth(uint16_t opc, Chip8* chip8)
+{
+    // 0 is 256 pixels
+    int width = (opc & 0x00FF) == 0 ? 256 : opc & 0x00FF;
+
+    Debug::Log("0x%04X: SetSpriteWidth %d\n", opc, width);
+    chip8->SetSpriteSize(width, chip8->GetMegaScreen().GetSpriteHeight());
+}
+
+void Instructions::SetSpriteHeight(uint16_t opc, Chip8* chip8)
+{
+    // 0 is 256 pixels
+    int height = (opc & 0x00FF) == 0 ? 256 : opc & 0x00FF;
+
+    Debug::Log("0x%04X: SetSpriteHeight %d\n", opc, height);
+    chip8->SetSpriteSize(chip8->GetMegaScreen().GetSpriteWidth(), height);
+}
+
+void Instructions::SetScreenAlpha(uint16_t opc, Chip8* chip8)
+{
+    uint8_t alpha = opc & 0x00FF;
+
+    Debug::Log("0x%04X: SetScreenAlpha %d\n", opc, alpha);
+    chip8->SetScreenAlpha(alpha);
+}
+
+void Instructions::PlayDigitizedSound(uint16_t opc, Chip8* chip8)
+{
+    // N = 0 loops the sound, anything else plays it once
+    bool loop = (opc & 0x000F) == 0;
+
+    Debug::Log("0x%04X: PlayDigitizedSound from Memory[0x%X]%s\n", opc, chip8->GetIndex(), loop ? " looped" : "");
+    chip8->PlayDigitizedSound(chip8->GetIndex(), loop);
+}
+
+void Instructions::StopDigitizedSound(uint16_t opc, Chip8* chip8)
+{
+    Debug::Log("0x%04X: StopDigitizedSound\n", opc);
+
+    chip8->StopDigitizedSound();
+}
+
+void Instructions::SetBlendMode(uint16_t opc, Chip8* chip8)
+{
+    uint8_t mode = opc & 0x000F;
+
+    Debug::Log("0x%04X: SetBlendMode %d\n", opc, mode);
+    chip8->SetBlendMode(mode);
+}
+
+void Instructions::SetCollisionColor(uint16_t opc, Chip8* chip8)
+{
+    uint8_t index = opc & 0x00FF;
+
+    Debug::Log("0x%04X: SetCollisionColor %d\n", opc, index);
+    chip8->SetCollisionColor(index);
+}
+
+// moves the program counter past the next instruction of a superinstruction, like Tick does for each instruction
+static void AdvanceProgramCounter(Chip8* chip8)
+{
+    chip8->SetProgramCounter(chip8->GetProgramCounter() + 2);
+}
+
+int Instructions::LoadConstPair(uint16_t opc, uint16_t next, uint16_t /*last*/, Chip8* chip8)
+{
+    LoadConst(opc, chip8);
+    AdvanceProgramCounter(chip8);
+    LoadConst(next, chip8);
+    return 2;
+}
+
+template <unsigned Quirks, bool SetFlag>
+int Instructions::SetIndexAndDraw(uint16_t opc, uint16_t next, uint16_t /*last*/, Chip8* chip8)
+{
+    SetIndex(opc, chip8);
+    AdvanceProgramCounter(chip8);
+    DrawSprite<Quirks, SetFlag>(next, chip8);
+    return 2;
+}
+
+int Instructions::WaitForDelayTimer(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8)
+{
+    GetDelayTimerValue(opc, chip8);
+    AdvanceProgramCounter(chip8);
+
+    // the jump is only reached if the skip isn't taken
+    const uint16_t jumpAddress = chip8->GetProgramCounter();
+    SkipIfEqualConst(next, chip8);
+    if (chip8->GetProgramCounter() != jumpAddress)
+        return 2;
+
+    AdvanceProgramCounter(chip8);
+    Jump(last, chip8);
+    return 3;
+}
+
+int Instructions::CountAndSkipIfEqual(uint16_t opc, uint16_t next, uint16_t /*last*/, Chip8* chip8)
+{
+    AddConst(opc, chip8);
+    AdvanceProgramCounter(chip8);
+    SkipIfEqualConst(next, chip8);
+    return 2;
+}
+
+// every profile's handlers are compiled here, for Chip8::SetQuirkProfile to pick from
+#define INSTANTIATE_QUIRK_HANDLERS(quirks) \
+    template void Instructions::LoadOr<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::LoadAnd<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::LoadXor<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::ShiftRight<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::ShiftLeft<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::ShiftRight<quirks, false>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::ShiftLeft<quirks, false>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::JumpOffset<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::DrawSprite<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::DrawSprite<quirks, false>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::DumpRegistersToMemory<quirks>(uint16_t opc, Chip8* chip8); \
+    template void Instructions::LoadRegistersFromMemory<quirks>(uint16_t opc, Chip8* chip8); \
+    template int Instructions::SetIndexAndDraw<quirks>(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8); \
+    template int Instructions::SetIndexAndDraw<quirks, false>(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8);
+
+INSTANTIATE_QUIRK_HANDLERS(QUIRKS_DEFAULT_FLAGS)
+INSTANTIATE_QUIRK_HANDLERS(QUIRKS_COSMAC_FLAGS)
+INSTANTIATE_QUIRK_HANDLERS(QUIRKS_SCHIP_FLAGS)
+INSTANTIATE_QUIRK_HANDLERS(QUIRKS_XOCHIP_FLAGS)
+
+// the rest of the instructions that set VF, with and without the flag
+template void Instructions::AddVal<true>(uint16_t opc, Chip8* chip8);
+template void Instructions::AddVal<false>(uint16_t opc, Chip8* chip8);
+template void Instructions::SubVal<true>(uint16_t opc, Chip8* chip8);
+template void Instructions::SubVal<false>(uint16_t opc, Chip8* chip8);
+template void Instructions::SubValInverse<true>(uint16_t opc, Chip8* chip8);
+template void Instructions::SubValInverse<false>(uint16_t opc, Chip8* chip8);
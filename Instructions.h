@@ -7,12 +7,33 @@ public:
     // Do nothing
     static void Null(uint16_t opc, Chip8* chip8);
 
-    // 00E0 - Clear the display
+    // 00E0 - Clear the display. In MEGA-CHIP 256x192 mode this shows the page drawn so far and clears the other one
     static void Clear(uint16_t opc, Chip8* chip8);
 
     // 00EE - Return from a subroutine.
     static void Return(uint16_t opc, Chip8* chip8);
 
+    // 00CN - Scroll the display down N pixels. (SUPER-CHIP)
+    static void ScrollDown(uint16_t opc, Chip8* chip8);
+
+    // 00DN - Scroll the selected planes up N pixels. (XO-CHIP) 00BN does the same on MEGA-CHIP
+    static void ScrollUp(uint16_t opc, Chip8* chip8);
+
+    // 00FB - Scroll the display right 4 pixels. (SUPER-CHIP)
+    static void ScrollRight(uint16_t opc, Chip8* chip8);
+
+    // 00FC - Scroll the display left 4 pixels. (SUPER-CHIP)
+    static void ScrollLeft(uint16_t opc, Chip8* chip8);
+
+    // 00FD - Exit the interpreter. (SUPER-CHIP) The machine spins on this instruction from then on.
+    static void Exit(uint16_t opc, Chip8* chip8);
+
+    // 00FE - Switch to the 64x32 display and clear it. (SUPER-CHIP)
+    static void LowResolution(uint16_t opc, Chip8* chip8);
+
+    // 00FF - Switch to the 128x64 display and clear it. (SUPER-CHIP)
+    static void HighResolution(uint16_t opc, Chip8* chip8);
+
     // 1nnn - Jump to location nnn.
     static void Jump(uint16_t opc, Chip8* chip8);
 
@@ -28,6 +49,12 @@ public:
     // 5xy0 - Skip next instruction if Vx = Vy.
     static void SkipIfEqualVal(uint16_t opc, Chip8* chip8);
 
+    // 5xy2 - Store Vx to Vy (in that order, so possibly backwards) in memory starting at address I. I is left unmodified. (XO-CHIP)
+    static void SaveRegisterRange(uint16_t opc, Chip8* chip8);
+
+    // 5xy3 - Load Vx to Vy (in that order, so possibly backwards) from memory starting at address I. I is left unmodified. (XO-CHIP)
+    static void LoadRegisterRange(uint16_t opc, Chip8* chip8);
+
     // 6xkk - Set Vx = kk.
     static void LoadConst(uint16_t opc, Chip8* chip8);
 
@@ -37,28 +64,39 @@ public:
     // 8xy0 - Set Vx = Vy.
     static void LoadVal(uint16_t opc, Chip8* chip8);
 
-    // 8XY1 - Sets VX to VX or VY. (Bitwise OR operation) 
+    // 8XY1 - Sets VX to VX or VY. (Bitwise OR operation) VF is cleared with QUIRK_VF_RESET
+    template <unsigned Quirks>
     static void LoadOr(uint16_t opc, Chip8* chip8);
 
-    // 8XY2 - Sets VX to VX and VY. (Bitwise AND operation) 
+    // 8XY2 - Sets VX to VX and VY. (Bitwise AND operation) VF is cleared with QUIRK_VF_RESET
+    template <unsigned Quirks>
     static void LoadAnd(uint16_t opc, Chip8* chip8);
 
-    // 8XY3 - Sets VX to VX xor VY. 
+    // 8XY3 - Sets VX to VX xor VY. VF is cleared with QUIRK_VF_RESET
+    template <unsigned Quirks>
     static void LoadXor(uint16_t opc, Chip8* chip8);
 
     // 8XY4 - Adds VY to VX. VF is set to 1 when there's a carry, and to 0 when there isn't. 
+    // Without SetFlag VF is left alone, for where FlagLiveness found the flag is dead. The same goes for 8XY5 - 8XYE and DXYN
+    template <bool SetFlag = true>
     static void AddVal(uint16_t opc, Chip8* chip8);
 
     // 8XY5 - VY is subtracted from VX. VF is set to 0 when there's a borrow, and 1 when there isn't. 
+    template <bool SetFlag = true>
     static void SubVal(uint16_t opc, Chip8* chip8);
 
     // 8XY6 - Stores the least significant bit of VX in VF and then shifts VX to the right by 1.[2] 
+    // With QUIRK_SHIFT_VY it is VY that is shifted into VX
+    template <unsigned Quirks, bool SetFlag = true>
     static void ShiftRight(uint16_t opc, Chip8* chip8);
 
     // 8XY7 - Sets VX to VY minus VX. VF is set to 0 when there's a borrow, and 1 when there isn't. 
+    template <bool SetFlag = true>
     static void SubValInverse(uint16_t opc, Chip8* chip8);
 
     // 8XYE - Stores the most significant bit of VX in VF and then shifts VX to the left by 1.
+    // With QUIRK_SHIFT_VY it is VY that is shifted into VX
+    template <unsigned Quirks, bool SetFlag = true>
     static void ShiftLeft(uint16_t opc, Chip8* chip8);
 
     // 9XY0  - Skips the next instruction if VX doesn't equal VY.
@@ -67,7 +105,8 @@ public:
     // ANNN - Sets I to the address NNN. 
     static void SetIndex(uint16_t opc, Chip8* chip8);
 
-    // BNNN - Jumps to the address NNN plus V0. 
+    // BNNN - Jumps to the address NNN plus V0. With QUIRK_JUMP_VX it is BXNN, a jump to XNN plus VX
+    template <unsigned Quirks>
     static void JumpOffset(uint16_t opc, Chip8* chip8);
 
     // CXNN - Sets VX to the result of a bitwise and operation on a random number (Typically: 0 to 255) and NN. 
@@ -76,6 +115,10 @@ public:
     // DXYN - Draws a sprite at coordinate (VX, VY) that has a width of 8 pixels and a height of N pixels. 
     // Each row of 8 pixels is read as bit-coded starting from memory location I; I value doesnt change after the execution of this instruction.
     // As described above, VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesnt happen
+    // DXY0 draws a 16x16 sprite of 32 bytes instead. (SUPER-CHIP) The sprite starts at (VX, VY) wrapped to the screen, anything past the edges is clipped.
+    // In MEGA-CHIP 256x192 mode the sprite is one palette index per pixel, sized by 03NN / 04NN, and VF is set if it covers a pixel of the collision color.
+    // QUIRK_WRAP_SPRITES wraps the rest of the sprite around the edges too, QUIRK_DISPLAY_WAIT ends the frame after drawing.
+    template <unsigned Quirks, bool SetFlag = true>
     static void DrawSprite(uint16_t opc, Chip8* chip8);
 
     // EX9E - Skips the next instruction if the key stored in VX is pressed. (Usually the next instruction is a jump to skip a code block) 
@@ -87,7 +130,7 @@ public:
     // FX07 - Sets VX to the value of the delay timer. 
     static void GetDelayTimerValue(uint16_t opc, Chip8* chip8);
 
-    // FX0A - A key press is awaited, and then stored in VX. (Blocking Operation. All instruction halted until next key event)
+    // FX0A - A key press is awaited, and then stored in VX. (Execution is suspended until the next key press, timers keep running)
     static void WaitForNextKeyPress(uint16_t opc, Chip8* chip8);
 
     // FX15 - Sets the delay timer to VX. 
@@ -102,14 +145,90 @@ public:
     // FX29 - Sets I to the location of the sprite for the character in VX. Characters 0-F (in hexadecimal) are represented by a 4x5 font. 
     static void SetIndexToFontIndex(uint16_t opc, Chip8* chip8);
 
+    // FX30 - Sets I to the location of the 8x10 sprite for the digit in VX. (SUPER-CHIP)
+    static void SetIndexToBigFontIndex(uint16_t opc, Chip8* chip8);
+
     // FX33 - Stores the binary-coded decimal representation of VX, with the most significant of three digits at the address in I,
     // the middle digit at I plus 1, and the least significant digit at I plus 2. (In other words, take the decimal representation of VX,
     // place the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.) 
     static void StoreBCDValInIndex(uint16_t opc, Chip8* chip8);
 
     // FX55 - Stores V0 to VX (including VX) in memory starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified. 
+    // With QUIRK_INCREMENT_INDEX I is left at I + X + 1
+    template <unsigned Quirks>
     static void DumpRegistersToMemory(uint16_t opc, Chip8* chip8);
 
     // FX65 - Fills V0 to VX (including VX) with values from memory starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified. 
+    // With QUIRK_INCREMENT_INDEX I is left at I + X + 1
+    template <unsigned Quirks>
     static void LoadRegistersFromMemory(uint16_t opc, Chip8* chip8);
+
+    // FX75 - Stores V0 to VX (including VX) in the RPL user flags. (SUPER-CHIP)
+    static void DumpRegistersToRplFlags(uint16_t opc, Chip8* chip8);
+
+    // FX85 - Fills V0 to VX (including VX) from the RPL user flags. (SUPER-CHIP)
+    static void LoadRegistersFromRplFlags(uint16_t opc, Chip8* chip8);
+
+    // F000 NNNN - Sets I to the 16-bit address NNNN that follows the instruction. The instruction is 4 bytes long. (XO-CHIP)
+    static void LoadLongIndex(uint16_t opc, Chip8* chip8);
+
+    // FN01 - Selects the bitplanes N (a bit mask) that drawing, clearing and scrolling apply to. (XO-CHIP)
+    static void SelectPlanes(uint16_t opc, Chip8* chip8);
+
+    // F002 - Loads the 16 byte audio pattern from memory starting at address I. (XO-CHIP)
+    static void LoadAudioPattern(uint16_t opc, Chip8* chip8);
+
+    // FX3A - Sets the pitch the audio pattern plays at to VX. (XO-CHIP)
+    static void SetPitch(uint16_t opc, Chip8* chip8);
+
+    // 0010 - Switches MEGA-CHIP 256x192 mode off. (MEGA-CHIP)
+    static void MegaModeOff(uint16_t opc, Chip8* chip8);
+
+    // 0011 - Switches MEGA-CHIP 256x192 mode on. Drawing, clearing and scrolling go to its screen from now on. (MEGA-CHIP)
+    static void MegaModeOn(uint16_t opc, Chip8* chip8);
+
+    // 01NN NNNN - Sets I to the 24-bit address NNNNNN. The instruction is 4 bytes long. (MEGA-CHIP)
+    static void LoadMegaIndex(uint16_t opc, Chip8* chip8);
+
+    // 02NN - Loads NN ARGB colors from memory starting at address I into palette entries 1 to NN. (MEGA-CHIP)
+    static void LoadPalette(uint16_t opc, Chip8* chip8);
+
+    // 03NN - Sets the width of the sprites DXYN draws to NN pixels, or 256 if NN is 0. (MEGA-CHIP)
+    static void SetSpriteWidth(uint16_t opc, Chip8* chip8);
+
+    // 04NN - Sets the height of the sprites DXYN draws to NN pixels, or 256 if NN is 0. (MEGA-CHIP)
+    static void SetSpriteHeight(uint16_t opc, Chip8* chip8);
+
+    // 05NN - Sets the alpha the screen is shown with to NN. (MEGA-CHIP)
+    static void SetScreenAlpha(uint16_t opc, Chip8* chip8);
+
+    // 060N - Plays the digitized sound at address I, looped if N is 0. (MEGA-CHIP)
+    static void PlayDigitizedSound(uint16_t opc, Chip8* chip8);
+
+    // 0700 - Stops the digitized sound. (MEGA-CHIP)
+    static void StopDigitizedSound(uint16_t opc, Chip8* chip8);
+
+    // 080N - Sets the blend mode of the sprites drawn from now on. (MEGA-CHIP)
+    static void SetBlendMode(uint16_t opc, Chip8* chip8);
+
+    // 09NN - Sets the palette index that DXYN reports collisions with to NN. (MEGA-CHIP)
+    static void SetCollisionColor(uint16_t opc, Chip8* chip8);
+
+    // Superinstructions. Each runs a common sequence of instructions with a single dispatch, exactly as the
+    // instructions would run one by one. opc is the first opcode, next and last the ones after it (last is only
+    // used by three instruction sequences), and the program counter already points past opc.
+    // Each returns the number of instructions it ran.
+
+    // 6XKK 6YKK - Set Vx = kk, then Vy = kk.
+    static int LoadConstPair(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8);
+
+    // ANNN DXYN - Set I = nnn and draw the sprite there. Without SetFlag the draw leaves VF alone, like DrawSprite.
+    template <unsigned Quirks, bool SetFlag = true>
+    static int SetIndexAndDraw(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8);
+
+    // FX07 3XKK 1NNN - Read the delay timer into Vx, and jump back to nnn unless it's down to kk. Runs 2 instructions if it is.
+    static int WaitForDelayTimer(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8);
+
+    // 7XKK 3XKK - Add kk to a loop counter and skip the next instruction once it reaches kk.
+    static int CountAndSkipIfEqual(uint16_t opc, uint16_t next, uint16_t last, Chip8* chip8);
 };
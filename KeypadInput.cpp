@@ -0,0 +1,169 @@
+#include <chrono>
+#include "Chip8.h"
+#include "KeypadInput.h"
+#include "LatencyHistogram.h"
+
+// the 4x4 block of keys under 1 2 3 4 emulates the chip8 keypad. Scancodes keep it in place on any layout
+static const SDL_Scancode hostKeys[16] =
+{
+    SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3, SDL_SCANCODE_4,
+    SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_R,
+    SDL_SCANCODE_A, SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_F,
+    SDL_SCANCODE_Z, SDL_SCANCODE_X, SDL_SCANCODE_C, SDL_SCANCODE_V,
+};
+
+KeypadInput::KeypadInput() :
+    m_quitRequested(false),
+    m_keys(0),
+    m_pendingPressed(0),
+    m_pendingReleased(0),
+    m_appliedKeys(0),
+    m_lastInputTime(0),
+    m_unreadPresses(0)
+{
+    m_pressTimes.fill(0);
+
+    // keys 0 - F in order, row by row
+    m_scancodeMap.fill(-1);
+    for (int i = 0; i < 16; ++i)
+        m_scancodeMap[hostKeys[i]] = (int8_t)i;
+}
+
+void KeypadInput::SetKeymap(const std::array<uint8_t, 16>& keymap)
+{
+    for (int i = 0; i < 16; ++i)
+        m_scancodeMap[hostKeys[i]] = (int8_t)(keymap[i] & 0xF);
+}
+
+void KeypadInput::PollEvents()
+{
+    SDL_Event event;
+    while (SDL_PollEvent(&event))
+    {
+        switch (event.type)
+        {
+        case SDL_QUIT:
+            m_quitRequested.store(true, std::memory_order_release);
+            break;
+        case SDL_KEYDOWN:
+        case SDL_KEYUP:
+        {
+            const SDL_Scancode scancode = event.key.keysym.scancode;
+            if (event.key.repeat || scancode < 0 || scancode >= SDL_NUM_SCANCODES || m_scancodeMap[scancode] < 0)
+                break;
+
+            const uint16_t keyBit = 1 << m_scancodeMap[scancode];
+            if (event.type == SDL_KEYDOWN)
+            {
+                m_keys |= keyBit;
+                m_pendingPressed |= keyBit;
+            }
+            else
+            {
+                m_keys &= ~keyBit;
+                m_pendingReleased |= keyBit;
+            }
+            break;
+        }
+        }
+    }
+
+    PublishPending();
+}
+
+void KeypadInput::PublishKeys(uint16_t keys)
+{
+    m_pendingPressed |= keys & ~m_keys;
+    m_pendingReleased |= m_keys & ~keys;
+    m_keys = keys;
+    PublishPending();
+}
+
+void KeypadInput::PublishPending()
+{
+    if (m_pendingPressed == 0 && m_pendingReleased == 0)
+        return;
+
+    KeypadState state;
+    state.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    state.keys = m_keys;
+    state.pressed = m_pendingPressed;
+    state.released = m_pendingReleased;
+
+    // if the emulation thread has fallen behind, keep the edges and publish them with the next frame instead
+    if (m_queue.Push(state))
+    {
+        m_pendingPressed = 0;
+        m_pendingReleased = 0;
+    }
+}
+
+void KeypadInput::Apply(Chip8& chip8)
+{
+    chip8.ClearKeysRead();
+
+    const uint16_t previousKeys = m_appliedKeys;
+    uint16_t pressed = 0;
+    uint16_t released = 0;
+
+    KeypadState state;
+    while (m_queue.Pop(state))
+    {
+        m_appliedKeys = state.keys;
+        pressed |= state.pressed;
+        released |= state.released;
+        m_lastInputTime = state.timestamp;
+
+        // a key pressed again before the guest read it is timed from the newer press
+        m_unreadPresses |= state.pressed;
+        for (int i = 0; i < 16; ++i)
+        {
+            if ((state.pressed >> i) & 1)
+                m_pressTimes[i] = state.timestamp;
+        }
+    }
+
+    // keys that were released and pressed again since the last frame go up first so the guest sees a new press
+    const uint16_t repressed = previousKeys & released & pressed & m_appliedKeys;
+    if (repressed != 0)
+        chip8.SetKeyboardState(previousKeys & ~repressed);
+
+    // keys that were pressed and released again since the last frame are held for this frame
+    chip8.SetKeyboardState(m_appliedKeys | (pressed & ~m_appliedKeys));
+}
+
+void KeypadInput::CollectReadPresses(uint16_t keysRead, KeyPresses& presses)
+{
+    presses.keys = keysRead & m_unreadPresses;
+    for (int i = 0; i < 16; ++i)
+    {
+        if ((presses.keys >> i) & 1)
+            presses.keyTimes[i] = m_pressTimes[i];
+    }
+
+    // held keys stay readable. Taps were only held for the frame that just ran
+    m_unreadPresses &= ~keysRead & m_appliedKeys;
+}
+
+void KeyPresses::Merge(const KeyPresses& other)
+{
+    for (int i = 0; i < 16; ++i)
+    {
+        if (((other.keys >> i) & 1) && (((keys >> i) & 1) == 0 || other.keyTimes[i] < keyTimes[i]))
+            keyTimes[i] = other.keyTimes[i];
+    }
+
+    keys |= other.keys;
+}
+
+void KeyPresses::Measure(uint64_t presentTime, std::array<uint64_t, 16>& measured, LatencyHistogram& latency) const
+{
+    for (int i = 0; i < 16; ++i)
+    {
+        if (((keys >> i) & 1) && keyTimes[i] > measured[i])
+        {
+            latency.Add(presentTime - keyTimes[i]);
+            measured[i] = keyTimes[i];
+        }
+    }
+}
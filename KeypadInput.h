@@ -0,0 +1,97 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <SDL.h>
+#include "SpscQueue.h"
+
+class Chip8;
+class LatencyHistogram;
+
+// key presses the guest has read, with the time each press was published by the UI thread.
+// Travels with the frame the presses were read in until that frame is presented.
+struct KeyPresses
+{
+    // bit n is set if keyTimes[n] holds a press of key n
+    uint16_t keys;
+    std::array<uint64_t, 16> keyTimes;
+
+    // adds the presses of other. A key pressed in both keeps the earlier press
+    void Merge(const KeyPresses& other);
+
+    // records the time from each press to presentTime in latency, once per press. measured holds the time of the
+    // last press of each key that was recorded, since a press travels with every frame until one is known to be shown
+    void Measure(uint64_t presentTime, std::array<uint64_t, 16>& measured, LatencyHistogram& latency) const;
+};
+
+// Moves keypad input from the SDL event thread to the emulation thread.
+// The UI thread drains all pending SDL events once per frame, maps them through a flat scancode table and
+// publishes the resulting 16-bit keypad state over a lock-free queue. The emulation thread applies everything
+// published since its last frame. Keys that were pressed and released within one frame are still reported as
+// held for a frame so that short taps reach the guest.
+class KeypadInput
+{
+public:
+    KeypadInput();
+
+    // keymap[n] is the chip8 key pressed by the nth key of the 1234 / QWER / ASDF / ZXCV block. Call before polling
+    void SetKeymap(const std::array<uint8_t, 16>& keymap);
+
+    // UI thread. Drains every pending SDL event and publishes the keypad state if it changed
+    void PollEvents();
+
+    // UI thread. Publishes keys as the held keys without going through SDL, for driving the input path headlessly
+    void PublishKeys(uint16_t keys);
+
+    // true once the window has been closed
+    bool IsQuitRequested() const { return m_quitRequested.load(std::memory_order_acquire); }
+
+    // emulation thread. Starts a frame: forgets the keys the machine read in the last one (Chip8::ClearKeysRead)
+    // and applies all keypad states published since the last call to it. A press that completes an FX0A counts as
+    // read by the frame that starts here
+    void Apply(Chip8& chip8);
+
+    // emulation thread. Time the last applied keypad state was published, in steady_clock nanoseconds
+    uint64_t GetLastInputTime() const { return m_lastInputTime; }
+
+    // emulation thread. Call after running a frame with the keys the guest read during it (Chip8::GetKeysRead).
+    // Stores the presses that were read for the first time in presses. Presses of keys that are no
+    // longer held and weren't read are forgotten, as the guest can't see them anymore
+    void CollectReadPresses(uint16_t keysRead, KeyPresses& presses);
+
+private:
+    // publishes the current keys and the edges gathered since the last publish
+    void PublishPending();
+
+    struct KeypadState
+    {
+        // steady_clock time the events were drained, in nanoseconds
+        uint64_t timestamp;
+
+        // keys held after all drained events. Bit n is key n
+        uint16_t keys;
+
+        // keys that went down / up while draining, even if they went back up / down afterwards
+        uint16_t pressed;
+        uint16_t released;
+    };
+
+    // maps SDL scancodes to keypad indices, -1 for unmapped keys
+    std::array<int8_t, SDL_NUM_SCANCODES> m_scancodeMap;
+
+    SpscQueue<KeypadState, 256> m_queue;
+    std::atomic<bool> m_quitRequested;
+
+    // UI thread only. Edges are kept until they have been published
+    uint16_t m_keys;
+    uint16_t m_pendingPressed;
+    uint16_t m_pendingReleased;
+
+    // emulation thread only
+    uint16_t m_appliedKeys;
+    uint64_t m_lastInputTime;
+
+    // emulation thread only. Presses the guest hasn't read yet and when they were published
+    uint16_t m_unreadPresses;
+    std::array<uint64_t, 16> m_pressTimes;
+};
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <cstdio>
+#include "KeypadSpeculator.h"
+
+KeypadSpeculator::KeypadSpeculator(int maxBranches, unsigned threadCount) :
+    m_maxBranches(std::min(std::max(maxBranches, 1), 16)),
+    m_activeBranches(0),
+    m_lastKeys(0),
+    m_framesSpeculated(0),
+    m_branchesRun(0),
+    m_branchesCommitted(0),
+    m_pool(threadCount)
+{
+    m_pressCounts.fill(0);
+}
+
+int KeypadSpeculator::Init(uint32_t tickrate, MachineType machine, QuirkProfile quirks)
+{
+    m_machines.clear();
+    m_branches.resize(m_maxBranches);
+    for (int i = 0; i < m_maxBranches; ++i)
+    {
+        m_machines.push_back(std::unique_ptr<Chip8>(new Chip8()));
+        const int errorCode = m_machines.back()->Init(tickrate, machine, quirks);
+        if (errorCode != 0)
+            return errorCode;
+    }
+
+    return 0;
+}
+
+void KeypadSpeculator::Start(const Chip8& chip8, int instructionsPerFrame)
+{
+    const uint16_t heldKeys = chip8.GetKeyboardState();
+
+    // FX0A takes any key. A polling rom only reacts to the keys it reads
+    uint16_t candidates;
+    if (chip8.IsWaitingForKey())
+        candidates = (uint16_t)~heldKeys;
+    else
+        candidates = chip8.GetKeysRead() & ~heldKeys;
+
+    if (candidates == 0)
+        return;
+
+    // most frequently pressed keys first
+    std::array<uint8_t, 16> keys;
+    int keyCount = 0;
+    for (uint8_t key = 0; key < 16; ++key)
+    {
+        if ((candidates >> key) & 1)
+            keys[keyCount++] = key;
+    }
+
+    std::stable_sort(keys.begin(), keys.begin() + keyCount,
+        [this](uint8_t a, uint8_t b) { return m_pressCounts[a] > m_pressCounts[b]; });
+
+    chip8.SaveState(m_base);
+    m_activeBranches = std::min(keyCount, m_maxBranches);
+    for (int i = 0; i < m_activeBranches; ++i)
+    {
+        const uint8_t key = keys[i];
+        m_pool.Submit([this, i, key, instructionsPerFrame]() { RunBranch(i, key, instructionsPerFrame); });
+    }
+
+    ++m_framesSpeculated;
+    m_branchesRun += m_activeBranches;
+}
+
+bool KeypadSpeculator::TryCommit(Chip8& chip8)
+{
+    const uint16_t keys = chip8.GetKeyboardState();
+    const uint16_t newPresses = keys & ~m_lastKeys;
+    m_lastKeys = keys;
+    for (int i = 0; i < 16; ++i)
+    {
+        if ((newPresses >> i) & 1)
+            ++m_pressCounts[i];
+    }
+
+    if (m_activeBranches == 0)
+        return false;
+
+    m_pool.Wait();
+    const int branchCount = m_activeBranches;
+    m_activeBranches = 0;
+
+    // the keypad isn't part of the state hash, so it has to match separately
+    const uint64_t hash = chip8.GetStateHash();
+    for (int i = 0; i < branchCount; ++i)
+    {
+        if (m_branches[i].startHash == hash && m_branches[i].startKeys == keys)
+        {
+            chip8.LoadState(m_branches[i].result);
+            ++m_branchesCommitted;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void KeypadSpeculator::RunBranch(int index, uint8_t key, int instructionsPerFrame)
+{
+    Chip8& machine = *m_machines[index];
+    Branch& branch = m_branches[index];
+
+    // the same steps the real machine takes at the start of a frame in which the key goes down
+    machine.LoadState(m_base);
+    machine.ClearKeysRead();
+    machine.SetKeyboardState(machine.GetKeyboardState() | (1 << key));
+    branch.startHash = machine.GetStateHash();
+    branch.startKeys = machine.GetKeyboardState();
+
+    machine.RunFrame(instructionsPerFrame);
+    machine.SaveState(branch.result);
+}
+
+void KeypadSpeculator::PrintStats() const
+{
+    printf("Speculation: %llu branches run over %llu frames, %llu committed (%.1f%% useful)\n",
+        (unsigned long long)m_branchesRun, (unsigned long long)m_framesSpeculated, (unsigned long long)m_branchesCommitted,
+        m_branchesRun ? m_branchesCommitted * 100.0 / m_branchesRun : 0.0);
+}
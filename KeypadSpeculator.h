@@ -0,0 +1,71 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Chip8.h"
+#include "ThreadPool.h"
+
+// Speculatively runs the next frame once for every key the guest might see pressed.
+// While a rom waits on FX0A or polls the keypad there are at most 16 next inputs that matter. After each frame
+// the machine state is forked for the most likely new key presses (by press history) and each branch runs the
+// next frame on a worker thread. If the next frame starts from the same state with one of those keys pressed,
+// the precomputed result is committed instead of emulating the frame.
+class KeypadSpeculator
+{
+public:
+    // maxBranches is the number of key presses to speculate on per frame (1 - 16)
+    KeypadSpeculator(int maxBranches, unsigned threadCount = 0);
+
+    // initializes the machines the branches run on. They must be the same type, with the same quirks, as the machine being speculated on.
+    // returns 0 if no errors. Otherwise returns the Chip8::Init error code.
+    int Init(uint32_t tickrate, MachineType machine, QuirkProfile quirks);
+
+    // call after the real machine finished a frame. If it's waiting for a key or read the keypad during the frame,
+    // forks its state for the likeliest new key presses and runs the next frame of each on the workers
+    void Start(const Chip8& chip8, int instructionsPerFrame);
+
+    // call at the start of the next frame once the input has been applied. Waits for the branches and, if one of them
+    // started from exactly the current state and keypad, loads its result into chip8 and returns true.
+    // Otherwise chip8 is left alone and the frame has to be emulated as usual
+    bool TryCommit(Chip8& chip8);
+
+    // prints how many branches were run and how many of them were committed
+    void PrintStats() const;
+
+private:
+    struct Branch
+    {
+        // state hash and keypad right after the key was pressed. A frame starting from the same pair has the same result
+        uint64_t startHash;
+        uint16_t startKeys;
+
+        Chip8State result;
+    };
+
+    // runs branch index from m_base with key pressed
+    void RunBranch(int index, uint8_t key, int instructionsPerFrame);
+
+    int m_maxBranches;
+
+    // one machine and result per branch, allocated once
+    std::vector<std::unique_ptr<Chip8>> m_machines;
+    std::vector<Branch> m_branches;
+    int m_activeBranches;
+
+    // state the branches fork from. Read only while branches run
+    Chip8State m_base;
+
+    // keypad the last time Start was called, to count new presses
+    uint16_t m_lastKeys;
+
+    // number of times each key was newly pressed. Ranks the keys when there are more candidates than branches
+    std::array<uint32_t, 16> m_pressCounts;
+
+    uint64_t m_framesSpeculated;
+    uint64_t m_branchesRun;
+    uint64_t m_branchesCommitted;
+
+    // declared last so that the workers are joined before the machines they run on are destroyed
+    ThreadPool m_pool;
+};
@@ -0,0 +1,54 @@
+#include <cstdio>
+#include "LatencyHistogram.h"
+
+LatencyHistogram::LatencyHistogram() :
+    m_count(0),
+    m_max(0)
+{
+    m_buckets.fill(0);
+}
+
+void LatencyHistogram::Add(uint64_t latencyNs)
+{
+    uint64_t bucket = latencyNs / BUCKET_WIDTH_NS;
+    if (bucket >= BUCKET_COUNT)
+        bucket = BUCKET_COUNT - 1;
+
+    ++m_buckets[(size_t)bucket];
+    ++m_count;
+    if (latencyNs > m_max)
+        m_max = latencyNs;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double fraction) const
+{
+    if (m_count == 0)
+        return 0;
+
+    // rank of the sample we're after, 1 based
+    uint64_t rank = (uint64_t)(fraction * m_count + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > m_count)
+        rank = m_count;
+
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += m_buckets[i];
+        if (seen >= rank)
+        {
+            // the overflow bucket has no upper edge
+            const uint64_t upperEdge = (i + 1) * BUCKET_WIDTH_NS;
+            return upperEdge < m_max ? upperEdge : m_max;
+        }
+    }
+
+    return m_max;
+}
+
+void LatencyHistogram::Print(const char* name) const
+{
+    printf("%s: %llu samples, p50 %.1f ms, p95 %.1f ms, p99 %.1f ms, max %.1f ms\n", name, (unsigned long long)m_count,
+        GetPercentile(0.50) / 1e6, GetPercentile(0.95) / 1e6, GetPercentile(0.99) / 1e6, m_max / 1e6);
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include <array>
+#include <cstdint>
+
+// Fixed-resolution histogram of latencies.
+// Samples go into 100us buckets up to half a second, with everything slower counted in the last bucket,
+// so adding a sample is O(1) and never allocates. Percentiles are accurate to one bucket.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    // records one latency in nanoseconds
+    void Add(uint64_t latencyNs);
+
+    // number of latencies recorded
+    uint64_t GetCount() const { return m_count; }
+
+    // returns the latency in nanoseconds that the given fraction (0 - 1) of samples are at or below.
+    // Reported as the upper edge of the bucket. returns 0 if nothing was recorded
+    uint64_t GetPercentile(double fraction) const;
+
+    // slowest latency recorded, in nanoseconds
+    uint64_t GetMax() const { return m_max; }
+
+    // prints "<name>: <count> samples, p50 x ms, p95 y ms, p99 z ms, max w ms"
+    void Print(const char* name) const;
+
+private:
+    static const uint64_t BUCKET_WIDTH_NS = 100000;
+    static const int BUCKET_COUNT = 5000;
+
+    std::array<uint32_t, BUCKET_COUNT> m_buckets;
+    uint64_t m_count;
+    uint64_t m_max;
+};
@@ -0,0 +1,497 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "MegaFramebuffer.h"
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
+
+// 8-pixel words per row of a page
+#define MEGA_ROW_WORDS (MEGA_SCREEN_WIDTH / 8)
+
+// x / 255 rounded, for x up to 255 * 255. The SSE2 paths round the same way
+static uint32_t Div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// blends the sprite color s over the screen color d, channel by channel, in one of MegaBlendMode
+template <int Mode>
+static uint32_t BlendPixel(uint32_t s, uint32_t d)
+{
+    if (Mode == MEGA_BLEND_NORMAL)
+        return s;
+
+    uint32_t result = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+    {
+        const uint32_t sc = s >> shift & 0xFF;
+        const uint32_t dc = d >> shift & 0xFF;
+        uint32_t c;
+        switch (Mode)
+        {
+            case MEGA_BLEND_25:
+                c = (((sc + dc + 1) >> 1) + dc + 1) >> 1;
+                break;
+            case MEGA_BLEND_50:
+                c = (sc + dc + 1) >> 1;
+                break;
+            case MEGA_BLEND_ADD:
+                c = std::min(sc + dc, 0xFFu);
+                break;
+            default:
+                c = Div255(sc * dc);
+                break;
+        }
+        result |= c << shift;
+    }
+
+    return result;
+}
+
+#ifdef HAVE_SSE2
+// Div255 of 8 16-bit lanes
+static __m128i Div255(__m128i x)
+{
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// BlendPixel of 4 pixels
+template <int Mode>
+static __m128i BlendPixels(__m128i s, __m128i d)
+{
+    switch (Mode)
+    {
+        case MEGA_BLEND_25:
+            return _mm_avg_epu8(_mm_avg_epu8(s, d), d);
+        case MEGA_BLEND_50:
+            return _mm_avg_epu8(s, d);
+        case MEGA_BLEND_ADD:
+            return _mm_adds_epu8(s, d);
+        case MEGA_BLEND_MULTIPLY:
+        {
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i low = Div255(_mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero)));
+            const __m128i high = Div255(_mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero)));
+            return _mm_packus_epi16(low, high);
+        }
+        default:
+            return s;
+    }
+}
+#endif
+
+// draws count sprite pixels from src over dst and its colors dstColors, leaving both alone where the sprite pixel is 0.
+// The others copy their index and blend their palette color in. returns true if one landed on an index of collisionColor.
+// Compiled once per blend mode, so that the mode isn't looked at for every pixel
+template <int Mode>
+static bool BlitRow(uint8_t* dst, uint32_t* dstColors, const uint8_t* src, int count, const uint32_t* palette, uint8_t collisionColor)
+{
+    bool collision = false;
+    int i = 0;
+
+#ifdef HAVE_SSE2
+    // 16 pixels at a time: a mask of the transparent pixels picks between the old and the new index and color,
+    // and the collision test is the same compare against the screen, accumulated until the end of the row.
+    // SSE2 has no gather, so only the palette lookup goes pixel by pixel. The blend takes 4 pixels at a time
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i collide = _mm_set1_epi8((char)collisionColor);
+    __m128i hits = zero;
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i sprite = _mm_loadu_si128((const __m128i*)(src + i));
+        const __m128i transparent = _mm_cmpeq_epi8(sprite, zero);
+        if (_mm_movemask_epi8(transparent) == 0xFFFF)
+            continue;
+
+        const __m128i screen = _mm_loadu_si128((const __m128i*)(dst + i));
+        hits = _mm_or_si128(hits, _mm_andnot_si128(transparent, _mm_cmpeq_epi8(screen, collide)));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(transparent, screen), sprite));
+
+        // the byte mask widened to one 32-bit lane per pixel, 4 pixels to a register
+        const __m128i low = _mm_unpacklo_epi8(transparent, transparent);
+        const __m128i high = _mm_unpackhi_epi8(transparent, transparent);
+        const __m128i keep[4] =
+        {
+            _mm_unpacklo_epi16(low, low), _mm_unpackhi_epi16(low, low),
+            _mm_unpacklo_epi16(high, high), _mm_unpackhi_epi16(high, high),
+        };
+
+        for (int j = 0; j < 4; ++j)
+        {
+            const uint8_t* indices = src + i + j * 4;
+            const __m128i colors = _mm_set_epi32((int)palette[indices[3]], (int)palette[indices[2]], (int)palette[indices[1]], (int)palette[indices[0]]);
+
+            __m128i* pixels = (__m128i*)(dstColors + i + j * 4);
+            const __m128i old = _mm_loadu_si128(pixels);
+            const __m128i blended = BlendPixels<Mode>(colors, old);
+            _mm_storeu_si128(pixels, _mm_or_si128(_mm_and_si128(keep[j], old), _mm_andnot_si128(keep[j], blended)));
+        }
+    }
+    collision = _mm_movemask_epi8(hits) != 0;
+#endif
+
+    for (; i < count; ++i)
+    {
+        if (src[i] == 0)
+            continue;
+
+        if (dst[i] == collisionColor)
+            collision = true;
+        dst[i] = src[i];
+        dstColors[i] = BlendPixel<Mode>(palette[src[i]], dstColors[i]);
+    }
+
+    return collision;
+}
+
+typedef bool (*BlitRowFunction)(uint8_t* dst, uint32_t* dstColors, const uint8_t* src, int count, const uint32_t* palette,
+    uint8_t collisionColor);
+
+static BlitRowFunction GetBlitRow(uint8_t mode)
+{
+    switch (mode)
+    {
+        case MEGA_BLEND_25:
+            return BlitRow<MEGA_BLEND_25>;
+        case MEGA_BLEND_50:
+            return BlitRow<MEGA_BLEND_50>;
+        case MEGA_BLEND_ADD:
+            return BlitRow<MEGA_BLEND_ADD>;
+        case MEGA_BLEND_MULTIPLY:
+            return BlitRow<MEGA_BLEND_MULTIPLY>;
+        default:
+            return BlitRow<MEGA_BLEND_NORMAL>;
+    }
+}
+
+// scrolls a page of either indices or colors, filling the pixels scrolled in with 0
+template <typename Pixel>
+static void ScrollPageVertically(Pixel* page, int rows)
+{
+    const int moved = (MEGA_SCREEN_HEIGHT - std::abs(rows)) * MEGA_SCREEN_WIDTH;
+    const int cleared = std::abs(rows) * MEGA_SCREEN_WIDTH;
+    if (rows > 0)
+    {
+        memmove(page, page + cleared, moved * sizeof(Pixel));
+        memset(page + moved, 0, cleared * sizeof(Pixel));
+    }
+    else
+    {
+        memmove(page + cleared, page, moved * sizeof(Pixel));
+        memset(page, 0, cleared * sizeof(Pixel));
+    }
+}
+
+template <typename Pixel>
+static void ScrollPageHorizontally(Pixel* page, int pixels)
+{
+    const int moved = MEGA_SCREEN_WIDTH - std::abs(pixels);
+    const int cleared = std::abs(pixels);
+    for (int y = 0; y < MEGA_SCREEN_HEIGHT; ++y)
+    {
+        Pixel* line = page + y * MEGA_SCREEN_WIDTH;
+        if (pixels > 0)
+        {
+            memmove(line, line + cleared, moved * sizeof(Pixel));
+            memset(line + moved, 0, cleared * sizeof(Pixel));
+        }
+        else
+        {
+            memmove(line + cleared, line, moved * sizeof(Pixel));
+            memset(line, 0, cleared * sizeof(Pixel));
+        }
+    }
+}
+
+static uint64_t ReadWord(const uint8_t* bytes)
+{
+    uint64_t word;
+    memcpy(&word, bytes, sizeof(word));
+    return word;
+}
+
+MegaFramebuffer::MegaFramebuffer() :
+    m_pages(),
+    m_colors(),
+    m_shownPage(0),
+    m_palette({}),
+    m_spriteWidth(0),
+    m_spriteHeight(0),
+    m_screenAlpha(0xFF),
+    m_blendMode(MEGA_BLEND_NORMAL),
+    m_collisionColor(0),
+    m_pageHashes({}),
+    m_settingsHash(0)
+{
+    m_settingsHash = ComputeSettingsHash();
+}
+
+void MegaFramebuffer::SetEnabled(bool enabled)
+{
+    if (enabled)
+    {
+        m_pages.assign(PAGE_SIZE * 2, 0);
+        m_colors.assign(PAGE_SIZE * 2, 0);
+    }
+    else
+    {
+        m_pages.clear();
+        m_colors.clear();
+    }
+
+    m_shownPage = 0;
+    m_pageHashes = {};
+    m_settingsHash = ComputeSettingsHash();
+}
+
+void MegaFramebuffer::SetPaletteEntry(uint8_t index, uint32_t argb)
+{
+    m_settingsHash ^= StateHash::WordDelta(StateHash::SLOT_PALETTE + index, m_palette[index], argb);
+    m_palette[index] = argb;
+}
+
+void MegaFramebuffer::SetSpriteSize(int width, int height)
+{
+    UpdateSettingsHash(StateHash::SLOT_SPRITE_WIDTH, m_spriteWidth, width);
+    UpdateSettingsHash(StateHash::SLOT_SPRITE_HEIGHT, m_spriteHeight, height);
+    m_spriteWidth = width;
+    m_spriteHeight = height;
+}
+
+void MegaFramebuffer::SetScreenAlpha(uint8_t alpha)
+{
+    UpdateSettingsHash(StateHash::SLOT_SCREEN_ALPHA, m_screenAlpha, alpha);
+    m_screenAlpha = alpha;
+}
+
+void MegaFramebuffer::SetBlendMode(uint8_t mode)
+{
+    UpdateSettingsHash(StateHash::SLOT_BLEND_MODE, m_blendMode, mode);
+    m_blendMode = mode;
+}
+
+void MegaFramebuffer::SetCollisionColor(uint8_t index)
+{
+    UpdateSettingsHash(StateHash::SLOT_COLLISION_COLOR, m_collisionColor, index);
+    m_collisionColor = index;
+}
+
+bool MegaFramebuffer::DrawSprite(int x, int y, const uint8_t* sprite)
+{
+    x %= MEGA_SCREEN_WIDTH;
+    y %= MEGA_SCREEN_HEIGHT;
+
+    const int columns = std::min(m_spriteWidth, MEGA_SCREEN_WIDTH - x);
+    const int rows = std::min(m_spriteHeight, MEGA_SCREEN_HEIGHT - y);
+    if (columns <= 0 || rows <= 0)
+        return false;
+
+    // words of each row the sprite touches, kept as they were so that only the ones that changed are rehashed
+    const int firstWord = x / 8;
+    const int lastWord = (x + columns - 1) / 8;
+    uint8_t old[MEGA_SCREEN_WIDTH];
+    uint32_t oldColors[MEGA_SCREEN_WIDTH];
+
+    uint8_t* page = GetDrawnPage();
+    uint32_t* colors = GetDrawnColors();
+    const BlitRowFunction blitRow = GetBlitRow(m_blendMode);
+    bool collision = false;
+    for (int row = 0; row < rows; ++row)
+    {
+        uint8_t* line = page + (y + row) * MEGA_SCREEN_WIDTH;
+        uint32_t* colorLine = colors + (y + row) * MEGA_SCREEN_WIDTH;
+        memcpy(old, line + firstWord * 8, (lastWord - firstWord + 1) * 8);
+        memcpy(oldColors, colorLine + firstWord * 8, (lastWord - firstWord + 1) * 8 * sizeof(uint32_t));
+
+        if (blitRow(line + x, colorLine + x, sprite + row * m_spriteWidth, columns, m_palette.data(), m_collisionColor))
+            collision = true;
+
+        RehashWords((y + row) * MEGA_ROW_WORDS + firstWord, (y + row) * MEGA_ROW_WORDS + lastWord, old, oldColors);
+    }
+
+    return collision;
+}
+
+void MegaFramebuffer::Flip()
+{
+    UpdateSettingsHash(StateHash::SLOT_MEGA_MODE, 1 + m_shownPage, 1 + (m_shownPage ^ 1));
+    m_shownPage ^= 1;
+
+    memset(GetDrawnPage(), 0, PAGE_SIZE);
+    memset(GetDrawnColors(), 0, PAGE_SIZE * sizeof(uint32_t));
+    m_pageHashes[m_shownPage ^ 1] = 0;
+}
+
+void MegaFramebuffer::ScrollUp(int rows)
+{
+    if (rows <= 0)
+        return;
+
+    rows = std::min(rows, MEGA_SCREEN_HEIGHT);
+    ScrollPageVertically(GetDrawnPage(), rows);
+    ScrollPageVertically(GetDrawnColors(), rows);
+    RehashDrawnPage();
+}
+
+void MegaFramebuffer::ScrollDown(int rows)
+{
+    if (rows <= 0)
+        return;
+
+    rows = std::min(rows, MEGA_SCREEN_HEIGHT);
+    ScrollPageVertically(GetDrawnPage(), -rows);
+    ScrollPageVertically(GetDrawnColors(), -rows);
+    RehashDrawnPage();
+}
+
+void MegaFramebuffer::ScrollLeft(int pixels)
+{
+    if (pixels <= 0)
+        return;
+
+    pixels = std::min(pixels, MEGA_SCREEN_WIDTH);
+    ScrollPageHorizontally(GetDrawnPage(), pixels);
+    ScrollPageHorizontally(GetDrawnColors(), pixels);
+    RehashDrawnPage();
+}
+
+void MegaFramebuffer::ScrollRight(int pixels)
+{
+    if (pixels <= 0)
+        return;
+
+    pixels = std::min(pixels, MEGA_SCREEN_WIDTH);
+    ScrollPageHorizontally(GetDrawnPage(), -pixels);
+    ScrollPageHorizontally(GetDrawnColors(), -pixels);
+    RehashDrawnPage();
+}
+
+void MegaFramebuffer::ExpandShownPage(uint32_t* argb, int pitch) const
+{
+    // each channel is scaled by the pixel's alpha times the screen alpha, which shows the color over black
+    const uint32_t* page = GetShownColors();
+    for (int y = 0; y < MEGA_SCREEN_HEIGHT; ++y)
+    {
+        const uint32_t* src = page + y * MEGA_SCREEN_WIDTH;
+        uint32_t* dst = argb + y * pitch;
+        int x = 0;
+
+#ifdef HAVE_SSE2
+        // 4 pixels at a time, widened to 16 bits a channel with each pixel's alpha copied into all four of its lanes.
+        // On an opaque screen, pixels that are either cleared or opaque are common enough to skip the math for
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i screenAlpha = _mm_set1_epi16(m_screenAlpha);
+        const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+        const bool opaqueScreen = m_screenAlpha == 0xFF;
+        auto scale = [&](__m128i channels)
+        {
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(channels, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+            alpha = Div255(_mm_mullo_epi16(alpha, screenAlpha));
+            return Div255(_mm_mullo_epi16(channels, alpha));
+        };
+        for (; x < MEGA_SCREEN_WIDTH; x += 4)
+        {
+            const __m128i pixels = _mm_loadu_si128((const __m128i*)(src + x));
+            if (opaqueScreen)
+            {
+                const __m128i alphas = _mm_and_si128(pixels, opaque);
+                const __m128i shown = _mm_cmpeq_epi32(alphas, opaque);
+                if (_mm_movemask_epi8(_mm_or_si128(shown, _mm_cmpeq_epi32(alphas, zero))) == 0xFFFF)
+                {
+                    _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_and_si128(pixels, shown), opaque));
+                    continue;
+                }
+            }
+
+            const __m128i low = scale(_mm_unpacklo_epi8(pixels, zero));
+            const __m128i high = scale(_mm_unpackhi_epi8(pixels, zero));
+            _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_packus_epi16(low, high), opaque));
+        }
+#endif
+
+        for (; x < MEGA_SCREEN_WIDTH; ++x)
+        {
+            const uint32_t color = src[x];
+            const uint32_t alpha = Div255((color >> 24) * m_screenAlpha);
+            const uint32_t r = Div255((color >> 16 & 0xFF) * alpha);
+            const uint32_t g = Div255((color >> 8 & 0xFF) * alpha);
+            const uint32_t b = Div255((color & 0xFF) * alpha);
+            dst[x] = 0xFF000000 | r << 16 | g << 8 | b;
+        }
+    }
+}
+
+uint64_t MegaFramebuffer::ComputeHash() const
+{
+    uint64_t hash = ComputeSettingsHash();
+    if (IsEnabled())
+        hash ^= ComputePageHash(0) ^ ComputePageHash(1);
+
+    return hash;
+}
+
+uint64_t MegaFramebuffer::FoldWord(const uint8_t* indices, const uint32_t* colors)
+{
+    // multiplying by an odd constant between the xors mixes each color pair in, so that equal colors in different
+    // pixels don't cancel out. A cleared word folds to 0 and so has a key of 0, like every other cleared slot
+    uint64_t value = ReadWord(indices);
+    for (int i = 0; i < 4; ++i)
+    {
+        value = (value ^ ReadWord((const uint8_t*)(colors + i * 2))) * 0x9E3779B97F4A7C15ull;
+        value ^= value >> 32;
+    }
+
+    return value;
+}
+
+void MegaFramebuffer::RehashWords(int first, int last, const uint8_t* old, const uint32_t* oldColors)
+{
+    const int page = m_shownPage ^ 1;
+    const uint8_t* bytes = GetDrawnPage();
+    const uint32_t* colors = GetDrawnColors();
+    for (int word = first; word <= last; ++word)
+    {
+        const uint8_t* oldIndices = old + (word - first) * 8;
+        const uint32_t* oldWordColors = oldColors + (word - first) * 8;
+        if (memcmp(oldIndices, bytes + word * 8, 8) != 0 || memcmp(oldWordColors, colors + word * 8, 8 * sizeof(uint32_t)) != 0)
+        {
+            m_pageHashes[page] ^= StateHash::WordDelta(Slot(page, word), FoldWord(oldIndices, oldWordColors),
+                FoldWord(bytes + word * 8, colors + word * 8));
+        }
+    }
+}
+
+void MegaFramebuffer::RehashDrawnPage()
+{
+    m_pageHashes[m_shownPage ^ 1] = ComputePageHash(m_shownPage ^ 1);
+}
+
+uint64_t MegaFramebuffer::ComputePageHash(int page) const
+{
+    const uint8_t* bytes = m_pages.data() + page * PAGE_SIZE;
+    const uint32_t* colors = m_colors.data() + page * PAGE_SIZE;
+    uint64_t hash = 0;
+    for (int word = 0; word < PAGE_SIZE / 8; ++word)
+        hash ^= StateHash::WordKey(Slot(page, word), FoldWord(bytes + word * 8, colors + word * 8));
+
+    return hash;
+}
+
+uint64_t MegaFramebuffer::ComputeSettingsHash() const
+{
+    uint64_t hash = StateHash::Key(StateHash::SLOT_MEGA_MODE, IsEnabled() ? 1 + m_shownPage : 0);
+    hash ^= StateHash::Key(StateHash::SLOT_SPRITE_WIDTH, m_spriteWidth);
+    hash ^= StateHash::Key(StateHash::SLOT_SPRITE_HEIGHT, m_spriteHeight);
+    hash ^= StateHash::Key(StateHash::SLOT_SCREEN_ALPHA, m_screenAlpha);
+    hash ^= StateHash::Key(StateHash::SLOT_BLEND_MODE, m_blendMode);
+    hash ^= StateHash::Key(StateHash::SLOT_COLLISION_COLOR, m_collisionColor);
+    for (int i = 0; i < 256; ++i)
+        hash ^= StateHash::WordKey(StateHash::SLOT_PALETTE + i, m_palette[i]);
+
+    return hash;
+}
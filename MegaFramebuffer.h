@@ -0,0 +1,128 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "StateHash.h"
+
+// MEGA-CHIP 256x192 mode
+#define MEGA_SCREEN_WIDTH 256
+#define MEGA_SCREEN_HEIGHT 192
+
+// sprite blend modes of 080N. Each channel of the sprite's color s is blended with the screen's d.
+// Values past MEGA_BLEND_MULTIPLY draw like MEGA_BLEND_NORMAL
+enum MegaBlendMode
+{
+    MEGA_BLEND_NORMAL,          // s
+    MEGA_BLEND_25,              // s / 4 + d * 3 / 4
+    MEGA_BLEND_50,              // (s + d) / 2
+    MEGA_BLEND_ADD,             // s + d, saturated
+    MEGA_BLEND_MULTIPLY,        // s * d / 255
+};
+
+// The MEGA-CHIP display: two pages, one shown and one drawn to. 00E0 shows the page that was drawn to and clears the other.
+// Each page holds the 8-bit palette index last drawn to every pixel, which collisions are tested against, and the ARGB
+// color the blend mode left there, which is what's shown. Index 0 is transparent in sprites, and a cleared page is black.
+// The pages are only allocated while 256x192 mode is on, so classic machines copy and hash nothing more than before.
+// Like the packed framebuffer, a Zobrist hash is kept up to date on every change, with the indices and colors of
+// 8 pixels folded into each slot.
+class MegaFramebuffer
+{
+public:
+    static const int PAGE_SIZE = MEGA_SCREEN_WIDTH * MEGA_SCREEN_HEIGHT;
+
+    MegaFramebuffer();
+
+    // switches 256x192 mode on (0011) or off (0010). Both pages start out cleared
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const { return !m_pages.empty(); }
+
+    // sets one ARGB palette entry (02NN loads them from memory). Pixels already drawn keep their color
+    void SetPaletteEntry(uint8_t index, uint32_t argb);
+    uint32_t GetPaletteEntry(uint8_t index) const { return m_palette[index]; }
+
+    // size of the sprites DXYN draws (03NN / 04NN), 1 - 256 pixels
+    void SetSpriteSize(int width, int height);
+    int GetSpriteWidth() const { return m_spriteWidth; }
+    int GetSpriteHeight() const { return m_spriteHeight; }
+
+    // alpha the whole screen is shown with (05NN)
+    void SetScreenAlpha(uint8_t alpha);
+    uint8_t GetScreenAlpha() const { return m_screenAlpha; }
+
+    // blend mode of the sprites drawn from now on (080N), one of MegaBlendMode
+    void SetBlendMode(uint8_t mode);
+    uint8_t GetBlendMode() const { return m_blendMode; }
+
+    // palette index that DXYN reports a collision on (09NN)
+    void SetCollisionColor(uint8_t index);
+    uint8_t GetCollisionColor() const { return m_collisionColor; }
+
+    // draws a sprite of the current sprite size from sprite (one palette index per pixel, row by row) onto the page
+    // being drawn to at x, y. The starting position wraps around the screen, the rest is clipped at the edges.
+    // Pixels of index 0 are transparent. The others set the index and blend their palette color into the page.
+    // returns true if a drawn pixel covered a pixel of the collision color
+    bool DrawSprite(int x, int y, const uint8_t* sprite);
+
+    // shows the page that was drawn to and clears the other one for drawing (00E0)
+    void Flip();
+
+    // moves the picture in the page being drawn to. Pixels scrolled in are 0
+    void ScrollUp(int rows);
+    void ScrollDown(int rows);
+    void ScrollLeft(int pixels);
+    void ScrollRight(int pixels);
+
+    // the page on screen, MEGA_SCREEN_WIDTH indices per row. Only valid while enabled
+    const uint8_t* GetShownPage() const { return m_pages.data() + m_shownPage * PAGE_SIZE; }
+
+    // colors of the page on screen, MEGA_SCREEN_WIDTH ARGB pixels per row. Only valid while enabled
+    const uint32_t* GetShownColors() const { return m_colors.data() + m_shownPage * PAGE_SIZE; }
+
+    // writes the page on screen as opaque pixels: its colors at their own alpha times the screen alpha, over black.
+    // pitch is the distance between rows of argb in pixels
+    void ExpandShownPage(uint32_t* argb, int pitch) const;
+
+    // hash of the mode, settings, palette and both pages. O(1)
+    uint64_t GetHash() const { return m_pageHashes[0] ^ m_pageHashes[1] ^ m_settingsHash; }
+
+    // recomputes the hash from scratch. Slow - only useful to verify the incremental hash
+    uint64_t ComputeHash() const;
+
+private:
+    // hash slot of a word (8 pixels) of a page
+    static uint32_t Slot(int page, int word) { return StateHash::SLOT_MEGA_SCREEN + page * 0x2000 + word; }
+
+    // the indices and colors of the 8 pixels of a word, folded into the value hashed for its slot
+    static uint64_t FoldWord(const uint8_t* indices, const uint32_t* colors);
+
+    uint8_t* GetDrawnPage() { return m_pages.data() + (m_shownPage ^ 1) * PAGE_SIZE; }
+    uint32_t* GetDrawnColors() { return m_colors.data() + (m_shownPage ^ 1) * PAGE_SIZE; }
+
+    // rehashes words first - last of the page being drawn to. old and oldColors hold their indices and colors
+    // as they were before the change
+    void RehashWords(int first, int last, const uint8_t* old, const uint32_t* oldColors);
+
+    // rehashes every word of the page being drawn to from scratch
+    void RehashDrawnPage();
+
+    uint64_t ComputePageHash(int page) const;
+    uint64_t ComputeSettingsHash() const;
+
+    void UpdateSettingsHash(uint32_t slot, uint32_t oldVal, uint32_t newVal) { m_settingsHash ^= StateHash::Delta(slot, oldVal, newVal); }
+
+    // the indices and the colors of both pages, back to back. Empty while 256x192 mode is off
+    std::vector<uint8_t> m_pages;
+    std::vector<uint32_t> m_colors;
+    int m_shownPage;
+
+    std::array<uint32_t, 256> m_palette;
+    int m_spriteWidth;
+    int m_spriteHeight;
+    uint8_t m_screenAlpha;
+    uint8_t m_blendMode;
+    uint8_t m_collisionColor;
+
+    // hash of each page, and of the mode, settings and palette
+    std::array<uint64_t, 2> m_pageHashes;
+    uint64_t m_settingsHash;
+};
@@ -0,0 +1,25 @@
+#pragma once
+
+// behaviours that differ between chip8 interpreters, and that roms written for one of them rely on.
+// A quirk profile is a combination of these. Each profile's handlers are compiled with their flags as a template
+// argument, so the instructions themselves never test a flag at runtime
+#define QUIRK_SHIFT_VY          0x01    // 8XY6 / 8XYE shift VY into VX instead of shifting VX in place
+#define QUIRK_INCREMENT_INDEX   0x02    // FX55 / FX65 leave I pointing past the last register they touched
+#define QUIRK_JUMP_VX           0x04    // BXNN jumps to XNN + VX instead of BNNN jumping to NNN + V0
+#define QUIRK_VF_RESET          0x08    // 8XY1 / 8XY2 / 8XY3 clear VF
+#define QUIRK_WRAP_SPRITES      0x10    // sprites wrap around the edges of the screen instead of being clipped
+#define QUIRK_DISPLAY_WAIT      0x20    // DXYN waits for the next frame before the guest goes on
+
+// the quirks of each profile
+#define QUIRKS_DEFAULT_FLAGS    0
+#define QUIRKS_COSMAC_FLAGS     (QUIRK_SHIFT_VY | QUIRK_INCREMENT_INDEX | QUIRK_VF_RESET | QUIRK_DISPLAY_WAIT)
+#define QUIRKS_SCHIP_FLAGS      (QUIRK_JUMP_VX)
+#define QUIRKS_XOCHIP_FLAGS     (QUIRK_SHIFT_VY | QUIRK_INCREMENT_INDEX | QUIRK_WRAP_SPRITES)
+
+enum QuirkProfile
+{
+    QUIRKS_DEFAULT,         // what this interpreter has always done: SUPER-CHIP behaviour, but BNNN and clipped sprites
+    QUIRKS_COSMAC,          // the original COSMAC VIP interpreter
+    QUIRKS_SCHIP,           // SUPER-CHIP 1.1 on the HP48
+    QUIRKS_XOCHIP,          // XO-CHIP as Octo runs it
+};
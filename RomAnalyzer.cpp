@@ -0,0 +1,134 @@
+#include "ControlFlowGraph.h"
+#include "RomAnalyzer.h"
+
+namespace
+{
+    // instructions searched after an FX55 / FX65 for the next use of I
+    const int INDEX_USE_WINDOW = 16;
+
+    // FX07 followed by a 3XNN that skips out once VX reaches NN, and a jump back to the FX07
+    bool IsDelayTimerWait(const uint8_t* rom, int romSize, const DecodedInstruction& getDelay)
+    {
+        DecodedInstruction skip;
+        DecodedInstruction jump;
+        return Disassembler::Decode(rom, romSize, FIRST_MEMORY_LOCATION, getDelay.address + 2, skip)
+            && Disassembler::Decode(rom, romSize, FIRST_MEMORY_LOCATION, getDelay.address + 4, jump)
+            && skip.operation == OP_SKIP_EQ_CONST && skip.x == getDelay.x
+            && jump.operation == OP_JUMP && jump.target == getDelay.address;
+    }
+
+    // looks at the straight-line code after an FX55 / FX65 for the next instruction that touches I.
+    // returns true if it uses I as it was left rather than loading it
+    bool UsesIndexAfterRegisterTransfer(const uint8_t* rom, int romSize, const DecodedInstruction& transfer)
+    {
+        uint32_t address = transfer.address + transfer.length;
+        for (int i = 0; i < INDEX_USE_WINDOW; ++i)
+        {
+            DecodedInstruction instruction;
+            if (!Disassembler::Decode(rom, romSize, FIRST_MEMORY_LOCATION, address, instruction))
+                return false;
+
+            switch (instruction.operation)
+            {
+                case OP_DRAW:
+                case OP_BCD:
+                case OP_STORE_REGS:
+                case OP_LOAD_REGS:
+                case OP_SAVE_RANGE:
+                case OP_LOAD_RANGE:
+                    return true;
+                case OP_SET_INDEX:
+                case OP_LOAD_LONG_INDEX:
+                case OP_LOAD_MEGA_INDEX:
+                case OP_ADD_INDEX:
+                case OP_FONT:
+                case OP_BIG_FONT:
+                    return false;
+                default:
+                    break;
+            }
+
+            // the straight line ends
+            if (instruction.flow != FLOW_NEXT && instruction.flow != FLOW_SKIP)
+                return false;
+
+            address += instruction.length;
+        }
+
+        return false;
+    }
+
+    // speed of a rom on the machine it was written for. Roms that wait on the delay timer pace themselves and
+    // are given a faster cpu, the rest are paced by the instruction count and keep the original speed
+    int PickInstructionsPerFrame(MachineType machine, QuirkProfile quirks, bool waitsOnDelayTimer)
+    {
+        if (machine == MACHINE_MEGACHIP)
+            return waitsOnDelayTimer ? 3000 : 1000;
+        if (machine == MACHINE_XOCHIP)
+            return waitsOnDelayTimer ? 1000 : 200;
+        if (quirks == QUIRKS_COSMAC)
+            return 15;
+        if (quirks == QUIRKS_SCHIP)
+            return waitsOnDelayTimer ? 30 : 15;
+
+        return waitsOnDelayTimer ? 30 : 8;
+    }
+}
+
+RomAnalysis RomAnalyzer::Analyze(const uint8_t* rom, int romSize)
+{
+    RomAnalysis analysis = {};
+
+    ControlFlowGraph graph;
+    graph.Build(rom, romSize > 0 ? romSize : 0, FIRST_MEMORY_LOCATION, FIRST_MEMORY_LOCATION);
+    analysis.reachableInstructions = (int)graph.GetInstructions().size();
+
+    for (const DecodedInstruction& instruction : graph.GetInstructions())
+    {
+        if (instruction.set == SET_SUPERCHIP)
+            analysis.usesSuperChip = true;
+        else if (instruction.set == SET_XOCHIP)
+            analysis.usesXoChip = true;
+        else if (instruction.set == SET_MEGACHIP)
+            analysis.usesMegaChip = true;
+
+        switch (instruction.operation)
+        {
+            case OP_SHIFT_RIGHT:
+            case OP_SHIFT_LEFT:
+                if (instruction.x != instruction.y)
+                    analysis.shiftsVY = true;
+                break;
+            case OP_STORE_REGS:
+            case OP_LOAD_REGS:
+                if (UsesIndexAfterRegisterTransfer(rom, romSize, instruction))
+                    analysis.reliesOnIndexIncrement = true;
+                break;
+            case OP_GET_DELAY:
+                if (IsDelayTimerWait(rom, romSize, instruction))
+                    analysis.waitsOnDelayTimer = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // the extensions decide the machine. SUPER-CHIP roms often name a VY that SUPER-CHIP ignores, so the shift
+    // and index hints only pick between the plain chip8 profiles
+    analysis.machine = MACHINE_CHIP8;
+    analysis.quirks = QUIRKS_DEFAULT;
+    if (analysis.usesMegaChip)
+        analysis.machine = MACHINE_MEGACHIP;
+    else if (analysis.usesXoChip)
+    {
+        analysis.machine = MACHINE_XOCHIP;
+        analysis.quirks = QUIRKS_XOCHIP;
+    }
+    else if (analysis.usesSuperChip)
+        analysis.quirks = QUIRKS_SCHIP;
+    else if (analysis.shiftsVY || analysis.reliesOnIndexIncrement)
+        analysis.quirks = QUIRKS_COSMAC;
+
+    analysis.instructionsPerFrame = PickInstructionsPerFrame(analysis.machine, analysis.quirks, analysis.waitsOnDelayTimer);
+    return analysis;
+}
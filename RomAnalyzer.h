@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include "Chip8.h"
+
+// what RomAnalyzer found out about a rom
+struct RomAnalysis
+{
+    // smallest machine that has every reachable instruction
+    MachineType machine;
+
+    QuirkProfile quirks;
+    int instructionsPerFrame;
+
+    // instructions reachable from FIRST_MEMORY_LOCATION. Everything else in the rom is taken to be data
+    int reachableInstructions;
+
+    // reachable instructions that only exist on SUPER-CHIP or later, XO-CHIP and MEGA-CHIP
+    bool usesSuperChip;
+    bool usesXoChip;
+    bool usesMegaChip;
+
+    // an 8XY6 / 8XYE with X != Y, which only makes sense if VY is the register being shifted
+    bool shiftsVY;
+
+    // an FX55 / FX65 followed by another instruction that uses I before I is loaded again, which only works
+    // if I was left past the registers
+    bool reliesOnIndexIncrement;
+
+    // a loop that spins on FX07 until the delay timer runs out, so the rom paces itself by the timer
+    bool waitsOnDelayTimer;
+};
+
+// Infers the machine, quirk profile and speed of a rom that isn't in the rom database, without running it.
+// Builds the rom's ControlFlowGraph from FIRST_MEMORY_LOCATION to find the code, and looks for the telltale
+// instructions and patterns of each interpreter in it. BNNN targets depend on V0 and aren't followed.
+// Well under a millisecond even for a 3.5K rom that branches on every instruction.
+class RomAnalyzer
+{
+public:
+    static RomAnalysis Analyze(const uint8_t* rom, int romSize);
+};
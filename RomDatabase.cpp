@@ -0,0 +1,95 @@
+#include <algorithm>
+#include "RomDatabase.h"
+
+namespace
+{
+    // presets the entries pick their palette and keymap from, so an entry stays 16 bytes
+    enum RomPalette : uint8_t
+    {
+        PALETTE_DEFAULT,        // white on black, grays for the XO-CHIP planes
+        PALETTE_OCTO,           // Octo's yellow on brown
+    };
+
+    enum RomKeymap : uint8_t
+    {
+        KEYMAP_DEFAULT,         // keys 0 - F in order, row by row
+        KEYMAP_COSMAC,          // the COSMAC VIP hex keypad: 1 2 3 C / 4 5 6 D / 7 8 9 E / A 0 B F
+    };
+
+    const uint32_t palettes[][4] =
+    {
+        { 0xFF000000, 0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555 },
+        { 0xFF996600, 0xFFFFCC00, 0xFFFF6600, 0xFF662200 },
+    };
+
+    const uint8_t keymaps[][16] =
+    {
+        { 0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0x8, 0x9, 0xA, 0xB, 0xC, 0xD, 0xE, 0xF },
+        { 0x1, 0x2, 0x3, 0xC, 0x4, 0x5, 0x6, 0xD, 0x7, 0x8, 0x9, 0xE, 0xA, 0x0, 0xB, 0xF },
+    };
+
+    struct RomEntry
+    {
+        uint64_t hash;
+        uint16_t instructionsPerFrame;
+        uint8_t quirks;
+        uint8_t palette;
+        uint8_t keymap;
+    };
+
+    // sorted by RomDatabase::Hash, which the compiler checks below
+    constexpr RomEntry roms[] =
+    {
+        { 0x06D44AFD0B3773B2ull, 15, QUIRKS_COSMAC, PALETTE_DEFAULT, KEYMAP_COSMAC },      // Airplane.ch8
+        { 0x0C8DFFFA2F0474D6ull, 8, QUIRKS_DEFAULT, PALETTE_DEFAULT, KEYMAP_DEFAULT },     // TEST2.ch8
+        { 0x19FA1EDF40FAD0AFull, 8, QUIRKS_DEFAULT, PALETTE_DEFAULT, KEYMAP_DEFAULT },     // TEST1.ch8
+        { 0x624B3EED64313F42ull, 15, QUIRKS_COSMAC, PALETTE_DEFAULT, KEYMAP_COSMAC },      // PONG.ch8
+    };
+
+    constexpr bool IsSorted(const RomEntry* entries, size_t count)
+    {
+        for (size_t i = 1; i < count; ++i)
+        {
+            if (entries[i - 1].hash >= entries[i].hash)
+                return false;
+        }
+        return true;
+    }
+
+    static_assert(IsSorted(roms, sizeof(roms) / sizeof(roms[0])), "the rom database must be sorted by hash without duplicates");
+}
+
+uint64_t RomDatabase::Hash(const uint8_t* rom, int romSize)
+{
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (int i = 0; i < romSize; ++i)
+    {
+        hash ^= rom[i];
+        hash *= 0x100000001B3ull;
+    }
+    return hash;
+}
+
+bool RomDatabase::Lookup(uint64_t hash, RomInfo& info)
+{
+    const RomEntry* end = roms + sizeof(roms) / sizeof(roms[0]);
+    const RomEntry* entry = std::lower_bound(roms, end, hash, [](const RomEntry& e, uint64_t h) { return e.hash < h; });
+    if (entry == end || entry->hash != hash)
+        return false;
+
+    info.quirks = (QuirkProfile)entry->quirks;
+    info.instructionsPerFrame = entry->instructionsPerFrame;
+    std::copy(palettes[entry->palette], palettes[entry->palette] + 4, info.palette.begin());
+    std::copy(keymaps[entry->keymap], keymaps[entry->keymap] + 16, info.keymap.begin());
+    return true;
+}
+
+RomInfo RomDatabase::GetDefaults()
+{
+    RomInfo info;
+    info.quirks = QUIRKS_DEFAULT;
+    info.instructionsPerFrame = 8;
+    std::copy(palettes[PALETTE_DEFAULT], palettes[PALETTE_DEFAULT] + 4, info.palette.begin());
+    std::copy(keymaps[KEYMAP_DEFAULT], keymaps[KEYMAP_DEFAULT] + 16, info.keymap.begin());
+    return info;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "Quirks.h"
+
+// how a known rom wants to be run
+struct RomInfo
+{
+    QuirkProfile quirks;
+
+    // instructions the rom expects per 60hz frame
+    int instructionsPerFrame;
+
+    // colors of the 4 combinations of the 2 bitplanes. Classic roms only use the first two
+    std::array<uint32_t, 4> palette;
+
+    // keymap[n] is the chip8 key pressed by the nth key of the 1234 / QWER / ASDF / ZXCV block
+    std::array<uint8_t, 16> keymap;
+};
+
+// Settings of known roms, looked up by a hash of the rom bytes.
+// The entries are a compact table embedded in the binary and sorted by hash, so a lookup is a binary search
+// that costs nothing measurable no matter how many roms there are.
+class RomDatabase
+{
+public:
+    // FNV-1a hash of the rom bytes, the key of the table
+    static uint64_t Hash(const uint8_t* rom, int romSize);
+
+    // finds the rom with the given hash. returns false if it isn't known, info is left alone
+    static bool Lookup(uint64_t hash, RomInfo& info);
+
+    // settings of roms that aren't in the database
+    static RomInfo GetDefaults();
+};
@@ -0,0 +1,86 @@
+#include "SpriteCache.h"
+
+SpriteCache::SpriteCache() :
+    m_memory(nullptr),
+    m_entries({}),
+    m_hits(0),
+    m_misses(0)
+{
+}
+
+void SpriteCache::Reset(const uint8_t* memory, size_t memorySize)
+{
+    m_memory = memory;
+    for (Entry& entry : m_entries)
+        entry.valid = false;
+
+    // PC and I are 16 bits wide everywhere but on MEGA-CHIP, whose big sprites don't come through here
+    m_coverage.assign(memorySize < 0x10000 ? memorySize : 0x10000, 0);
+}
+
+const uint64_t* SpriteCache::GetRows(uint32_t address, int height, bool wide)
+{
+    const uint32_t size = wide ? height * 2 : height;
+    if (height > 16 || address >= m_coverage.size() || m_coverage.size() - address < size)
+        return nullptr;
+
+    // address, height and width hashed together, so the same address drawn at two heights lands in different entries
+    const uint32_t key = address << 5 | height << 1 | (wide ? 1 : 0);
+    Entry& entry = m_entries[(key * 0x9E3779B1u) >> 26 & (SPRITE_CACHE_ENTRIES - 1)];
+    if (entry.valid && entry.address == address && entry.height == height && entry.wide == wide)
+    {
+        ++m_hits;
+        return entry.rows.data();
+    }
+
+    ++m_misses;
+    if (entry.valid)
+        Cover(entry, -1);
+
+    entry.address = address;
+    entry.height = (uint8_t)height;
+    entry.wide = wide;
+    entry.valid = true;
+    ReadRows(entry);
+    Cover(entry, 1);
+    return entry.rows.data();
+}
+
+void SpriteCache::Refresh()
+{
+    for (Entry& entry : m_entries)
+    {
+        if (entry.valid)
+            ReadRows(entry);
+    }
+}
+
+void SpriteCache::Invalidate(uint32_t address)
+{
+    for (Entry& entry : m_entries)
+    {
+        if (entry.valid && address >= entry.address && address - entry.address < entry.GetSize())
+        {
+            Cover(entry, -1);
+            entry.valid = false;
+        }
+    }
+}
+
+void SpriteCache::ReadRows(Entry& entry) const
+{
+    const uint8_t* sprite = m_memory + entry.address;
+    for (int row = 0; row < entry.height; ++row)
+    {
+        if (entry.wide)
+            entry.rows[row] = (uint64_t)(sprite[row * 2] << 8 | sprite[row * 2 + 1]) << 48;
+        else
+            entry.rows[row] = (uint64_t)sprite[row] << 56;
+    }
+}
+
+void SpriteCache::Cover(const Entry& entry, int delta)
+{
+    for (uint32_t i = 0; i < entry.GetSize(); ++i)
+        m_coverage[entry.address + i] += delta;
+}
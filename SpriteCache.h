@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// sprites the cache holds at once. A power of two
+#define SPRITE_CACHE_ENTRIES 64
+
+// Rows of the sprites DXYN draws, packed into 64-bit words the way Framebuffer::XorRow takes them (the leftmost pixel
+// in the top bit), keyed by address and size. Games draw the same few sprites from the same addresses every frame,
+// so a draw reads its rows from here instead of going through memory a byte at a time.
+// Direct mapped. Each byte of memory counts the sprites it belongs to, so a write to memory that no sprite was read from
+// costs one lookup. Only covers the first 64K of memory.
+class SpriteCache
+{
+public:
+    SpriteCache();
+
+    // sets the memory sprites are read from, which must stay valid while the cache is used. Empties the cache
+    void Reset(const uint8_t* memory, size_t memorySize);
+
+    // rows of the sprite at address that is height rows of 1 byte, or of 2 bytes if wide. Reads it from memory the first time.
+    // Null if the sprite doesn't lie within the memory the cache covers
+    const uint64_t* GetRows(uint32_t address, int height, bool wide);
+
+    // call after memory at address was written
+    void OnWrite(uint32_t address)
+    {
+        if (address < m_coverage.size() && m_coverage[address] != 0)
+            Invalidate(address);
+    }
+
+    // re-reads every cached sprite, after memory was replaced as a whole
+    void Refresh();
+
+    // draws whose rows were / weren't cached
+    uint64_t GetHits() const { return m_hits; }
+    uint64_t GetMisses() const { return m_misses; }
+
+private:
+    struct Entry
+    {
+        uint32_t address;
+        uint8_t height;
+        bool wide;
+        bool valid;
+        std::array<uint64_t, 16> rows;
+
+        uint32_t GetSize() const { return wide ? height * 2 : height; }
+    };
+
+    // drops every sprite that contains address
+    void Invalidate(uint32_t address);
+
+    // packs the rows of entry from memory
+    void ReadRows(Entry& entry) const;
+
+    // adds delta to the sprite count of every byte of entry
+    void Cover(const Entry& entry, int delta);
+
+    const uint8_t* m_memory;
+    std::array<Entry, SPRITE_CACHE_ENTRIES> m_entries;
+
+    // number of cached sprites each byte of memory belongs to
+    std::vector<uint8_t> m_coverage;
+
+    uint64_t m_hits;
+    uint64_t m_misses;
+};
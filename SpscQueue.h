@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free bounded queue for exactly one producer thread and one consumer thread.
+// Capacity must be a power of two. Push and Pop never block and never allocate.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity != 0 && (Capacity & (Capacity - 1)) == 0, "SpscQueue capacity must be a power of two");
+
+public:
+    SpscQueue() :
+        m_head(0),
+        m_tail(0)
+    {
+    }
+
+    // producer only. returns false if the queue is full
+    bool Push(const T& item)
+    {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+            return false;
+
+        m_items[tail & (Capacity - 1)] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // consumer only. returns false if the queue is empty
+    bool Pop(T& item)
+    {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire))
+            return false;
+
+        item = m_items[head & (Capacity - 1)];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // number of queued items. Only exact when called from the producer or consumer with the other side idle
+    size_t GetSize() const { return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire); }
+
+private:
+    std::array<T, Capacity> m_items;
+
+    // the indices only ever grow and are wrapped on access. Padded apart so the
+    // producer and consumer don't invalidate each other's cache line on every operation.
+    std::atomic<size_t> m_head;
+    char m_headPadding[64];
+    std::atomic<size_t> m_tail;
+    char m_tailPadding[64];
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <cstdint>
+
+// Zobrist-style hashing of the chip8 machine state.
+// Every piece of state (a memory byte, a register, a row of pixels...) has its own slot. The state hash is the xor of
+// Key(slot, value) over all slots, so a write only has to xor out the key of the old value and xor in the new one.
+class StateHash
+{
+public:
+    enum Slot : uint32_t
+    {
+        SLOT_MEMORY = 0x0000000,            // 1 slot per byte of memory, up to 16M
+        SLOT_REGISTER = 0x1000000,          // V0 - VF
+        SLOT_INDEX = 0x1000010,
+        SLOT_PROGRAM_COUNTER = 0x1000011,
+        SLOT_STACK_POINTER = 0x1000012,
+        SLOT_DELAY_TIMER = 0x1000013,
+        SLOT_BEEP_TIMER = 0x1000014,
+        SLOT_KEY_WAIT = 0x1000015,          // 0 when running, 0x100 | register index while FX0A waits for a key
+        SLOT_HIGH_RES = 0x1000016,          // 1 in 128x64 mode
+        SLOT_SELECTED_PLANES = 0x1000017,   // bitplanes selected by FN01
+        SLOT_PITCH = 0x1000018,             // XO-CHIP pitch register (FX3A)
+        SLOT_PATTERN_LOADED = 0x1000019,    // 1 once F002 has loaded an XO-CHIP audio pattern
+        SLOT_MEGA_MODE = 0x100001A,         // 1 + the page shown while in MEGA-CHIP 256x192 mode
+        SLOT_SPRITE_WIDTH = 0x100001B,      // MEGA-CHIP sprite size (03NN / 04NN)
+        SLOT_SPRITE_HEIGHT = 0x100001C,
+        SLOT_SCREEN_ALPHA = 0x100001D,      // MEGA-CHIP screen alpha (05NN)
+        SLOT_BLEND_MODE = 0x100001E,        // MEGA-CHIP sprite blend mode (080N)
+        SLOT_COLLISION_COLOR = 0x100001F,   // MEGA-CHIP collision color index (09NN)
+        SLOT_SOUND_STREAM = 0x1000020,      // MEGA-CHIP digitized sound: address, looping, playing (060N / 0700)
+        SLOT_SOUND_TRIGGER = 0x1000021,     // number of times 060N has started a sound
+        SLOT_STACK = 0x1000100,             // 1 slot per stack entry
+        SLOT_RPL_FLAG = 0x1000200,          // 1 slot per RPL flag (FX75/FX85)
+        SLOT_PATTERN = 0x1000300,           // 1 slot per byte of the audio pattern
+        SLOT_PALETTE = 0x1000400,           // 1 slot per MEGA-CHIP palette entry
+        SLOT_SCREEN = 0x1010000,            // 1 slot per 64-pixel framebuffer word, 0x100 per bitplane
+        SLOT_MEGA_SCREEN = 0x1020000,       // 1 slot per 8 pixels (indices and colors) of a MEGA-CHIP page, 0x2000 per page
+    };
+
+    // returns the key for a slot holding the given value.
+    // a value of 0 always has a key of 0 so that a zeroed machine hashes to 0 and doesn't need to be seeded.
+    static uint64_t Key(uint32_t slot, uint32_t value)
+    {
+        if (value == 0)
+            return 0;
+
+        // splitmix64 finalizer over (slot, value). Cheaper than a lookup table with 64K+ entries per slot type
+        return Mix(((uint64_t)slot << 32 | value) + 0x9E3779B97F4A7C15ull);
+    }
+
+    // returns the change to apply to a hash when a slot goes from oldVal to newVal
+    static uint64_t Delta(uint32_t slot, uint32_t oldVal, uint32_t newVal)
+    {
+        return Key(slot, oldVal) ^ Key(slot, newVal);
+    }
+
+    // the same for slots that hold a whole 64-bit word, like 64 pixels of the framebuffer
+    static uint64_t WordKey(uint32_t slot, uint64_t value)
+    {
+        if (value == 0)
+            return 0;
+
+        return Mix(Mix((uint64_t)slot + 0x9E3779B97F4A7C15ull) ^ value);
+    }
+
+    static uint64_t WordDelta(uint32_t slot, uint64_t oldVal, uint64_t newVal)
+    {
+        return WordKey(slot, oldVal) ^ WordKey(slot, newVal);
+    }
+
+private:
+    static uint64_t Mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+};
@@ -0,0 +1,134 @@
+#include "ThreadPool.h"
+
+namespace
+{
+    // index of the pool worker running on this thread, or -1 for threads outside the pool
+    thread_local int t_workerIndex = -1;
+    thread_local const ThreadPool* t_workerPool = nullptr;
+}
+
+ThreadPool::ThreadPool(unsigned threadCount) :
+    m_pending(0),
+    m_queued(0),
+    m_nextQueue(0),
+    m_steals(0),
+    m_stop(false)
+{
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+
+    // hardware_concurrency is allowed to return 0
+    if (threadCount == 0)
+        threadCount = 1;
+
+    for (unsigned i = 0; i < threadCount; ++i)
+        m_queues.emplace_back(new WorkerQueue());
+
+    for (unsigned i = 0; i < threadCount; ++i)
+        m_threads.emplace_back(&ThreadPool::WorkerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    Wait();
+
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stop = true;
+    }
+    m_workAvailable.notify_all();
+
+    for (std::thread& thread : m_threads)
+        thread.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    unsigned index;
+    if (t_workerPool == this)
+        index = (unsigned)t_workerIndex;
+    else
+        index = m_nextQueue.fetch_add(1, std::memory_order_relaxed) % m_queues.size();
+
+    m_pending.fetch_add(1, std::memory_order_relaxed);
+
+    // count the task before it becomes visible so the queued count can never drop below 0.
+    // Done under the sleep mutex so a worker that's about to sleep can't miss the wakeup.
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_queued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_queues[index]->mutex);
+        m_queues[index]->tasks.push_back(std::move(task));
+    }
+    m_workAvailable.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_sleepMutex);
+    m_allDone.wait(lock, [this] { return m_pending.load() == 0; });
+}
+
+bool ThreadPool::TakeTask(unsigned index, std::function<void()>& task)
+{
+    // own queue first, newest task first since it's the most likely to still be in cache
+    {
+        WorkerQueue& queue = *m_queues[index];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // steal the oldest task from the other queues
+    for (size_t i = 1; i < m_queues.size(); ++i)
+    {
+        WorkerQueue& queue = *m_queues[(index + i) % m_queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty())
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            m_queued.fetch_sub(1, std::memory_order_relaxed);
+            m_steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void ThreadPool::WorkerLoop(unsigned index)
+{
+    t_workerIndex = (int)index;
+    t_workerPool = this;
+
+    std::function<void()> task;
+    while (true)
+    {
+        if (TakeTask(index, task))
+        {
+            task();
+            task = nullptr;
+
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                std::lock_guard<std::mutex> lock(m_sleepMutex);
+                m_allDone.notify_all();
+            }
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_workAvailable.wait(lock, [this] { return m_stop || m_queued.load() > 0; });
+        if (m_stop)
+            return;
+    }
+}
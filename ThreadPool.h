@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads with work stealing.
+// Every worker owns a queue. Workers pop their newest task first and steal the oldest task from
+// other queues when their own runs dry, so long and short tasks balance out across cores.
+class ThreadPool
+{
+public:
+    // threadCount of 0 uses one thread per hardware thread
+    explicit ThreadPool(unsigned threadCount = 0);
+
+    // waits for all submitted tasks and joins the workers
+    ~ThreadPool();
+
+    // queues a task. Tasks submitted from a worker go to that worker's own queue,
+    // other tasks are spread round-robin over all queues.
+    void Submit(std::function<void()> task);
+
+    // blocks until every submitted task has finished. Must not be called from a task
+    void Wait();
+
+    unsigned GetThreadCount() const { return (unsigned)m_threads.size(); }
+
+    // number of tasks that were run by a worker other than the one they were queued on
+    uint64_t GetStealCount() const { return m_steals.load(std::memory_order_relaxed); }
+
+private:
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void WorkerLoop(unsigned index);
+
+    // takes a task from the worker's own queue, or steals one from another worker
+    bool TakeTask(unsigned index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+    std::vector<std::thread> m_threads;
+
+    // tasks submitted but not finished yet
+    std::atomic<size_t> m_pending;
+
+    // tasks sitting in queues. Workers sleep while this is 0
+    std::atomic<size_t> m_queued;
+
+    std::atomic<unsigned> m_nextQueue;
+    std::atomic<uint64_t> m_steals;
+    bool m_stop;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_workAvailable;
+    std::condition_variable m_allDone;
+};
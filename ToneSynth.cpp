@@ -0,0 +1,202 @@
+#include <cmath>
+#include "ToneSynth.h"
+
+// peak output level. Square waves are loud, so stay well below full scale
+#define TONE_VOLUME 0.2f
+
+// digitized sound is mostly quieter than a full scale square wave to begin with
+#define STREAM_VOLUME 0.5f
+
+// polynomial approximation of the band-limited step, for a discontinuity at phase 0.
+// Subtracting it from a naive square wave removes most of the aliasing
+static float PolyBlep(double phase, double phaseStep)
+{
+    if (phase < phaseStep)
+    {
+        const double t = phase / phaseStep;
+        return (float)(t + t - t * t - 1.0);
+    }
+
+    if (phase > 1.0 - phaseStep)
+    {
+        const double t = (phase - 1.0) / phaseStep;
+        return (float)(t * t + t + t + 1.0);
+    }
+
+    return 0.0f;
+}
+
+ToneSynth::ToneSynth(int sampleRate) :
+    m_sampleRate(sampleRate),
+    m_renderableFrames(0),
+    m_rateAdjustPpm(0),
+    m_frame(0),
+    m_sampleInFrame(0),
+    m_frameLength(0),
+    m_frameLengthError(0.0),
+    m_hasNextEdge(false),
+    m_nextEdge(),
+    m_gate(false),
+    m_voice(),
+    m_amplitude(0.0f),
+    m_phase(0.0),
+    m_patternPhase(0.0),
+    m_patternStep(0.0),
+    m_streamPosition(0.0),
+    m_streamStep(0.0),
+    m_renderedFrames(0),
+    m_samplesRendered(0),
+    m_underruns(0),
+    m_skips(0),
+    m_droppedEdges(0)
+{
+    BeginFrame();
+}
+
+void ToneSynth::PushEdge(uint64_t frame, bool on, const ToneVoice& voice)
+{
+    ToneEdge edge;
+    edge.frame = frame;
+    edge.on = on;
+    edge.voice = voice;
+
+    if (!m_edges.Push(edge))
+        m_droppedEdges.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ToneSynth::Render(int16_t* samples, int count)
+{
+    const uint64_t renderableFrames = m_renderableFrames.load(std::memory_order_acquire);
+    const double phaseStep = TONE_FREQUENCY / m_sampleRate;
+    const float rampStep = 1.0f / GATE_RAMP_SAMPLES;
+    m_samplesRendered.fetch_add(count, std::memory_order_relaxed);
+
+    // emulation hasn't started yet. Not an underrun
+    if (renderableFrames == 0)
+    {
+        for (int i = 0; i < count; ++i)
+            samples[i] = 0;
+        return;
+    }
+
+    // too far behind emulation. The edges in between are applied when rendering resumes
+    if (renderableFrames > m_frame + MAX_LAG_FRAMES)
+    {
+        m_frame = renderableFrames - SKIP_TARGET_FRAMES;
+        m_sampleInFrame = 0;
+        m_skips.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool underrun = false;
+    for (int i = 0; i < count; ++i)
+    {
+        // time only moves on while there are emulated frames to cover it. Otherwise the tone is held
+        if (m_frame < renderableFrames)
+        {
+            // edges only ever fall on frame boundaries
+            if (m_sampleInFrame == 0)
+            {
+                for (;;)
+                {
+                    if (!m_hasNextEdge)
+                        m_hasNextEdge = m_edges.Pop(m_nextEdge);
+
+                    if (!m_hasNextEdge || m_nextEdge.frame > m_frame)
+                        break;
+
+                    const ToneVoice& voice = m_nextEdge.voice;
+                    if (voice.samples != nullptr && (voice.trigger != m_voice.trigger || voice.samples != m_voice.samples))
+                    {
+                        m_streamPosition = 0.0;
+                        m_streamStep = (double)voice.sampleRate / m_sampleRate;
+                    }
+
+                    m_gate = m_nextEdge.on;
+                    m_voice = voice;
+                    m_patternStep = 4000.0 * pow(2.0, (m_voice.pitch - 64) / 48.0) / m_sampleRate / 128.0;
+                    m_hasNextEdge = false;
+                }
+            }
+
+            if (++m_sampleInFrame >= m_frameLength)
+            {
+                ++m_frame;
+                m_sampleInFrame = 0;
+                BeginFrame();
+            }
+        }
+        else
+        {
+            underrun = true;
+        }
+
+        if (m_gate)
+            m_amplitude = m_amplitude + rampStep < 1.0f ? m_amplitude + rampStep : 1.0f;
+        else
+            m_amplitude = m_amplitude - rampStep > 0.0f ? m_amplitude - rampStep : 0.0f;
+
+        if (m_amplitude == 0.0f)
+        {
+            // restart the wave from the same phase every time the tone comes on
+            m_phase = 0.0;
+            m_patternPhase = 0.0;
+            samples[i] = 0;
+            continue;
+        }
+
+        // digitized sound plays once or loops, and stays silent once it has run out
+        if (m_voice.samples != nullptr)
+        {
+            float value = 0.0f;
+            const uint32_t index = (uint32_t)m_streamPosition;
+            if (index < m_voice.sampleCount)
+            {
+                value = (m_voice.samples[index] - 128) / 128.0f;
+
+                m_streamPosition += m_streamStep;
+                if (m_streamPosition >= m_voice.sampleCount && m_voice.loop)
+                    m_streamPosition -= m_voice.sampleCount;
+            }
+
+            samples[i] = (int16_t)(value * m_amplitude * STREAM_VOLUME * 32767.0f);
+            continue;
+        }
+
+        // patterns are played back as they are. They're 1-bit samples, not a waveform to band-limit
+        if (m_voice.usePattern)
+        {
+            const int bit = (int)(m_patternPhase * 128.0);
+            const float value = (m_voice.pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? 1.0f : -1.0f;
+            samples[i] = (int16_t)(value * m_amplitude * TONE_VOLUME * 32767.0f);
+
+            m_patternPhase += m_patternStep;
+            if (m_patternPhase >= 1.0)
+                m_patternPhase -= 1.0;
+            continue;
+        }
+
+        double fallingPhase = m_phase + 0.5;
+        if (fallingPhase >= 1.0)
+            fallingPhase -= 1.0;
+
+        float value = m_phase < 0.5 ? 1.0f : -1.0f;
+        value += PolyBlep(m_phase, phaseStep);
+        value -= PolyBlep(fallingPhase, phaseStep);
+        samples[i] = (int16_t)(value * m_amplitude * TONE_VOLUME * 32767.0f);
+
+        m_phase += phaseStep;
+        if (m_phase >= 1.0)
+            m_phase -= 1.0;
+    }
+
+    m_renderedFrames.store(m_frame, std::memory_order_release);
+    if (underrun)
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ToneSynth::BeginFrame()
+{
+    const double exactLength = m_sampleRate / 60.0 * (1.0 + m_rateAdjustPpm.load(std::memory_order_relaxed) * 1e-6) + m_frameLengthError;
+    m_frameLength = (int)exactLength;
+    m_frameLengthError = exactLength - m_frameLength;
+}
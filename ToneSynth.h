@@ -0,0 +1,133 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include "SpscQueue.h"
+
+#define TONE_SAMPLE_RATE 48000
+#define TONE_FREQUENCY 440.0
+
+// what the tone sounds like. Classic roms beep with a square wave, XO-CHIP roms can load a 1-bit sample pattern instead
+// and MEGA-CHIP roms play digitized sound
+struct ToneVoice
+{
+    // false for the square wave
+    bool usePattern;
+
+    // 128 1-bit samples, most significant bit first, played in a loop
+    std::array<uint8_t, 16> pattern;
+
+    // XO-CHIP pitch register. The pattern plays at 4000 * 2 ^ ((pitch - 64) / 48) samples per second
+    uint8_t pitch;
+
+    // MEGA-CHIP digitized sound, played instead of the rest while samples isn't null. 8-bit unsigned samples.
+    // They're read on the audio thread, so they must not change or go away while the synth can still play them
+    const uint8_t* samples;
+    uint32_t sampleCount;
+    uint16_t sampleRate;
+    bool loop;
+
+    // changes every time a sound is started, so that starting the same sound again restarts it
+    uint32_t trigger;
+
+    bool operator==(const ToneVoice& other) const
+    {
+        return usePattern == other.usePattern && pattern == other.pattern && pitch == other.pitch && samples == other.samples
+            && sampleCount == other.sampleCount && sampleRate == other.sampleRate && loop == other.loop && trigger == other.trigger;
+    }
+    bool operator!=(const ToneVoice& other) const { return !(*this == other); }
+};
+
+// Synthesizes the beep for the sound timer.
+// The emulation thread only reports when the tone goes on or off and how far emulation has got, both in 60hz frames.
+// The audio thread turns that into a band-limited square wave. The two sides share nothing but a lock-free ring of
+// edges and a frame counter, so rendering never locks or allocates.
+class ToneSynth
+{
+public:
+    explicit ToneSynth(int sampleRate = TONE_SAMPLE_RATE);
+
+    // emulation thread. The tone is on / off and sounds like voice from the start of the given frame.
+    // Edges must be pushed in frame order
+    void PushEdge(uint64_t frame, bool on, const ToneVoice& voice);
+
+    // emulation thread. Frames before this one are final and may be rendered
+    void SetRenderableFrames(uint64_t frames) { m_renderableFrames.store(frames, std::memory_order_release); }
+
+    // audio thread. Writes count mono samples. If emulation hasn't produced the frames the samples belong to yet, the
+    // rest is filled without advancing time and counted as an underrun. If emulation has run far ahead, skips forward
+    void Render(int16_t* samples, int count);
+
+    int GetSampleRate() const { return m_sampleRate; }
+
+    // stretches (positive) or shrinks (negative) every emulated frame by this many parts per million of its
+    // nominal length, which slows down or speeds up emulation paced by the audio clock. The tone's pitch is unaffected
+    void SetRateAdjust(int32_t ppm) { m_rateAdjustPpm.store(ppm, std::memory_order_relaxed); }
+    int32_t GetRateAdjust() const { return m_rateAdjustPpm.load(std::memory_order_relaxed); }
+
+    // samples written by Render so far, whether or not there were frames to cover them
+    uint64_t GetSamplesRendered() const { return m_samplesRendered.load(std::memory_order_relaxed); }
+
+    // frame the next rendered sample belongs to
+    uint64_t GetRenderedFrames() const { return m_renderedFrames.load(std::memory_order_acquire); }
+
+    // number of Render calls that ran out of emulated frames
+    uint64_t GetUnderrunCount() const { return m_underruns.load(std::memory_order_relaxed); }
+
+    // number of times rendering fell so far behind that it skipped ahead
+    uint64_t GetSkipCount() const { return m_skips.load(std::memory_order_relaxed); }
+
+    // edges lost because the ring was full
+    uint64_t GetDroppedEdgeCount() const { return m_droppedEdges.load(std::memory_order_relaxed); }
+
+private:
+    struct ToneEdge
+    {
+        uint64_t frame;
+        bool on;
+        ToneVoice voice;
+    };
+
+    // audio thread only. Starts the next frame, whose length in samples carries over the rounding error of the last one
+    void BeginFrame();
+
+    // rendering skips ahead to SKIP_TARGET_FRAMES behind emulation once it's MAX_LAG_FRAMES behind
+    static const uint64_t MAX_LAG_FRAMES = 8;
+    static const uint64_t SKIP_TARGET_FRAMES = 2;
+
+    // samples of fade when the tone starts or stops, so gating doesn't click
+    static const int GATE_RAMP_SAMPLES = 48;
+
+    int m_sampleRate;
+
+    SpscQueue<ToneEdge, 256> m_edges;
+    std::atomic<uint64_t> m_renderableFrames;
+
+    std::atomic<int32_t> m_rateAdjustPpm;
+
+    // audio thread only. Position as the frame being rendered and the samples of it already rendered
+    uint64_t m_frame;
+    int m_sampleInFrame;
+    int m_frameLength;
+    double m_frameLengthError;
+    bool m_hasNextEdge;
+    ToneEdge m_nextEdge;
+    bool m_gate;
+    ToneVoice m_voice;
+    float m_amplitude;
+    double m_phase;
+
+    // position in the pattern (0 - 1) and how far it moves per sample
+    double m_patternPhase;
+    double m_patternStep;
+
+    // sample of the digitized sound being played and how far it moves per output sample
+    double m_streamPosition;
+    double m_streamStep;
+
+    std::atomic<uint64_t> m_renderedFrames;
+    std::atomic<uint64_t> m_samplesRendered;
+    std::atomic<uint64_t> m_underruns;
+    std::atomic<uint64_t> m_skips;
+    std::atomic<uint64_t> m_droppedEdges;
+};
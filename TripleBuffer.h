@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer for handing the latest value from one writer thread to one reader thread.
+// The writer fills the back buffer and publishes it, the reader picks up the newest published buffer.
+// Neither side ever waits for the other: a value published while the previous one is still unread replaces it
+// (a dropped frame), and a reader that finds nothing new keeps its current buffer (a duplicated frame).
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() :
+        m_buffers(),
+        m_middle(1),
+        m_back(0),
+        m_front(2),
+        m_dropped(0),
+        m_duplicated(0),
+        m_acquires(0)
+    {
+    }
+
+    // writer only. The buffer to fill before calling Publish
+    T& GetBackBuffer() { return m_buffers[m_back]; }
+
+    // writer only. Makes the back buffer the newest value and hands the writer a free buffer.
+    // returns true if the previous value was dropped. Its buffer is the new back buffer
+    bool Publish()
+    {
+        const uint8_t previous = m_middle.exchange(m_back | NEW_VALUE, std::memory_order_acq_rel);
+        m_back = previous & INDEX_MASK;
+
+        // the reader never saw the value that was just replaced
+        if (previous & NEW_VALUE)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        return false;
+    }
+
+    // reader only. Swaps in the newest published value. returns false if nothing was published since the last call
+    bool Acquire()
+    {
+        m_acquires.fetch_add(1, std::memory_order_relaxed);
+        if ((m_middle.load(std::memory_order_acquire) & NEW_VALUE) == 0)
+        {
+            m_duplicated.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        const uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX_MASK;
+        return true;
+    }
+
+    // reader only. The value picked up by the last successful Acquire
+    const T& GetFrontBuffer() const { return m_buffers[m_front]; }
+
+    // values replaced before the reader picked them up
+    uint64_t GetDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    // Acquire calls that found no new value
+    uint64_t GetDuplicatedCount() const { return m_duplicated.load(std::memory_order_relaxed); }
+
+    // all Acquire calls. With a reader that acquires once per display refresh, this counts refreshes
+    uint64_t GetAcquireCount() const { return m_acquires.load(std::memory_order_relaxed); }
+
+private:
+    // the middle index carries a flag that is set while it holds a value the reader hasn't picked up
+    static const uint8_t INDEX_MASK = 0x3;
+    static const uint8_t NEW_VALUE = 0x4;
+
+    std::array<T, 3> m_buffers;
+    std::atomic<uint8_t> m_middle;
+
+    // owned by the writer and the reader respectively
+    uint8_t m_back;
+    uint8_t m_front;
+
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint64_t> m_duplicated;
+    std::atomic<uint64_t> m_acquires;
+};
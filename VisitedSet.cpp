@@ -0,0 +1,76 @@
+#include "VisitedSet.h"
+
+VisitedSet::VisitedSet(size_t capacity) :
+    m_mask(0),
+    m_size(0),
+    m_zeroVisited(false)
+{
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+
+    m_mask = size - 1;
+    m_slots.reset(new std::atomic<uint64_t>[size]);
+    for (size_t i = 0; i < size; ++i)
+        m_slots[i].store(0, std::memory_order_relaxed);
+}
+
+VisitedSet::InsertResult VisitedSet::Insert(uint64_t hash)
+{
+    if (hash == 0)
+    {
+        if (m_zeroVisited.exchange(true, std::memory_order_acq_rel))
+            return InsertResult::AlreadyVisited;
+
+        m_size.fetch_add(1, std::memory_order_relaxed);
+        return InsertResult::Inserted;
+    }
+
+    // state hashes are already well mixed, so the low bits make a fine starting slot
+    size_t slot = hash & m_mask;
+    for (size_t probes = 0; probes <= m_mask; ++probes)
+    {
+        uint64_t current = m_slots[slot].load(std::memory_order_acquire);
+        if (current == hash)
+            return InsertResult::AlreadyVisited;
+
+        if (current == 0)
+        {
+            // claim the empty slot. If another thread got there first, check what it stored
+            if (m_slots[slot].compare_exchange_strong(current, hash, std::memory_order_acq_rel))
+            {
+                m_size.fetch_add(1, std::memory_order_relaxed);
+                return InsertResult::Inserted;
+            }
+
+            if (current == hash)
+                return InsertResult::AlreadyVisited;
+        }
+
+        slot = (slot + 1) & m_mask;
+    }
+
+    return InsertResult::TableFull;
+}
+
+bool VisitedSet::Contains(uint64_t hash) const
+{
+    if (hash == 0)
+        return m_zeroVisited.load(std::memory_order_acquire);
+
+    size_t slot = hash & m_mask;
+    for (size_t probes = 0; probes <= m_mask; ++probes)
+    {
+        uint64_t current = m_slots[slot].load(std::memory_order_acquire);
+        if (current == hash)
+            return true;
+
+        // slots are never cleared, so an empty slot ends the probe sequence
+        if (current == 0)
+            return false;
+
+        slot = (slot + 1) & m_mask;
+    }
+
+    return false;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Lock-free set of visited machine state hashes (see Chip8::GetStateHash).
+// Open addressing with linear probing over a fixed-size table of atomics. Any number of threads
+// may insert and query concurrently. The table never grows, so size it for the expected number of states.
+// An empty slot holds 0, so a hash of 0 can't go in the table. It's kept in a flag of its own instead,
+// and it doesn't alias any other hash.
+class VisitedSet
+{
+public:
+    enum class InsertResult
+    {
+        Inserted,
+        AlreadyVisited,
+        TableFull
+    };
+
+    // capacity is rounded up to the next power of two
+    explicit VisitedSet(size_t capacity);
+
+    // adds a state hash to the set. Returns AlreadyVisited if the hash was already in the set.
+    InsertResult Insert(uint64_t hash);
+
+    // returns true if the state hash is in the set
+    bool Contains(uint64_t hash) const;
+
+    // number of hashes in the set
+    size_t GetSize() const { return m_size.load(std::memory_order_relaxed); }
+    size_t GetCapacity() const { return m_mask + 1; }
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> m_slots;
+    size_t m_mask;
+    std::atomic<size_t> m_size;
+
+    // whether a hash of 0 was inserted, since 0 marks an empty slot
+    std::atomic<bool> m_zeroVisited;
+};
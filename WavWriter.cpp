@@ -0,0 +1,98 @@
+#include "WavWriter.h"
+
+WavWriter::WavWriter() :
+    m_file(nullptr),
+    m_sampleRate(0),
+    m_dataBytes(0)
+{
+}
+
+WavWriter::~WavWriter()
+{
+    Close();
+}
+
+int WavWriter::Open(const std::string& path, int sampleRate)
+{
+    Close();
+
+    m_file = fopen(path.c_str(), "wb");
+    if (m_file == nullptr)
+        return 1;
+
+    m_sampleRate = sampleRate;
+    m_dataBytes = 0;
+    WriteHeader();
+    return 0;
+}
+
+int WavWriter::Write(const int16_t* samples, int count)
+{
+    if (m_file == nullptr)
+        return 1;
+
+    // wav is little endian. Convert a chunk at a time
+    uint8_t bytes[1024];
+    for (int start = 0; start < count; start += sizeof(bytes) / 2)
+    {
+        const int chunk = count - start < (int)sizeof(bytes) / 2 ? count - start : (int)sizeof(bytes) / 2;
+        for (int i = 0; i < chunk; ++i)
+        {
+            bytes[i * 2] = (uint8_t)(samples[start + i] & 0xFF);
+            bytes[i * 2 + 1] = (uint8_t)((uint16_t)samples[start + i] >> 8);
+        }
+
+        if (fwrite(bytes, 1, chunk * 2, m_file) != (size_t)chunk * 2)
+            return 2;
+    }
+
+    m_dataBytes += count * 2;
+    return 0;
+}
+
+void WavWriter::Close()
+{
+    if (m_file == nullptr)
+        return;
+
+    // now that the sizes are known, rewrite the header
+    fseek(m_file, 0, SEEK_SET);
+    WriteHeader();
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+void WavWriter::WriteHeader()
+{
+    uint8_t header[44];
+    auto put32 = [&header](int offset, uint32_t value)
+    {
+        for (int i = 0; i < 4; ++i)
+            header[offset + i] = (uint8_t)(value >> (i * 8));
+    };
+    auto put16 = [&header](int offset, uint16_t value)
+    {
+        header[offset] = (uint8_t)value;
+        header[offset + 1] = (uint8_t)(value >> 8);
+    };
+
+    const uint16_t channels = 1;
+    const uint16_t bitsPerSample = 16;
+    const uint16_t blockAlign = channels * bitsPerSample / 8;
+
+    header[0] = 'R'; header[1] = 'I'; header[2] = 'F'; header[3] = 'F';
+    put32(4, 36 + m_dataBytes);
+    header[8] = 'W'; header[9] = 'A'; header[10] = 'V'; header[11] = 'E';
+    header[12] = 'f'; header[13] = 'm'; header[14] = 't'; header[15] = ' ';
+    put32(16, 16);
+    put16(20, 1);
+    put16(22, channels);
+    put32(24, m_sampleRate);
+    put32(28, m_sampleRate * blockAlign);
+    put16(32, blockAlign);
+    put16(34, bitsPerSample);
+    header[36] = 'd'; header[37] = 'a'; header[38] = 't'; header[39] = 'a';
+    put32(40, m_dataBytes);
+
+    fwrite(header, 1, sizeof(header), m_file);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+// Writes 16 bit mono PCM to a .wav file. Used to capture audio without a sound device
+class WavWriter
+{
+public:
+    WavWriter();
+
+    // finishes the file if it's still open
+    ~WavWriter();
+
+    // creates the file and writes a placeholder header. returns 0 if no errors. Otherwise returns an error code.
+    int Open(const std::string& path, int sampleRate);
+
+    // appends samples. returns 0 if no errors. Otherwise returns an error code.
+    int Write(const int16_t* samples, int count);
+
+    // fills in the sizes in the header and closes the file
+    void Close();
+
+private:
+    void WriteHeader();
+
+    FILE* m_file;
+    int m_sampleRate;
+    uint32_t m_dataBytes;
+};
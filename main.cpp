@@ -1,26 +1,449 @@
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include "BatchRunner.h"
+#include "Benchmark.h"
 #include "Chip8.h"
+#include "ControlFlowGraph.h"
+#include "FlagLiveness.h"
+#include "GoldenTest.h"
+#include "InputMovie.h"
+#include "ToneSynth.h"
+#include "WavWriter.h"
+
+// option names of the machine types and quirk profiles
+static const char* machineNames[] = { "chip8", "xochip", "megachip" };
+static const char* quirkNames[] = { "default", "cosmac", "schip", "xochip" };
+
+// parses a -machine option. returns 0 if no errors. Otherwise returns an error code.
+static int ParseMachine(const char* name, MachineType& machine)
+{
+    for (int i = 0; i < (int)(sizeof(machineNames) / sizeof(machineNames[0])); ++i)
+    {
+        if (strcmp(name, machineNames[i]) == 0)
+        {
+            machine = (MachineType)i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// parses a -quirks option. returns 0 if no errors. Otherwise returns an error code.
+static int ParseQuirks(const char* name, QuirkProfile& quirks)
+{
+    for (int i = 0; i < (int)(sizeof(quirkNames) / sizeof(quirkNames[0])); ++i)
+    {
+        if (strcmp(name, quirkNames[i]) == 0)
+        {
+            quirks = (QuirkProfile)i;
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// chip8 -batch jobList [-threads n] [-ipf instructionsPerFrame] [-hashevery frames] [-budget instructions] [-out file]
+static int RunBatch(int argc, char** argv)
+{
+    BatchRunner runner;
+    unsigned threads = 0;
+    const char* outFile = nullptr;
+
+    for (int i = 3; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-threads") == 0)
+            threads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-ipf") == 0)
+            runner.SetInstructionsPerFrame(atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "-hashevery") == 0)
+            runner.SetHashInterval(atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "-budget") == 0)
+            runner.SetDefaultInstructionBudget(strtoull(argv[i + 1], nullptr, 10));
+        else if (strcmp(argv[i], "-out") == 0)
+            outFile = argv[i + 1];
+        else
+        {
+            printf("Unknown batch option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    int errorCode = runner.LoadJobs(argv[2]);
+    if (errorCode != 0)
+    {
+        printf("Failed to load job list %s. Error code: %d\n", argv[2], errorCode);
+        return 1;
+    }
+
+    FILE* out = stdout;
+    if (outFile != nullptr && (out = fopen(outFile, "w")) == nullptr)
+    {
+        printf("Failed to open %s for writing\n", outFile);
+        return 1;
+    }
+
+    const int failures = runner.Run(threads, out);
+
+    if (out != stdout)
+        fclose(out);
+
+    return failures == 0 ? 0 : 1;
+}
+
+// chip8 -bench [-reps n] [-warmup n] [-instructions n] [-pin cpu] [-roms dir] [-out file]
+static int RunBenchmark(int argc, char** argv)
+{
+    BenchmarkOptions options;
+    const char* outFile = nullptr;
+
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-reps") == 0)
+            options.reps = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-warmup") == 0)
+            options.warmupReps = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-instructions") == 0)
+            options.instructionsPerRep = strtoull(argv[i + 1], nullptr, 10);
+        else if (strcmp(argv[i], "-pin") == 0)
+            options.pinCpu = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-roms") == 0)
+            options.romDir = argv[i + 1];
+        else if (strcmp(argv[i], "-out") == 0)
+            outFile = argv[i + 1];
+        else
+        {
+            printf("Unknown benchmark option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    FILE* out = stdout;
+    if (outFile != nullptr && (out = fopen(outFile, "w")) == nullptr)
+    {
+        printf("Failed to open %s for writing\n", outFile);
+        return 1;
+    }
+
+    const int errorCode = Benchmark::Run(options, out);
+
+    if (out != stdout)
+        fclose(out);
+
+    return errorCode;
+}
+
+// chip8 -scale [-instances n] [-threads n] [-frames n] [-rom file] [-out file]
+static int RunScalingBenchmark(int argc, char** argv)
+{
+    ScalingOptions options;
+    const char* outFile = nullptr;
+
+    for (int i = 2; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-instances") == 0)
+            options.instances = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-threads") == 0)
+            options.maxThreads = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-frames") == 0)
+            options.frames = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-rom") == 0)
+            options.romPath = argv[i + 1];
+        else if (strcmp(argv[i], "-out") == 0)
+            outFile = argv[i + 1];
+        else
+        {
+            printf("Unknown scaling benchmark option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    FILE* out = stdout;
+    if (outFile != nullptr && (out = fopen(outFile, "w")) == nullptr)
+    {
+        printf("Failed to open %s for writing\n", outFile);
+        return 1;
+    }
+
+    const int errorCode = Benchmark::RunScaling(options, out);
+
+    if (out != stdout)
+        fclose(out);
+
+    return errorCode;
+}
+
+// chip8 -disasm rom
+static int RunDisassembler(const char* romPath)
+{
+    std::ifstream file(romPath, std::ios::binary);
+    if (!file)
+    {
+        printf("Failed to open rom %s\n", romPath);
+        return 1;
+    }
+    const std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    ControlFlowGraph graph;
+    graph.Build(rom.data(), (uint32_t)rom.size(), FIRST_MEMORY_LOCATION, FIRST_MEMORY_LOCATION);
+    const std::vector<DecodedInstruction>& instructions = graph.GetInstructions();
+    const std::vector<uint32_t> deadFlagWrites = FlagLiveness::FindDeadFlagWrites(graph);
+
+    // every block with its instructions, then whatever wasn't reached as data
+    for (const BasicBlock& block : graph.GetBlocks())
+    {
+        printf("\n%s0x%03X:", block.subroutine ? "sub " : "", block.start);
+        for (int i = 0; i < block.successorCount; ++i)
+            printf(" -> 0x%03X", block.successors[i]);
+        if (block.unresolved)
+            printf(" -> ?");
+        printf("\n");
+
+        // instructions whose VF write is never read are marked
+        for (int i = block.firstInstruction; i < block.lastInstruction; ++i)
+        {
+            const bool deadFlag = std::binary_search(deadFlagWrites.begin(), deadFlagWrites.end(), instructions[i].address);
+            printf("    0x%03X  %04X  %-20s%s\n", instructions[i].address, instructions[i].opcode, Disassembler::Format(instructions[i]).c_str(),
+                deadFlag ? "; vF dead" : "");
+        }
+    }
+
+    int dataBytes = 0;
+    printf("\n");
+    for (uint32_t address = FIRST_MEMORY_LOCATION; address < FIRST_MEMORY_LOCATION + rom.size(); )
+    {
+        if (graph.IsCode(address))
+        {
+            ++address;
+            continue;
+        }
+
+        const uint32_t start = address;
+        while (address < FIRST_MEMORY_LOCATION + rom.size() && !graph.IsCode(address))
+            ++address;
+        printf("data 0x%03X - 0x%03X (%u bytes)\n", start, address - 1, address - start);
+        dataBytes += address - start;
+    }
+
+    printf("%d instructions in %d blocks, %d calls, %d bytes of data, %d dead VF writes\n", (int)instructions.size(), (int)graph.GetBlocks().size(),
+        (int)graph.GetCalls().size(), dataBytes, (int)deadFlagWrites.size());
+    return 0;
+}
+
+// chip8 -wav rom movie frames out.wav [-tick tickRate] [-machine chip8|xochip|megachip] [-quirks default|cosmac|schip|xochip]
+static int RenderWav(int argc, char** argv)
+{
+    const char* romPath = argv[2];
+    const char* moviePath = argv[3];
+    const uint32_t frames = (uint32_t)strtoul(argv[4], nullptr, 10);
+    const char* wavPath = argv[5];
+
+    int tickrate = 500;
+    MachineType machine = MACHINE_CHIP8;
+    QuirkProfile quirks = QUIRKS_DEFAULT;
+    for (int i = 6; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-tick") == 0)
+            tickrate = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-machine") == 0)
+        {
+            if (ParseMachine(argv[i + 1], machine) != 0)
+            {
+                printf("Unknown machine %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-quirks") == 0)
+        {
+            if (ParseQuirks(argv[i + 1], quirks) != 0)
+            {
+                printf("Unknown quirk profile %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else
+        {
+            printf("Unknown wav option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    Chip8 emu;
+    int errorCode = emu.Init(tickrate, machine, quirks);
+    if (errorCode == 0)
+        errorCode = emu.LoadGame(romPath);
+    if (errorCode != 0)
+    {
+        printf("Failed to load Chip8 rom %s. Error code: %d\n", romPath, errorCode);
+        return 1;
+    }
+
+    InputMovie movie;
+    if (strcmp(moviePath, "-") != 0 && movie.Load(moviePath) != 0)
+    {
+        printf("Failed to load input movie %s\n", moviePath);
+        return 1;
+    }
+
+    ToneSynth synth;
+    WavWriter wav;
+    if (wav.Open(wavPath, synth.GetSampleRate()) != 0)
+    {
+        printf("Failed to open %s for writing\n", wavPath);
+        return 1;
+    }
+
+    // same edges the emulation thread reports in Run(), rendered a frame at a time as soon as each frame is done
+    std::vector<int16_t> samples;
+    bool toneOn = false;
+    ToneVoice voice = emu.GetToneVoice();
+    uint32_t toneFrames = 0;
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        emu.SetKeyboardState(movie.GetKeyState(frame));
+        emu.RunFrame((int)((frame + 1ull) * tickrate / 60 - frame * (uint64_t)tickrate / 60));
+
+        if (emu.IsSoundOn() != toneOn || emu.GetToneVoice() != voice)
+        {
+            toneOn = emu.IsSoundOn();
+            voice = emu.GetToneVoice();
+            synth.PushEdge(frame, toneOn, voice);
+        }
+        synth.SetRenderableFrames(frame + 1);
+        toneFrames += toneOn ? 1 : 0;
+
+        const int sampleRate = synth.GetSampleRate();
+        samples.resize((size_t)((frame + 1ull) * sampleRate / 60 - frame * (uint64_t)sampleRate / 60));
+        synth.Render(samples.data(), (int)samples.size());
+        if (wav.Write(samples.data(), (int)samples.size()) != 0)
+        {
+            printf("Failed to write %s\n", wavPath);
+            return 1;
+        }
+    }
+
+    wav.Close();
+    printf("Wrote %u frames of audio to %s. Tone on for %u frames, %llu underruns\n", frames, wavPath, toneFrames,
+        (unsigned long long)synth.GetUnderrunCount());
+    return 0;
+}
 
 int main(int argc, char** argv) 
 {
     if (argc < 2)
     {
-        printf("Please supply a chip8 rom. Correct syntax is:\n%s \"romname.rom\" [-tick tickRate]\n", argv[0]);
+        printf("Please supply a chip8 rom. Correct syntax is:\n%s \"romname.rom\" [-tick tickRate] [-runahead frames] [-speculate keys] [-pace wall|audio|vsync] [-machine chip8|xochip|megachip] [-quirks default|cosmac|schip|xochip]\n", argv[0]);
+        printf("To run headless jobs instead:\n%s -batch jobList [-threads n] [-ipf n] [-hashevery frames] [-budget instructions] [-out file]\n", argv[0]);
+        printf("To check the golden-frame regression cases:\n%s -golden caseList [-update | -checkflags]\n", argv[0]);
+        printf("To benchmark the interpreter:\n%s -bench [-reps n] [-warmup n] [-instructions n] [-pin cpu] [-roms dir] [-out file]\n", argv[0]);
+        printf("To record the beeper to a wav file without a window:\n%s -wav rom movie frames out.wav [-tick tickRate] [-machine chip8|xochip|megachip] [-quirks default|cosmac|schip|xochip]\n", argv[0]);
+        printf("To list a rom's code by basic block, and its data:\n%s -disasm rom\n", argv[0]);
+        printf("To benchmark many instances at once:\n%s -scale [-instances n] [-threads n] [-frames n] [-rom file] [-out file]\n", argv[0]);
         return 1;
     }
+
+    if (argc >= 3 && strcmp(argv[1], "-batch") == 0)
+        return RunBatch(argc, argv);
+
+    if (strcmp(argv[1], "-bench") == 0)
+        return RunBenchmark(argc, argv);
+
+    if (strcmp(argv[1], "-scale") == 0)
+        return RunScalingBenchmark(argc, argv);
+
+    if (argc >= 3 && strcmp(argv[1], "-disasm") == 0)
+        return RunDisassembler(argv[2]);
+
+    if (argc >= 6 && strcmp(argv[1], "-wav") == 0)
+        return RenderWav(argc, argv);
+
+    if (argc >= 3 && strcmp(argv[1], "-golden") == 0)
+    {
+        const bool update = argc >= 4 && strcmp(argv[3], "-update") == 0;
+        const bool checkFlags = argc >= 4 && strcmp(argv[3], "-checkflags") == 0;
+        const int failures = GoldenTest::Run(argv[2], update, checkFlags);
+        if (failures < 0)
+        {
+            printf("Failed to load golden case list %s\n", argv[2]);
+            return 1;
+        }
+
+        printf("%d golden case(s) failed\n", failures);
+        return failures == 0 ? 0 : 1;
+    }
     
+    // -tick and -quirks override what the rom database says about the rom
     int tickrate = 500;
-    if (argc >= 3)
+    bool tickrateSpecified = false;
+    bool quirksSpecified = false;
+    bool machineSpecified = false;
+    int runAhead = 0;
+    int speculation = 0;
+    PacingMode pacing = PACING_WALL_CLOCK;
+    MachineType machine = MACHINE_CHIP8;
+    QuirkProfile quirks = QUIRKS_DEFAULT;
+    for (int i = 2; i + 1 < argc; i += 2)
     {
-        if (argv[1] == "-tick")
+        if (strcmp(argv[i], "-tick") == 0)
         {
-            tickrate = atoi(argv[2]);
+            tickrate = atoi(argv[i + 1]);
+            tickrateSpecified = true;
             printf("-tick flag specified tickrate to %d\n", tickrate);
         }
+        else if (strcmp(argv[i], "-runahead") == 0)
+        {
+            runAhead = atoi(argv[i + 1]);
+            printf("-runahead flag specified %d frame(s) of run-ahead\n", runAhead);
+        }
+        else if (strcmp(argv[i], "-speculate") == 0)
+        {
+            speculation = atoi(argv[i + 1]);
+            printf("-speculate flag specified speculating on %d key(s) per frame\n", speculation);
+        }
+        else if (strcmp(argv[i], "-pace") == 0)
+        {
+            if (strcmp(argv[i + 1], "audio") == 0)
+                pacing = PACING_AUDIO;
+            else if (strcmp(argv[i + 1], "wall") == 0)
+                pacing = PACING_WALL_CLOCK;
+            else if (strcmp(argv[i + 1], "vsync") == 0)
+                pacing = PACING_VSYNC;
+            else
+            {
+                printf("Unknown pacing mode %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "-machine") == 0)
+        {
+            if (ParseMachine(argv[i + 1], machine) != 0)
+            {
+                printf("Unknown machine %s\n", argv[i + 1]);
+                return 1;
+            }
+            machineSpecified = true;
+        }
+        else if (strcmp(argv[i], "-quirks") == 0)
+        {
+            if (ParseQuirks(argv[i + 1], quirks) != 0)
+            {
+                printf("Unknown quirk profile %s\n", argv[i + 1]);
+                return 1;
+            }
+            quirksSpecified = true;
+        }
     }
-    
+
     Chip8 emu;
-    int errorCode = emu.Init(tickrate);
+    emu.SetRunAhead(runAhead);
+    emu.SetSpeculation(speculation);
+    emu.SetPacing(pacing);
+    int errorCode = emu.Init(tickrate, machine, quirks);
     if (errorCode != 0)
     {
         printf("Failed to initialize Chip8 emulator. Error code: %d\n", errorCode);
@@ -36,6 +459,31 @@ int main(int argc, char** argv)
         printf("Failed to load Chip8 rom %s. Error code: %d\n", "TEST_ROM", errorCode);
         return 1;
     }
+    printf("Loaded %d bytes into memory\n", emu.GetRomSize());
+
+    // roms that use the extensions of a bigger machine are reloaded on one
+    if (!machineSpecified && emu.GetRomMachine() != machine)
+    {
+        machine = emu.GetRomMachine();
+        printf("Rom uses %s instructions, switching machines\n", machineNames[machine]);
+        if (emu.Init(tickrate, machine, quirks) != 0 || emu.LoadGame(argv[1]) != 0)
+        {
+            printf("Failed to reload Chip8 rom %s\n", argv[1]);
+            return 1;
+        }
+    }
+
+    const RomInfo& info = emu.GetRomInfo();
+    if (emu.IsRomKnown())
+        printf("Found rom %016llX in the rom database\n", (unsigned long long)emu.GetRomHash());
+    else
+        printf("Rom %016llX is not in the rom database, inferred its settings from the code\n", (unsigned long long)emu.GetRomHash());
+
+    if (!quirksSpecified)
+        emu.SetQuirkProfile(info.quirks);
+    if (!tickrateSpecified)
+        emu.SetTickrate(info.instructionsPerFrame * 60);
+    printf("Running with %s quirks at %u instructions per frame\n", quirkNames[emu.GetQuirkProfile()], emu.GetTickrate() / 60);
 
     printf("Starting %s...\n", "TEST_ROM");
     emu.Run();